@@ -0,0 +1,38 @@
+// Benchmarks.cpp
+// Runs the micro benchmarks used to tune CameraStreamer. Usage: Benchmarks <name> [arguments]
+
+#include <iostream>
+#include <map>
+#include <string>
+
+#include "Logger.h"
+#include "Benchmarks.h"
+
+using namespace std;
+
+int main(int argc, char* argv[])
+{
+	// structure that lists benchmarks -> points to the function that runs them
+	typedef std::map<string, int(*)(int, char*[])> BenchmarkNameToFunctionMap;
+	BenchmarkNameToFunctionMap SupportedBenchmarks = {
+		{"depthcodec", &DepthCodecBenchmark},
+		{"shmring", &SharedMemoryRingBenchmark},
+		{"localsocket", &LocalSocketBenchmark},
+		{"multicast", &MulticastBenchmark},
+		{"pointcloud", &PointCloudBenchmark},
+		{"mjpeg", &MJPEGBenchmark},
+		{"egress", &EgressBenchmark},
+	};
+
+	BenchmarkNameToFunctionMap::const_iterator benchmark = (argc > 1) ? SupportedBenchmarks.find(argv[1]) : SupportedBenchmarks.end();
+	if (benchmark == SupportedBenchmarks.end())
+	{
+		Logger::Log("Benchmarks") << "Usage: " << argv[0] << " <benchmark> [arguments]" << endl;
+		Logger::Log("Benchmarks") << "Available benchmarks:" << endl;
+		for (const auto& entry : SupportedBenchmarks)
+			Logger::Log("Benchmarks") << "\t" << entry.first << endl;
+		return 1;
+	}
+
+	return benchmark->second(argc - 2, argv + 2);
+}
@@ -0,0 +1,14 @@
+#pragma once
+
+// Benchmarks.h
+// Every benchmark is a function that gets the command line arguments that follow its name
+// (e.g.: "Benchmarks.exe depthcodec file.depth" calls DepthCodecBenchmark with "file.depth")
+// and returns the process exit code.
+
+int DepthCodecBenchmark(int argc, char* argv[]);
+int SharedMemoryRingBenchmark(int argc, char* argv[]);
+int LocalSocketBenchmark(int argc, char* argv[]);
+int MulticastBenchmark(int argc, char* argv[]);
+int PointCloudBenchmark(int argc, char* argv[]);
+int MJPEGBenchmark(int argc, char* argv[]);
+int EgressBenchmark(int argc, char* argv[]);
@@ -0,0 +1,198 @@
+// DepthCodecBenchmark.cpp
+// Compares the depth codecs (see DepthCodec.h) on depth files recorded by VideoRecorder.
+//
+// Usage: Benchmarks depthcodec <file.depth> [more files] [--frames N]
+//
+// For every file and codec, it reports the compression ratio and how long it takes to
+// encode/decode a pixel. Every frame is decoded and compared to the original, so codecs
+// are also checked for being lossless.
+
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "Logger.h"
+#include "DepthCodec.h"
+#include "Benchmarks.h"
+
+using namespace std;
+
+static const char* DepthCodecBenchmarkConstStr = "DepthCodecBenchmark";
+
+// a depth recording loaded in memory
+struct DepthRecording
+{
+	unsigned long width = 0, height = 0;
+	vector<vector<uint16_t> > frames;
+};
+
+// reads "resolution": [w, h] and "codec": "name" from the json header VideoRecorder writes
+static bool ParseDepthHeader(const string& header, unsigned long& width, unsigned long& height, DepthCodec::Type& codec)
+{
+	size_t resolution = header.find("\"resolution\"");
+	if (resolution == string::npos) return false;
+
+	resolution = header.find('[', resolution);
+	if (resolution == string::npos) return false;
+
+	char* end = nullptr;
+	width = strtoul(header.c_str() + resolution + 1, &end, 10);
+	while (*end == ',' || *end == ' ') ++end;
+	height = strtoul(end, nullptr, 10);
+
+	// files recorded before depth codecs existed are raw
+	codec = DepthCodec::Type::Raw;
+	size_t codecField = header.find("\"codec\"");
+	if (codecField != string::npos)
+	{
+		size_t nameStart = header.find('"', header.find(':', codecField));
+		size_t nameEnd = (nameStart == string::npos) ? string::npos : header.find('"', nameStart + 1);
+		if (nameEnd == string::npos || !DepthCodec::TypeFromString(header.substr(nameStart + 1, nameEnd - nameStart - 1), codec))
+			return false;
+	}
+
+	return width > 0 && height > 0;
+}
+
+static bool LoadDepthRecording(const string& filename, size_t maxFrames, DepthRecording& recording)
+{
+	ifstream file(filename, ios::in | ios::binary);
+	if (!file.is_open())
+	{
+		Logger::Log(DepthCodecBenchmarkConstStr) << "Could not open " << filename << endl;
+		return false;
+	}
+
+	string header;
+	DepthCodec::Type codec;
+	if (!getline(file, header) || !ParseDepthHeader(header, recording.width, recording.height, codec))
+	{
+		Logger::Log(DepthCodecBenchmarkConstStr) << "Invalid depth file header in " << filename << endl;
+		return false;
+	}
+
+	const size_t pixels = (size_t)recording.width * recording.height;
+	vector<unsigned char> compressed;
+
+	while (recording.frames.size() < maxFrames)
+	{
+		long long ticks;
+		if (!file.read((char*)&ticks, sizeof(long long)))
+			break;
+
+		vector<uint16_t> frame(pixels);
+		if (codec == DepthCodec::Type::Raw)
+		{
+			if (!file.read((char*)frame.data(), pixels * sizeof(uint16_t)))
+				break;
+		}
+		else {
+			// compressed frames are [length][compressed frame]
+			uint32_t length;
+			if (!file.read((char*)&length, sizeof(uint32_t)))
+				break;
+
+			compressed.resize(length);
+			if (!file.read((char*)compressed.data(), length))
+				break;
+
+			if (!DepthCodec::DecompressPixels(codec, compressed.data(), length, frame.data(), recording.width, recording.height))
+			{
+				Logger::Log(DepthCodecBenchmarkConstStr) << "Corrupted frame #" << recording.frames.size() << " in " << filename << endl;
+				return false;
+			}
+		}
+
+		recording.frames.push_back(std::move(frame));
+	}
+
+	return !recording.frames.empty();
+}
+
+static void BenchmarkCodec(DepthCodec::Type codec, const DepthRecording& recording)
+{
+	typedef std::chrono::high_resolution_clock Clock;
+
+	const size_t pixels = (size_t)recording.width * recording.height;
+	vector<unsigned char> compressed(DepthCodec::MaxCompressedSize(codec, pixels));
+	vector<uint16_t> decompressed(pixels);
+
+	size_t rawBytes = 0, compressedBytes = 0, mismatches = 0;
+	Clock::duration encodeTime(0), decodeTime(0);
+
+	for (const vector<uint16_t>& frame : recording.frames)
+	{
+		Clock::time_point start = Clock::now();
+		size_t length = DepthCodec::CompressPixels(codec, frame.data(), recording.width, recording.height, compressed.data(), compressed.size());
+		Clock::time_point encoded = Clock::now();
+		bool decoded = length > 0 && DepthCodec::DecompressPixels(codec, compressed.data(), length, decompressed.data(), recording.width, recording.height);
+		Clock::time_point end = Clock::now();
+
+		encodeTime += encoded - start;
+		decodeTime += end - encoded;
+		rawBytes += pixels * sizeof(uint16_t);
+		compressedBytes += length;
+
+		if (!decoded || memcmp(frame.data(), decompressed.data(), pixels * sizeof(uint16_t)) != 0)
+			++mismatches;
+	}
+
+	const double totalPixels = (double)pixels * recording.frames.size();
+	const double encodeNs = std::chrono::duration<double, std::nano>(encodeTime).count() / totalPixels;
+	const double decodeNs = std::chrono::duration<double, std::nano>(decodeTime).count() / totalPixels;
+
+	Logger::Log(DepthCodecBenchmarkConstStr) << setw(5) << DepthCodec::TypeToString(codec)
+		<< " ratio: " << fixed << setprecision(2) << (compressedBytes ? (double)rawBytes / compressedBytes : 0.0)
+		<< " encode: " << setprecision(3) << encodeNs << " ns/pixel"
+		<< " decode: " << decodeNs << " ns/pixel"
+		<< (mismatches ? " (NOT LOSSLESS: " + to_string(mismatches) + " frames differ)" : string()) << endl;
+}
+
+int DepthCodecBenchmark(int argc, char* argv[])
+{
+	vector<string> filenames;
+	size_t maxFrames = 300;
+
+	for (int i = 0; i < argc; ++i)
+	{
+		if (strcmp(argv[i], "--frames") == 0 && i + 1 < argc)
+			maxFrames = strtoul(argv[++i], nullptr, 10);
+		else
+			filenames.push_back(argv[i]);
+	}
+
+	if (filenames.empty())
+	{
+		Logger::Log(DepthCodecBenchmarkConstStr) << "Usage: depthcodec <file.depth> [more files] [--frames N]" << endl;
+		Logger::Log(DepthCodecBenchmarkConstStr) << "(depth files are the ones saved by CameraStreamer when recording depth)" << endl;
+		return 1;
+	}
+
+	const DepthCodec::Type codecs[] = { DepthCodec::Type::RVL, DepthCodec::Type::ZstdDelta, DepthCodec::Type::LZ4Delta };
+
+	for (const string& filename : filenames)
+	{
+		DepthRecording recording;
+		if (!LoadDepthRecording(filename, maxFrames, recording))
+			return 1;
+
+		Logger::Log(DepthCodecBenchmarkConstStr) << filename << ": " << recording.frames.size() << " frames ("
+			<< recording.width << 'x' << recording.height << ')' << endl;
+
+		for (DepthCodec::Type codec : codecs)
+		{
+			if (DepthCodec::IsAvailable(codec))
+				BenchmarkCodec(codec, recording);
+			else
+				Logger::Log(DepthCodecBenchmarkConstStr) << setw(5) << DepthCodec::TypeToString(codec) << " not compiled in (see CompilerConfiguration.h)" << endl;
+		}
+	}
+
+	return 0;
+}
@@ -0,0 +1,192 @@
+// EgressBenchmark.cpp
+// Measures how much the streaming server's network thread pays to push frames to many
+// clients, with whichever backend boost.asio was built with (epoll by default on Linux,
+// io_uring when enabled - see CompilerConfiguration.h). Build it both ways to compare.
+//
+// Usage: Benchmarks egress [message size in KB] [--seconds N] [--clients N [N ...]]
+//
+// Like TCPStreamingServer, a single thread writes every message (a small header and a
+// frame, as a buffer sequence) to every client over loopback TCP. Clients read on their
+// own thread and discard what they get. CPU time is the sender thread's only.
+
+#include "CompilerConfiguration.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include <boost/asio.hpp>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
+#include "Logger.h"
+#include "NetworkBackend.h"
+#include "Benchmarks.h"
+
+using namespace std;
+using boost::asio::ip::tcp;
+
+static const char* EgressBenchmarkConstStr = "EgressBenchmark";
+
+// cpu time used by the calling thread so far
+static double ThreadCPUSeconds()
+{
+#ifdef _WIN32
+	FILETIME creation, exit, kernel, user;
+	GetThreadTimes(GetCurrentThread(), &creation, &exit, &kernel, &user);
+	const ULONGLONG kernelTime = ((ULONGLONG)kernel.dwHighDateTime << 32) | kernel.dwLowDateTime;
+	const ULONGLONG userTime = ((ULONGLONG)user.dwHighDateTime << 32) | user.dwLowDateTime;
+	return (kernelTime + userTime) / 1e7; // 100 ns ticks
+#else
+	timespec now;
+	clock_gettime(CLOCK_THREAD_CPUTIME_ID, &now);
+	return now.tv_sec + now.tv_nsec / 1e9;
+#endif
+}
+
+// writes the same message over and over to a client
+struct Sender
+{
+	tcp::socket socket;
+	const vector<boost::asio::const_buffer>& message;
+	size_t& messagesSent;
+
+	Sender(boost::asio::io_context& io_context, const vector<boost::asio::const_buffer>& message, size_t& messagesSent) :
+		socket(io_context), message(message), messagesSent(messagesSent) {}
+
+	void Write()
+	{
+		boost::asio::async_write(socket, message, [this](const boost::system::error_code& error, size_t)
+		{
+			if (error) return;
+			++messagesSent;
+			Write();
+		});
+	}
+};
+
+// reads whatever comes and throws it away
+struct Receiver
+{
+	tcp::socket socket;
+	vector<unsigned char> buffer;
+
+	Receiver(boost::asio::io_context& io_context) : socket(io_context), buffer(256 * 1024) {}
+
+	void Read()
+	{
+		socket.async_read_some(boost::asio::buffer(buffer), [this](const boost::system::error_code& error, size_t)
+		{
+			if (!error) Read();
+		});
+	}
+};
+
+static void BenchmarkClients(size_t clients, const vector<unsigned char>& header, const vector<unsigned char>& frame, std::chrono::seconds duration)
+{
+	boost::asio::io_context senderContext, receiverContext;
+	tcp::acceptor acceptor(senderContext, tcp::endpoint(boost::asio::ip::address_v4::loopback(), 0));
+
+	const vector<boost::asio::const_buffer> message = { boost::asio::buffer(header), boost::asio::buffer(frame) };
+	size_t messagesSent = 0;
+
+	vector<unique_ptr<Sender> > senders;
+	vector<unique_ptr<Receiver> > receivers;
+	for (size_t i = 0; i < clients; ++i)
+	{
+		receivers.emplace_back(new Receiver(receiverContext));
+		receivers.back()->socket.connect(acceptor.local_endpoint());
+		senders.emplace_back(new Sender(senderContext, message, messagesSent));
+		acceptor.accept(senders.back()->socket);
+	}
+
+	for (unique_ptr<Receiver>& receiver : receivers)
+		receiver->Read();
+	thread receiverThread([&receiverContext]() { receiverContext.run(); });
+
+	for (unique_ptr<Sender>& sender : senders)
+		sender->Write();
+
+	const double cpuStart = ThreadCPUSeconds();
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	senderContext.run_for(duration);
+	const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	const double cpuSeconds = ThreadCPUSeconds() - cpuStart;
+
+	for (unique_ptr<Sender>& sender : senders)
+	{
+		boost::system::error_code error;
+		sender->socket.close(error);
+	}
+	receiverContext.stop();
+	receiverThread.join();
+
+	const double bytes = messagesSent * (double)(header.size() + frame.size());
+	Logger::Log(EgressBenchmarkConstStr) << setw(3) << clients << " client(s): " << fixed << setprecision(0) << (bytes / (1024.0 * 1024.0)) / seconds << " MB/s, "
+		<< messagesSent / seconds << " messages/s - sender cpu " << setprecision(1) << (100.0 * cpuSeconds) / seconds << "%, "
+		<< setprecision(2) << (messagesSent ? (cpuSeconds * 1e6) / messagesSent : 0.0) << " us/message" << endl;
+}
+
+int EgressBenchmark(int argc, char* argv[])
+{
+	size_t messageSize = 1024 * 1024;
+	std::chrono::seconds duration(3);
+	vector<size_t> clientCounts;
+
+	bool readingClients = false;
+	for (int i = 0; i < argc; ++i)
+	{
+		if (strcmp(argv[i], "--seconds") == 0 && i + 1 < argc)
+		{
+			duration = std::chrono::seconds(strtoul(argv[++i], nullptr, 10));
+			readingClients = false;
+		}
+		else if (strcmp(argv[i], "--clients") == 0)
+			readingClients = true;
+		else if (readingClients)
+			clientCounts.push_back(strtoul(argv[i], nullptr, 10));
+		else
+			messageSize = strtoul(argv[i], nullptr, 10) * 1024;
+	}
+
+	if (clientCounts.empty())
+		clientCounts = { 1, 10, 100 };
+
+	if (messageSize == 0 || duration.count() == 0)
+	{
+		Logger::Log(EgressBenchmarkConstStr) << "Usage: egress [message size in KB] [--seconds N] [--clients N [N ...]]" << endl;
+		return 1;
+	}
+
+	// a version 1 header followed by a frame
+	vector<unsigned char> header(5 * sizeof(uint32_t), 0), frame(messageSize);
+	for (size_t i = 0; i < frame.size(); ++i)
+		frame[i] = (unsigned char)(i * 31);
+
+	Logger::Log(EgressBenchmarkConstStr) << "Backend: " << NetworkBackendName() << " - messages of " << messageSize / 1024 << " KB for " << duration.count() << " s" << endl;
+
+	try
+	{
+		for (size_t clients : clientCounts)
+			if (clients > 0)
+				BenchmarkClients(clients, header, frame, duration);
+	}
+	catch (const std::exception& e)
+	{
+		Logger::Log(EgressBenchmarkConstStr) << "Error: " << e.what() << endl;
+		return 1;
+	}
+
+	return 0;
+}
@@ -0,0 +1,128 @@
+// LocalSocketBenchmark.cpp
+// Compares the latency of loopback TCP and unix domain sockets (see "localSocket"
+// in the "streaming" section of the configuration file).
+//
+// Usage: Benchmarks localsocket [message size in bytes] [--messages N]
+//
+// Messages are sent one at a time and echoed back (just a few bytes), so the
+// round trip time measures how long a message takes to reach the other end.
+
+#include "CompilerConfiguration.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <iomanip>
+#include <iostream>
+#include <numeric>
+#include <string>
+#include <thread>
+#include <vector>
+#include <boost/asio.hpp>
+
+#include "Logger.h"
+#include "Benchmarks.h"
+
+using namespace std;
+using boost::asio::ip::tcp;
+
+static const char* LocalSocketBenchmarkConstStr = "LocalSocketBenchmark";
+
+// sends messages from one socket and echoes them back from the other
+template <class Protocol>
+static void BenchmarkStreamSocket(const char* transport, const typename Protocol::endpoint& listenEndpoint, size_t messageSize, size_t messages)
+{
+	boost::asio::io_context io_context;
+	typename Protocol::acceptor acceptor(io_context, listenEndpoint);
+	typename Protocol::socket client(io_context), server(io_context);
+	client.connect(acceptor.local_endpoint());
+	acceptor.accept(server);
+
+	vector<unsigned char> message(messageSize, 0x5a);
+
+	// server reads whole messages and answers with their first 8 bytes
+	thread echo([&]()
+	{
+		vector<unsigned char> received(messageSize);
+		boost::system::error_code error;
+		for (size_t i = 0; i < messages; ++i)
+		{
+			boost::asio::read(server, boost::asio::buffer(received), error);
+			if (!error)
+				boost::asio::write(server, boost::asio::buffer(received.data(), sizeof(uint64_t)), error);
+			if (error)
+				break;
+		}
+	});
+
+	vector<double> roundTrips;
+	roundTrips.reserve(messages);
+
+	uint64_t answer;
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	for (size_t i = 0; i < messages; ++i)
+	{
+		std::chrono::steady_clock::time_point sent = std::chrono::steady_clock::now();
+		boost::asio::write(client, boost::asio::buffer(message));
+		boost::asio::read(client, boost::asio::buffer(&answer, sizeof(uint64_t)));
+		roundTrips.push_back(std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - sent).count());
+	}
+	const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	echo.join();
+
+	sort(roundTrips.begin(), roundTrips.end());
+	const double mean = accumulate(roundTrips.begin(), roundTrips.end(), 0.0) / roundTrips.size();
+
+	Logger::Log(LocalSocketBenchmarkConstStr) << setw(12) << transport << ": round trip mean " << fixed << setprecision(1) << mean << " us"
+		<< " p50 " << roundTrips[roundTrips.size() / 2] << " us"
+		<< " p99 " << roundTrips[min(roundTrips.size() - 1, roundTrips.size() * 99 / 100)] << " us"
+		<< " (" << setprecision(0) << (messages * (double)messageSize / (1024.0 * 1024.0)) / seconds << " MB/s)" << endl;
+}
+
+int LocalSocketBenchmark(int argc, char* argv[])
+{
+	size_t messageSize = 64 * 1024, messages = 2000;
+
+	for (int i = 0; i < argc; ++i)
+	{
+		if (strcmp(argv[i], "--messages") == 0 && i + 1 < argc)
+			messages = strtoul(argv[++i], nullptr, 10);
+		else
+			messageSize = strtoul(argv[i], nullptr, 10);
+	}
+
+	if (messageSize < sizeof(uint64_t) || messages == 0)
+	{
+		Logger::Log(LocalSocketBenchmarkConstStr) << "Usage: localsocket [message size in bytes] [--messages N]" << endl;
+		return 1;
+	}
+
+	Logger::Log(LocalSocketBenchmarkConstStr) << messages << " messages of " << messageSize << " bytes" << endl;
+
+	try
+	{
+		BenchmarkStreamSocket<tcp>("loopback tcp", tcp::endpoint(boost::asio::ip::address_v4::loopback(), 0), messageSize, messages);
+
+#ifdef BOOST_ASIO_HAS_LOCAL_SOCKETS
+		const std::string path = (std::filesystem::temp_directory_path() / "CameraStreamerBenchmark.sock").string();
+		std::error_code removeError;
+		std::filesystem::remove(path, removeError);
+
+		BenchmarkStreamSocket<boost::asio::local::stream_protocol>("unix socket", boost::asio::local::stream_protocol::endpoint(path), messageSize, messages);
+
+		std::filesystem::remove(path, removeError);
+#else
+		Logger::Log(LocalSocketBenchmarkConstStr) << " unix socket: not supported on this platform" << endl;
+#endif
+	}
+	catch (const std::exception& e)
+	{
+		Logger::Log(LocalSocketBenchmarkConstStr) << "Error: " << e.what() << endl;
+		return 1;
+	}
+
+	return 0;
+}
@@ -0,0 +1,169 @@
+// MJPEGBenchmark.cpp
+// Measures what MJPEG cameras (e.g.: the Azure Kinect) save by forwarding their jpeg images
+// as they are, and what consumers that need pixels pay to decode them (see JPEGDecoder).
+//
+// Usage: Benchmarks mjpeg [width height] [--frames N] [--quality Q] [--threads N]
+//
+// The image is synthetic (gradients and noise) and is compressed once with JPEGEncoder.
+// "decode + encode" is what streaming used to cost per frame before passthrough, and
+// DCT scaling (1/2, 1/4) is compared with decoding the whole image and resizing it.
+// Last, frames go through a decode stage like the Azure Kinect's (see "decodeColor"),
+// which is what tells whether decoding keeps up with the camera.
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "Logger.h"
+#include "FrameConversion.h"
+#include "JPEGDecoder.h"
+#include "JPEGEncoder.h"
+#include "OrderedWorkerPool.h"
+#include "Benchmarks.h"
+
+using namespace std;
+
+static const char* MJPEGBenchmarkConstStr = "MJPEGBenchmark";
+
+// runs work frames times and logs how long each run took. returns false if work failed
+static bool BenchmarkStep(const char* name, size_t frames, const function<std::shared_ptr<Frame>()>& work)
+{
+	std::shared_ptr<Frame> output;
+
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	for (size_t i = 0; i < frames; ++i)
+	{
+		output = work();
+		if (!output)
+		{
+			Logger::Log(MJPEGBenchmarkConstStr) << setw(20) << name << ": failed" << endl;
+			return false;
+		}
+	}
+	const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+	Logger::Log(MJPEGBenchmarkConstStr) << setw(20) << name << ": " << fixed << setprecision(2) << (seconds * 1e3) / frames << " ms/frame ("
+		<< output->getWidth() << 'x' << output->getHeight() << ')' << endl;
+	return true;
+}
+
+// decodes frames on a worker pool (as fast as it can take them) and logs how many frames per second come out
+static bool BenchmarkDecodeStage(const std::shared_ptr<Frame>& mjpeg, FrameType::Encoding encoding, unsigned int threads, size_t frames)
+{
+	std::atomic<size_t> delivered(0), failed(0);
+	OrderedWorkerPool<std::shared_ptr<Frame> > stage("MJPEGBenchmarkStage", threads, 0, [&](unsigned long long, std::shared_ptr<Frame>& frame)
+	{
+		if (frame) ++delivered;
+		else ++failed;
+	});
+	stage.Start();
+
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	for (size_t i = 0; i < frames; ++i)
+	{
+		// waits for room instead of dropping frames
+		while (i - (delivered + failed) >= stage.GetMaxInFlight())
+			std::this_thread::yield();
+		while (!stage.Submit([&mjpeg, encoding]() { return JPEGDecoder::Decode(*mjpeg, encoding); }))
+			std::this_thread::yield();
+	}
+	while (delivered + failed < frames)
+		std::this_thread::yield();
+	const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	stage.Stop();
+
+	Logger::Log(MJPEGBenchmarkConstStr) << setw(14) << (encoding == FrameType::Encoding::I420 ? "stage i420" : "stage bgra32") << " (" << threads << "t): "
+		<< fixed << setprecision(1) << frames / seconds << " frames/s" << endl;
+	return failed == 0;
+}
+
+int MJPEGBenchmark(int argc, char* argv[])
+{
+	unsigned long width = 3840, height = 2160;
+	size_t frames = 20;
+	int quality = 90;
+	unsigned int threads = OrderedWorkerPool<int>::DefaultThreadCount();
+
+	vector<unsigned long> resolution;
+	for (int i = 0; i < argc; ++i)
+	{
+		if (strcmp(argv[i], "--frames") == 0 && i + 1 < argc)
+			frames = strtoul(argv[++i], nullptr, 10);
+		else if (strcmp(argv[i], "--quality") == 0 && i + 1 < argc)
+			quality = atoi(argv[++i]);
+		else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc)
+			threads = strtoul(argv[++i], nullptr, 10);
+		else
+			resolution.push_back(strtoul(argv[i], nullptr, 10));
+	}
+
+	if (resolution.size() == 2 && resolution[0] > 0 && resolution[1] > 0)
+	{
+		width = resolution[0];
+		height = resolution[1];
+	}
+	else if (!resolution.empty() || frames == 0 || quality < 1 || quality > 100 || threads == 0)
+	{
+		Logger::Log(MJPEGBenchmarkConstStr) << "Usage: mjpeg [width height] [--frames N] [--quality Q] [--threads N]" << endl;
+		return 1;
+	}
+
+	// something that compresses like a camera image would (smooth areas and some noise)
+	std::shared_ptr<Frame> image = Frame::Create(width, height, FrameType::Encoding::BGR24);
+	uint32_t noise = 12345;
+	for (unsigned long y = 0; y < height; ++y)
+	{
+		unsigned char* row = image->getData() + (size_t)y * image->getLineSize();
+		for (unsigned long x = 0; x < width; ++x)
+		{
+			noise = noise * 1664525u + 1013904223u;
+			row[3 * x + 0] = (unsigned char)((255 * x) / width + (noise >> 29));
+			row[3 * x + 1] = (unsigned char)((255 * y) / height + ((noise >> 26) & 7));
+			row[3 * x + 2] = (unsigned char)(((x / 64 + y / 64) & 1) ? 200 : 60);
+		}
+	}
+
+	JPEGEncoder encoder(quality);
+	std::shared_ptr<EncodedBuffer> compressed = encoder.Encode(*image);
+	if (!compressed)
+	{
+		Logger::Log(MJPEGBenchmarkConstStr) << "Could not compress a " << width << 'x' << height << " image" << endl;
+		return 1;
+	}
+
+	// what the camera would hand out
+	std::shared_ptr<Frame> mjpeg = Frame::Create(width, height, (unsigned long)compressed->size(), FrameType::Encoding::MJPEG);
+	memcpy(mjpeg->getData(), compressed->data(), compressed->size());
+
+	Logger::Log(MJPEGBenchmarkConstStr) << frames << " MJPEG frames of " << width << 'x' << height << " (" << mjpeg->size() / 1024 << " KB, quality " << quality
+		<< ") - passthrough sends them as they are" << endl;
+
+	const bool succeeded =
+		BenchmarkStep("decode + encode", frames, [&]() -> std::shared_ptr<Frame> {
+			std::shared_ptr<Frame> decoded = JPEGDecoder::Decode(*mjpeg);
+			return (decoded && encoder.Encode(*decoded)) ? decoded : nullptr;
+		}) &&
+		BenchmarkStep("decode", frames, [&]() { return JPEGDecoder::Decode(*mjpeg); }) &&
+		BenchmarkStep("decode bgra32", frames, [&]() { return JPEGDecoder::Decode(*mjpeg, FrameType::Encoding::BGRA32); }) &&
+		BenchmarkStep("decode i420", frames, [&]() { return JPEGDecoder::Decode(*mjpeg, FrameType::Encoding::I420); }) &&
+		BenchmarkStep("decode 1/2 (dct)", frames, [&]() { return JPEGDecoder::Decode(*mjpeg, FrameType::Encoding::BGR24, 2); }) &&
+		BenchmarkStep("decode 1/2 (resize)", frames, [&]() -> std::shared_ptr<Frame> {
+			std::shared_ptr<Frame> decoded = JPEGDecoder::Decode(*mjpeg);
+			return decoded ? FrameConversion::Downscale(decoded, 2) : nullptr;
+		}) &&
+		BenchmarkStep("decode 1/4 (dct)", frames, [&]() { return JPEGDecoder::Decode(*mjpeg, FrameType::Encoding::BGR24, 4); }) &&
+		BenchmarkStep("decode 1/3", frames, [&]() { return JPEGDecoder::Decode(*mjpeg, FrameType::Encoding::BGR24, 3); }) &&
+		BenchmarkDecodeStage(mjpeg, FrameType::Encoding::BGRA32, 1, frames) &&
+		BenchmarkDecodeStage(mjpeg, FrameType::Encoding::BGRA32, threads, frames) &&
+		BenchmarkDecodeStage(mjpeg, FrameType::Encoding::I420, threads, frames);
+
+	return succeeded ? 0 : 1;
+}
@@ -0,0 +1,183 @@
+// MulticastBenchmark.cpp
+// Sends JPEG frames to a multicast group over RTP (see RTPMulticastSender.h) and receives them
+// with several receivers on the same machine (see RTPJPEGProtocolReader.h).
+//
+// Usage: Benchmarks multicast [receivers] [--frames N] [--interval ms] [--group address] [--port N] [--interface address]
+//
+// Everything goes through the loopback interface by default (--interface 127.0.0.1), so no
+// datagram leaves the machine. Egress is the same no matter how many receivers join the group
+// (a tcp server would send every frame once per client).
+
+#include "CompilerConfiguration.h"
+
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include <boost/asio.hpp>
+
+#include "Logger.h"
+#include "Frame.h"
+#include "JPEGEncoder.h"
+#include "RTPMulticastSender.h"
+#include "RTPJPEGProtocolReader.h"
+#include "Benchmarks.h"
+
+using namespace std;
+using boost::asio::ip::udp;
+
+static const char* MulticastBenchmarkConstStr = "MulticastBenchmark";
+
+// a machine watching the stream
+struct MulticastReceiver
+{
+	udp::socket socket;
+	vector<unsigned char> datagram;
+	shared_ptr<ProtocolPacketReader> reader;
+	unsigned long long framesReceived, bytesReceived;
+
+	MulticastReceiver(boost::asio::io_context& io_context, const udp::endpoint& group, const string& interfaceAddress) : socket(io_context),
+		datagram(65536), reader(RTPJPEGProtocolReader::Create()), framesReceived(0), bytesReceived(0)
+	{
+		socket.open(group.protocol());
+		socket.set_option(udp::socket::reuse_address(true));
+		socket.bind(udp::endpoint(group.protocol(), group.port()));
+		socket.set_option(boost::asio::socket_base::receive_buffer_size(8 * 1024 * 1024));
+		socket.set_option(boost::asio::ip::multicast::join_group(group.address().to_v4(), boost::asio::ip::make_address_v4(interfaceAddress)));
+	}
+
+	void Receive()
+	{
+		socket.async_receive(boost::asio::buffer(datagram), [this](const boost::system::error_code& error, size_t length)
+		{
+			if (error)
+				return;
+
+			bytesReceived += length;
+			if (reader->ParseHeader(datagram.data(), length) && reader->ParseFrame(datagram.data(), length))
+				++framesReceived;
+
+			Receive();
+		});
+	}
+};
+
+int MulticastBenchmark(int argc, char* argv[])
+{
+	size_t receiverCount = 4, frames = 300;
+	std::chrono::milliseconds interval(33);
+	string groupAddress = "239.255.0.1", interfaceAddress = "127.0.0.1";
+	unsigned short port = 5004;
+
+	for (int i = 0; i < argc; ++i)
+	{
+		if (strcmp(argv[i], "--frames") == 0 && i + 1 < argc)
+			frames = strtoul(argv[++i], nullptr, 10);
+		else if (strcmp(argv[i], "--interval") == 0 && i + 1 < argc)
+			interval = std::chrono::milliseconds(strtoul(argv[++i], nullptr, 10));
+		else if (strcmp(argv[i], "--group") == 0 && i + 1 < argc)
+			groupAddress = argv[++i];
+		else if (strcmp(argv[i], "--port") == 0 && i + 1 < argc)
+			port = (unsigned short)strtoul(argv[++i], nullptr, 10);
+		else if (strcmp(argv[i], "--interface") == 0 && i + 1 < argc)
+			interfaceAddress = argv[++i];
+		else
+			receiverCount = strtoul(argv[i], nullptr, 10);
+	}
+
+	if (receiverCount == 0 || frames == 0)
+	{
+		Logger::Log(MulticastBenchmarkConstStr) << "Usage: multicast [receivers] [--frames N] [--interval ms] [--group address] [--port N] [--interface address]" << endl;
+		return 1;
+	}
+
+	// a 1280x720 frame with some detail in it
+	const unsigned long width = 1280, height = 720;
+	shared_ptr<Frame> frame = Frame::Create(width, height, FrameType::Encoding::BGRA32);
+	for (unsigned long y = 0; y < height; ++y)
+	{
+		unsigned char* line = frame->getData() + y * frame->getLineSize();
+		for (unsigned long x = 0; x < width; ++x)
+		{
+			line[x * 4 + 0] = (unsigned char)(x ^ y);
+			line[x * 4 + 1] = (unsigned char)(x * 2 + y);
+			line[x * 4 + 2] = (unsigned char)(y * 3);
+			line[x * 4 + 3] = 255;
+		}
+	}
+
+	JPEGEncoder encoder(90, JPEGEncoder::Subsampling::YUV420);
+	shared_ptr<EncodedBuffer> jpeg = encoder.Encode(*frame);
+	if (!jpeg)
+	{
+		Logger::Log(MulticastBenchmarkConstStr) << "Error: could not encode a test frame" << endl;
+		return 1;
+	}
+
+	Logger::Log(MulticastBenchmarkConstStr) << frames << " JPEG frames of " << width << 'x' << height << " (" << jpeg->size() / 1024 << " KB) every "
+		<< interval.count() << " ms to " << groupAddress << ':' << port << " through " << interfaceAddress << " - " << receiverCount << " receivers" << endl;
+
+	try
+	{
+		const udp::endpoint group(boost::asio::ip::make_address(groupAddress), port);
+
+		// receivers
+		boost::asio::io_context receiverContext;
+		vector<unique_ptr<MulticastReceiver> > receivers;
+		for (size_t i = 0; i < receiverCount; ++i)
+		{
+			receivers.emplace_back(new MulticastReceiver(receiverContext, group, interfaceAddress));
+			receivers.back()->Receive();
+		}
+		thread receiverThread([&receiverContext]() { receiverContext.run(); });
+
+		// sender (ttl 0: datagrams never leave this machine)
+		boost::asio::io_context senderContext;
+		boost::asio::executor_work_guard<boost::asio::io_context::executor_type> senderWork(senderContext.get_executor());
+		RTPMulticastSender sender(senderContext, groupAddress, port, 0, true, 1400, interfaceAddress);
+		thread senderThread([&senderContext]() { senderContext.run(); });
+
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		for (size_t i = 0; i < frames; ++i)
+		{
+			const std::chrono::microseconds timestamp = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::system_clock::now().time_since_epoch());
+			sender.Post(jpeg, jpeg->data(), jpeg->size(), timestamp);
+			this_thread::sleep_for(interval);
+		}
+
+		// waits for the last datagrams
+		senderWork.reset();
+		senderThread.join();
+		this_thread::sleep_for(std::chrono::milliseconds(200));
+		const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+		receiverContext.stop();
+		receiverThread.join();
+
+		Logger::Log(MulticastBenchmarkConstStr) << "   multicast: " << sender.GetFramesSent() << " frames in " << sender.GetPacketsSent() << " packets - egress "
+			<< fixed << setprecision(2) << (sender.GetBytesSent() / (1024.0 * 1024.0)) / seconds << " MB/s" << endl;
+		Logger::Log(MulticastBenchmarkConstStr) << "  tcp (est.): egress " << (receiverCount * frames * (double)jpeg->size() / (1024.0 * 1024.0)) / seconds
+			<< " MB/s (every frame sent once per client)" << endl;
+
+		for (size_t i = 0; i < receivers.size(); ++i)
+		{
+			const RTPJPEGProtocolReader& reader = static_cast<const RTPJPEGProtocolReader&>(*receivers[i]->reader);
+			Logger::Log(MulticastBenchmarkConstStr) << "  receiver " << i << ": " << receivers[i]->framesReceived << '/' << frames << " frames ("
+				<< reader.getFramesDropped() << " incomplete)" << endl;
+		}
+
+		sender.Close();
+	}
+	catch (const std::exception& e)
+	{
+		Logger::Log(MulticastBenchmarkConstStr) << "Error: " << e.what() << endl;
+		return 1;
+	}
+
+	return 0;
+}
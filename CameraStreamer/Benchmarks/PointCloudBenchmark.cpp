@@ -0,0 +1,124 @@
+// PointCloudBenchmark.cpp
+// Measures how long it takes to turn a depth frame into points (see PointCloud.h), with
+// and without SSE2, and how big clouds get with and without a voxel grid.
+//
+// Usage: Benchmarks pointcloud [width height] [--frames N]
+//
+// Depth is synthetic (a tilted plane with a hole), and rays come from made up intrinsics
+// (90 degrees of horizontal field of view, mild distortion). Raw depth is the baseline.
+
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "Logger.h"
+#include "PointCloud.h"
+#include "Benchmarks.h"
+
+using namespace std;
+
+static const char* PointCloudBenchmarkConstStr = "PointCloudBenchmark";
+
+typedef void (*DepthToXYZFunction)(const uint16_t*, const float*, const float*, size_t, float, int16_t*, int16_t*, int16_t*);
+
+static void BenchmarkKernel(const char* name, DepthToXYZFunction kernel, const Frame& depth, const PointCloud::RayTable& rays, size_t frames)
+{
+	const size_t pixels = (size_t)depth.getWidth() * depth.getHeight();
+	vector<int16_t> x(pixels), y(pixels), z(pixels);
+
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	for (size_t i = 0; i < frames; ++i)
+		kernel((const uint16_t*)depth.getData(), rays.x.data(), rays.y.data(), pixels, 1.0f, x.data(), y.data(), z.data());
+	const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+	Logger::Log(PointCloudBenchmarkConstStr) << setw(14) << name << ": " << fixed << setprecision(2) << (seconds * 1e9) / (frames * (double)pixels) << " ns/pixel ("
+		<< setprecision(2) << (seconds * 1e3) / frames << " ms/frame)" << endl;
+}
+
+static void BenchmarkCompute(PointCloud::Format format, unsigned int voxelSize, const Frame& depth, const Frame& color, const PointCloud::RayTable& rays, size_t frames)
+{
+	vector<unsigned char> output;
+	size_t points = 0;
+
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	for (size_t i = 0; i < frames; ++i)
+		points = PointCloud::Compute(depth, &color, rays, 1.0f, format, voxelSize, output);
+	const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+	const string name = string(PointCloud::FormatToString(format)) + (voxelSize ? " voxel " + to_string(voxelSize) + "mm" : "");
+	Logger::Log(PointCloudBenchmarkConstStr) << setw(20) << name << ": " << fixed << setprecision(2) << (seconds * 1e3) / frames << " ms/frame - "
+		<< points << " points, " << output.size() / 1024 << " KB (" << setprecision(1) << (100.0 * output.size()) / depth.size() << "% of raw depth)" << endl;
+}
+
+int PointCloudBenchmark(int argc, char* argv[])
+{
+	unsigned long width = 640, height = 576;
+	size_t frames = 100;
+
+	vector<unsigned long> resolution;
+	for (int i = 0; i < argc; ++i)
+	{
+		if (strcmp(argv[i], "--frames") == 0 && i + 1 < argc)
+			frames = strtoul(argv[++i], nullptr, 10);
+		else
+			resolution.push_back(strtoul(argv[i], nullptr, 10));
+	}
+
+	if (resolution.size() == 2 && resolution[0] > 0 && resolution[1] > 0)
+	{
+		width = resolution[0];
+		height = resolution[1];
+	}
+	else if (!resolution.empty() || frames == 0)
+	{
+		Logger::Log(PointCloudBenchmarkConstStr) << "Usage: pointcloud [width height] [--frames N]" << endl;
+		return 1;
+	}
+
+	StreamingProtocol::IntrinsicsV2 intrinsics = StreamingProtocol::IntrinsicsV2();
+	intrinsics.fx = intrinsics.fy = width / 2.0f;
+	intrinsics.cx = width / 2.0f;
+	intrinsics.cy = height / 2.0f;
+	intrinsics.k1 = 0.1f;
+	intrinsics.k2 = -0.02f;
+
+	std::shared_ptr<PointCloud::RayTable> rays = PointCloud::MakeRayTable(intrinsics, width, height);
+	if (!rays)
+	{
+		Logger::Log(PointCloudBenchmarkConstStr) << "Could not compute rays for " << width << 'x' << height << endl;
+		return 1;
+	}
+
+	// a plane going from 1 to 3 meters, with a hole in the middle (pixels without depth)
+	std::shared_ptr<Frame> depth = Frame::Create(width, height, FrameType::Encoding::Mono16);
+	std::shared_ptr<Frame> color = Frame::Create(width, height, FrameType::Encoding::BGRA32);
+	for (unsigned long y = 0; y < height; ++y)
+	{
+		uint16_t* row = (uint16_t*)(depth->getData() + (size_t)y * depth->getLineSize());
+		for (unsigned long x = 0; x < width; ++x)
+		{
+			const bool hole = (x > width * 2 / 5 && x < width * 3 / 5 && y > height * 2 / 5 && y < height * 3 / 5);
+			row[x] = hole ? 0 : (uint16_t)(1000 + (2000 * x) / width);
+		}
+	}
+	memset(color->getData(), 128, color->size());
+
+	Logger::Log(PointCloudBenchmarkConstStr) << frames << " depth frames of " << width << 'x' << height << " (" << depth->size() / 1024 << " KB) - SSE2 "
+		<< (PointCloud::HasSIMD() ? "available" : "not available") << endl;
+
+	BenchmarkKernel("scalar", &PointCloud::DepthToXYZScalar, *depth, *rays, frames);
+	BenchmarkKernel("DepthToXYZ", &PointCloud::DepthToXYZ, *depth, *rays, frames);
+
+	BenchmarkCompute(PointCloud::Format::XYZ, 0, *depth, *color, *rays, frames);
+	BenchmarkCompute(PointCloud::Format::XYZRGB, 0, *depth, *color, *rays, frames);
+	BenchmarkCompute(PointCloud::Format::XYZ, 10, *depth, *color, *rays, frames);
+	BenchmarkCompute(PointCloud::Format::XYZ, 50, *depth, *color, *rays, frames);
+	BenchmarkCompute(PointCloud::Format::XYZRGB, 50, *depth, *color, *rays, frames);
+
+	return 0;
+}
@@ -0,0 +1,211 @@
+// SharedMemoryRingBenchmark.cpp
+// Compares how long a frame takes to reach a consumer through the shared memory ring
+// (see SharedMemoryRing.h) and through a loopback TCP connection.
+//
+// Usage: Benchmarks shmring [width height] [--frames N] [--interval ms]
+//
+// Frames are BGRA32 and are sent raw in both cases. The consumer reads every byte of
+// every frame, so the numbers include the cost of touching the pixels.
+
+#include "CompilerConfiguration.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <numeric>
+#include <string>
+#include <thread>
+#include <vector>
+#include <boost/asio.hpp>
+
+#include "Logger.h"
+#include "SharedMemoryRing.h"
+#include "Benchmarks.h"
+
+using namespace std;
+using boost::asio::ip::tcp;
+
+static const char* SharedMemoryRingBenchmarkConstStr = "SharedMemoryRingBenchmark";
+
+static long long MicrosecondsNow()
+{
+	return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+// reads every byte of a frame (what a consumer would do at the very least)
+static uint64_t TouchPixels(const unsigned char* data, size_t size)
+{
+	uint64_t sum = 0, word;
+	size_t i = 0;
+	for (; i + sizeof(uint64_t) <= size; i += sizeof(uint64_t))
+	{
+		memcpy(&word, data + i, sizeof(uint64_t));
+		sum += word;
+	}
+	for (; i < size; ++i)
+		sum += data[i];
+	return sum;
+}
+
+static void ReportLatencies(const char* transport, vector<long long>& latencies, size_t framesSent, size_t frameSize, double seconds)
+{
+	if (latencies.empty())
+	{
+		Logger::Log(SharedMemoryRingBenchmarkConstStr) << setw(13) << transport << ": no frames received" << endl;
+		return;
+	}
+
+	sort(latencies.begin(), latencies.end());
+	const double mean = accumulate(latencies.begin(), latencies.end(), 0.0) / latencies.size();
+
+	Logger::Log(SharedMemoryRingBenchmarkConstStr) << setw(13) << transport << ": latency mean " << fixed << setprecision(1) << mean << " us"
+		<< " p50 " << latencies[latencies.size() / 2] << " us"
+		<< " p99 " << latencies[min(latencies.size() - 1, latencies.size() * 99 / 100)] << " us"
+		<< " - " << latencies.size() << '/' << framesSent << " frames received"
+		<< " (" << setprecision(0) << (latencies.size() * (double)frameSize / (1024.0 * 1024.0)) / seconds << " MB/s)" << endl;
+}
+
+static void BenchmarkSharedMemory(const vector<unsigned char>& frame, unsigned long width, unsigned long height, size_t frames, std::chrono::milliseconds interval)
+{
+	const string name = "CameraStreamerBenchmark";
+	SharedMemoryRingWriter writer(name, 4, SharedMemoryRingSlotSize(frame.size(), 0));
+	SharedMemoryRingReader reader(name);
+
+	vector<long long> latencies;
+	latencies.reserve(frames);
+	atomic<bool> done(false);
+
+	thread consumer([&]()
+	{
+		SharedMemoryRingFrame sharedFrame;
+		while (!done || reader.GetLastSequence() < frames)
+		{
+			if (!reader.WaitForFrame(sharedFrame, 100))
+			{
+				if (done) break;
+				continue;
+			}
+
+			TouchPixels(sharedFrame.colorData, (size_t)sharedFrame.color.size);
+			if (reader.IsValid(sharedFrame))
+				latencies.push_back(MicrosecondsNow() - sharedFrame.timestamp);
+		}
+	});
+
+	SharedMemoryImage image = SharedMemoryImage();
+	image.width = width;
+	image.height = height;
+	image.stride = width * 4;
+	image.size = frame.size();
+
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	for (size_t i = 0; i < frames; ++i)
+	{
+		writer.Write(image, frame.data(), SharedMemoryImage(), nullptr);
+		this_thread::sleep_for(interval);
+	}
+	done = true;
+	consumer.join();
+
+	ReportLatencies("shared memory", latencies, frames, frame.size(), std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+}
+
+static void BenchmarkLoopbackTCP(const vector<unsigned char>& frame, size_t frames, std::chrono::milliseconds interval)
+{
+	boost::asio::io_context io_context;
+	tcp::acceptor acceptor(io_context, tcp::endpoint(boost::asio::ip::address_v4::loopback(), 0));
+	tcp::socket sender(io_context), receiver(io_context);
+	receiver.connect(acceptor.local_endpoint());
+	acceptor.accept(sender);
+
+	sender.set_option(tcp::no_delay(true));
+	receiver.set_option(tcp::no_delay(true));
+
+	vector<long long> latencies;
+	latencies.reserve(frames);
+
+	thread consumer([&]()
+	{
+		vector<unsigned char> received(frame.size());
+		long long header[2];
+		boost::system::error_code error;
+
+		for (size_t i = 0; i < frames; ++i)
+		{
+			// [timestamp][length][pixels]
+			boost::asio::read(receiver, boost::asio::buffer(header, sizeof(header)), error);
+			if (!error)
+				boost::asio::read(receiver, boost::asio::buffer(received.data(), (size_t)header[1]), error);
+			if (error)
+				break;
+
+			TouchPixels(received.data(), received.size());
+			latencies.push_back(MicrosecondsNow() - header[0]);
+		}
+	});
+
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	for (size_t i = 0; i < frames; ++i)
+	{
+		long long header[2] = { MicrosecondsNow(), (long long)frame.size() };
+		std::vector<boost::asio::const_buffer> buffers = { boost::asio::buffer(header, sizeof(header)), boost::asio::buffer(frame) };
+		boost::asio::write(sender, buffers);
+		this_thread::sleep_for(interval);
+	}
+	consumer.join();
+
+	ReportLatencies("loopback tcp", latencies, frames, frame.size(), std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+}
+
+int SharedMemoryRingBenchmark(int argc, char* argv[])
+{
+	unsigned long width = 1920, height = 1080;
+	size_t frames = 300;
+	std::chrono::milliseconds interval(10);
+
+	vector<unsigned long> resolution;
+	for (int i = 0; i < argc; ++i)
+	{
+		if (strcmp(argv[i], "--frames") == 0 && i + 1 < argc)
+			frames = strtoul(argv[++i], nullptr, 10);
+		else if (strcmp(argv[i], "--interval") == 0 && i + 1 < argc)
+			interval = std::chrono::milliseconds(strtoul(argv[++i], nullptr, 10));
+		else
+			resolution.push_back(strtoul(argv[i], nullptr, 10));
+	}
+
+	if (resolution.size() == 2 && resolution[0] > 0 && resolution[1] > 0)
+	{
+		width = resolution[0];
+		height = resolution[1];
+	}
+	else if (!resolution.empty())
+	{
+		Logger::Log(SharedMemoryRingBenchmarkConstStr) << "Usage: shmring [width height] [--frames N] [--interval ms]" << endl;
+		return 1;
+	}
+
+	vector<unsigned char> frame((size_t)width * height * 4);
+	for (size_t i = 0; i < frame.size(); ++i)
+		frame[i] = (unsigned char)(i * 31);
+
+	Logger::Log(SharedMemoryRingBenchmarkConstStr) << frames << " BGRA frames of " << width << 'x' << height << " (" << frame.size() / 1024 << " KB) every " << interval.count() << " ms" << endl;
+
+	try
+	{
+		BenchmarkSharedMemory(frame, width, height, frames, interval);
+		BenchmarkLoopbackTCP(frame, frames, interval);
+	}
+	catch (const std::exception& e)
+	{
+		Logger::Log(SharedMemoryRingBenchmarkConstStr) << "Error: " << e.what() << endl;
+		return 1;
+	}
+
+	return 0;
+}
@@ -7,6 +7,7 @@
 
 #include <fstream>
 #include "Logger.h"
+#include "FramePool.h"
 
 
 rapidjson::Document ApplicationStatus::GetApplicationStatusJSON()
@@ -55,6 +56,12 @@ rapidjson::Document ApplicationStatus::GetApplicationStatusJSON()
 		applicationStatusJson.AddMember("recordingDepthPath", rapidjson::Value().SetString(recordingDepthPath.c_str(), recordingDepthPath.length(), allocator), allocator);
 		applicationStatusJson.AddMember("recordingColorPath", rapidjson::Value().SetString(recordingColorPath.c_str(), recordingColorPath.length(), allocator), allocator);
 		
+		// frame memory (misses and unpooled allocations should stop growing once the application reaches a steady state)
+		FramePoolStatistics framePoolStats = FramePool::Instance().GetStatistics();
+		applicationStatusJson.AddMember("framePoolHits", framePoolStats.hits, allocator);
+		applicationStatusJson.AddMember("framePoolMisses", framePoolStats.misses, allocator);
+		applicationStatusJson.AddMember("framePoolUnpooledAllocations", framePoolStats.unpooledAllocations, allocator);
+
 		// application ports
 		applicationStatusJson.AddMember("port", streamerPort, allocator);
 		applicationStatusJson.AddMember("controlPort", controlPort, allocator);
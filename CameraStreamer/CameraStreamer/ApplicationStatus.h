@@ -85,6 +85,10 @@ public:
 		// streaming protocol
 		streamingColorFormat = config.GetStreamingColorFormat();
 		streamingDepthFormat = config.GetStreamingDepthFormat();
+		streamingDepthCodec = config.GetStreamingDepthCodec();
+
+		// recording
+		recordingDepthCodec = config.GetRecordingDepthCodec();
 	}
 
 	// ============================================================================
@@ -182,6 +186,18 @@ public:
 
 	}
 
+	/**
+	 * The recorder picks the color file extension once frames come in (e.g.: .mjpeg for MJPEG cameras)
+	 **/
+	void UpdateRecordingColorPath(const std::string& colorPath)
+	{
+		std::lock_guard<std::mutex> guard(dataLock);
+
+		// a recording that was already stopped keeps its status
+		if (this->isRecordingColor)
+			this->recordingColorPath = colorPath;
+	}
+
 	/**
 	 * Updates the application status internally (streaming)
 	 */
@@ -1,6 +1,9 @@
 #include "AzureKinect.h"
 
 #ifdef CS_ENABLE_CAMERA_K4A
+#include <algorithm>
+#include <cassert>
+#include <iterator>
 #include <sstream>
 #include <filesystem>
 
@@ -181,6 +184,43 @@ void AzureKinect::saveTransformationTable(int img_width, int img_height)
 	k4a_image_release(xy_image);
 }
 
+std::shared_ptr<Frame> AzureKinect::RegisterDepthToColor(const k4a::image& depthImage)
+{
+	std::shared_ptr<k4a::transformation> transformation = registrationTransformations.Borrow();
+
+	// registers depth straight into a pooled frame instead of letting k4a allocate a color sized image every time.
+	// the k4a::image only borrows the frame's buffer (k4a overwrites every pixel, so recycled buffers are fine)
+	std::shared_ptr<Frame> registeredDepth = Frame::Create(colorCameraParameters.resolutionWidth, colorCameraParameters.resolutionHeight, FrameType::Encoding::Mono16);
+	k4a::image registeredDepthImage = k4a::image::create_from_buffer(K4A_IMAGE_FORMAT_DEPTH16, colorCameraParameters.resolutionWidth, colorCameraParameters.resolutionHeight,
+		(int) registeredDepth->getLineSize(), registeredDepth->getData(), registeredDepth->size(), nullptr, nullptr);
+	transformation->depth_image_to_color_camera(depthImage, &registeredDepthImage);
+
+	return registeredDepth;
+}
+
+std::shared_ptr<Frame> AzureKinect::RegisterColorToDepth(const k4a::image& depthImage, const Frame& color)
+{
+	std::shared_ptr<k4a::transformation> transformation = registrationTransformations.Borrow();
+
+	// k4a reads the color frame where it is, and writes into a pooled frame (same as RegisterDepthToColor)
+	k4a::image colorImage = k4a::image::create_from_buffer(K4A_IMAGE_FORMAT_COLOR_BGRA32, (int) color.getWidth(), (int) color.getHeight(),
+		(int) color.getLineSize(), color.getData(), color.size(), nullptr, nullptr);
+	std::shared_ptr<Frame> registeredColor = Frame::Create(depthCameraParameters.resolutionWidth, depthCameraParameters.resolutionHeight, FrameType::Encoding::BGRA32);
+	k4a::image registeredColorImage = k4a::image::create_from_buffer(K4A_IMAGE_FORMAT_COLOR_BGRA32, depthCameraParameters.resolutionWidth, depthCameraParameters.resolutionHeight,
+		(int) registeredColor->getLineSize(), registeredColor->getData(), registeredColor->size(), nullptr, nullptr);
+	transformation->color_image_to_depth_camera(depthImage, colorImage, &registeredColorImage);
+
+	registeredColor->setCaptureTime(color.getCaptureTime());
+	return registeredColor;
+}
+
+void AzureKinect::OnCaptureProcessed(CapturedFrames& capture)
+{
+	// captures that could not be registered or decoded come out empty, and are dropped
+	if ((capture.color || capture.depth) && onFramesReady)
+		onFramesReady(capture.timestamp, capture.color, capture.depth, capture.originalDepth);
+}
+
 void AzureKinect::CameraLoop()
 {
 	Logger::Log(AzureKinectConstStr) << "Started Azure Kinect polling thread: " << std::this_thread::get_id << std::endl;
@@ -264,7 +304,7 @@ void AzureKinect::CameraLoop()
 				try
 				{
 					kinectCameraCalibration    = kinectDevice.get_calibration(kinectConfiguration.depth_mode, kinectConfiguration.color_resolution);
-					kinectCameraTransformation = k4a::transformation(kinectCameraCalibration);
+					registrationTransformations.Reset(kinectCameraCalibration, capturePipeline ? capturePipeline->GetThreadCount() : 1);
 
 					// save parameters for later - we will later convert them to opencv
 					if (depthCameraEnabled)
@@ -305,6 +345,11 @@ void AzureKinect::CameraLoop()
 						colorCameraParameters.intrinsics.p1 = kinectCameraCalibration.color_camera_calibration.intrinsics.parameters.param.p1;
 						colorCameraParameters.intrinsics.p2 = kinectCameraCalibration.color_camera_calibration.intrinsics.parameters.param.p2;
 						colorCameraParameters.intrinsics.metricRadius = kinectCameraCalibration.color_camera_calibration.intrinsics.parameters.param.metric_radius;
+
+						// where the depth camera is with respect to the color camera (clients line frames up with it when they are not registered)
+						const k4a_calibration_extrinsics_t& depthToColor = kinectCameraCalibration.extrinsics[K4A_CALIBRATION_TYPE_DEPTH][K4A_CALIBRATION_TYPE_COLOR];
+						std::copy(std::begin(depthToColor.rotation), std::end(depthToColor.rotation), colorCameraParameters.extrinsics.rotation);
+						std::copy(std::begin(depthToColor.translation), std::end(depthToColor.translation), colorCameraParameters.extrinsics.translation);
 					}
 				}
 				catch (const k4a::error& error)
@@ -354,9 +399,19 @@ void AzureKinect::CameraLoop()
 			// time to start reading frames and streaming
 			unsigned int triesBeforeRestart = 1;
 
+			// registration and decoding happen off the capture thread. color warped into the depth camera has to be
+			// decoded to BGRA32 first, at its full size
+			const bool registeringDepth = colorCameraEnabled && depthCameraEnabled && frameRegistration == FrameRegistration::DepthToColor;
+			const bool registeringColor = IsRegisteringColorToDepth();
+			const bool decodingColor = colorCameraEnabled && colorFrameEncoding == FrameType::Encoding::MJPEG && (decodeColorFrames || registeringColor);
+			const bool usingPipeline = (registeringDepth || registeringColor || decodingColor) && capturePipeline;
+
+			// what color frames look like once decoded or registered
+			const CameraParameters colorFrameParameters = GetColorFrameParameters();
+
 			// updates app with capture and stream status
 			appStatus->UpdateCaptureStatus(colorCameraEnabled, depthCameraEnabled, cameraSerialNumber,
-				OpenCVCameraMatrix(colorCameraEnabled ? colorCameraParameters : depthCameraParameters),
+				OpenCVCameraMatrix(colorCameraEnabled ? colorFrameParameters : depthCameraParameters),
 
 				// color camera
 				colorCameraEnabled ? colorCameraParameters.resolutionWidth : 0,
@@ -367,8 +422,11 @@ void AzureKinect::CameraLoop()
 				depthCameraEnabled ? depthCameraParameters.resolutionHeight : 0,
 
 				// streaming (color resolution when  color is available, depth resolution otherwise)
-				colorCameraEnabled ? colorCameraParameters.resolutionWidth : depthCameraParameters.resolutionWidth,
-				colorCameraEnabled ? colorCameraParameters.resolutionHeight : depthCameraParameters.resolutionHeight);
+				colorCameraEnabled ? colorFrameParameters.resolutionWidth : depthCameraParameters.resolutionWidth,
+				colorCameraEnabled ? colorFrameParameters.resolutionHeight : depthCameraParameters.resolutionHeight);
+
+			if (usingPipeline)
+				capturePipeline->Start();
 
 			// starts
 			Logger::Log(AzureKinectConstStr) << "Started capturing" << std::endl;
@@ -405,6 +463,7 @@ void AzureKinect::CameraLoop()
 					if (kinectDevice.get_capture(&currentCapture, getFrameTimeout))
 					{
 						std::shared_ptr<Frame> sharedColorFrame, sharedDepthFrame, originalDepthFrame;
+						k4a::image depthImage; // registered by the pipeline
 						// init to current time
 						std::chrono::microseconds timestamp = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::system_clock::now().time_since_epoch());
 
@@ -418,9 +477,11 @@ void AzureKinect::CameraLoop()
 							// transform color to depth
 							//k4a::image colorInDepthFrame = kinectCameraTransformation.color_image_to_depth_camera(depthFrame, colorFrame);
 
-							// copies images to Frame
-							sharedColorFrame = Frame::Create(colorFrame.get_width_pixels(), colorFrame.get_height_pixels(), colorFrame.get_size());
-							memcpy(sharedColorFrame->data, colorFrame.get_buffer(), sharedColorFrame->size());
+							// wraps the image without copying it (the frame holds a reference to the k4a::image)
+							if (colorFrameEncoding == FrameType::Encoding::MJPEG)
+								sharedColorFrame = Frame::Wrap(colorFrame.get_width_pixels(), colorFrame.get_height_pixels(), (unsigned long) colorFrame.get_size(), colorFrame.get_buffer(), colorFrame, colorFrameEncoding);
+							else
+								sharedColorFrame = Frame::Wrap(colorFrame.get_width_pixels(), colorFrame.get_height_pixels(), colorFrameEncoding, colorFrame.get_buffer(), (unsigned long) colorFrame.get_stride_bytes(), colorFrame);
 						}
 
 						// get depth frame
@@ -428,24 +489,48 @@ void AzureKinect::CameraLoop()
 						{
 							k4a::image depthFrame = currentCapture.get_depth_image();
 
-							// copies original depth frame just so we can save it in its original resolution
+							// keeps original depth frame just so we can save it in its original resolution
 							timestamp = depthFrame.get_device_timestamp();
-							originalDepthFrame = Frame::Create(depthFrame.get_width_pixels(), depthFrame.get_height_pixels(), FrameType::Encoding::Mono16);
-							memcpy(originalDepthFrame->data, depthFrame.get_buffer(), originalDepthFrame->size());
+							originalDepthFrame = Frame::Wrap(depthFrame.get_width_pixels(), depthFrame.get_height_pixels(), FrameType::Encoding::Mono16, depthFrame.get_buffer(), depthFrame);
+							assert((unsigned long) depthFrame.get_stride_bytes() == originalDepthFrame->getLineSize()); // depth16 images are tightly packed
 
-							if (colorCameraEnabled)
-							{
-								k4a::image largeDepthFrame = kinectCameraTransformation.depth_image_to_color_camera(depthFrame);
-								sharedDepthFrame = Frame::Create(largeDepthFrame.get_width_pixels(), largeDepthFrame.get_height_pixels(), FrameType::Encoding::Mono16);
-								memcpy(sharedDepthFrame->data, largeDepthFrame.get_buffer(), sharedDepthFrame->size());
-							}
-							else {
+							if (registeringDepth || registeringColor)
+								depthImage = depthFrame;
+
+							if (!registeringDepth)
 								sharedDepthFrame = originalDepthFrame;
-							}
 						}
 
-						// invoke callback
-						if (onFramesReady)
+						// registration and decoding run on the pipeline. captures that do not fit are dropped: the capture
+						// thread never waits for them (it would miss device frames otherwise)
+						if (usingPipeline)
+						{
+							CapturedFrames capture = { timestamp, sharedColorFrame, sharedDepthFrame, originalDepthFrame };
+							const FrameType::Encoding encoding = registeringColor ? FrameType::Encoding::BGRA32 : decodedColorEncoding;
+							const unsigned int scale = registeringColor ? 1 : decodedColorScale;
+							capturePipeline->Submit([this, capture, depthImage, registeringDepth, registeringColor, decodingColor, encoding, scale]() mutable
+							{
+								if (registeringDepth && depthImage)
+								{
+									capture.depth = RegisterDepthToColor(depthImage);
+									capture.depth->setCaptureTime(capture.originalDepth->getCaptureTime());
+								}
+
+								// frames that could not be decoded are dropped (JPEGDecoder tells why)
+								if (decodingColor && capture.color)
+								{
+									capture.color = JPEGDecoder::Decode(*capture.color, encoding, scale);
+									if (!capture.color)
+										return CapturedFrames();
+								}
+
+								if (registeringColor && depthImage && capture.color)
+									capture.color = RegisterColorToDepth(depthImage, *capture.color);
+
+								return capture;
+							});
+						}
+						else if (onFramesReady)
 							onFramesReady(timestamp, sharedColorFrame, sharedDepthFrame, originalDepthFrame);
 
 						// update info
@@ -472,7 +557,6 @@ void AzureKinect::CameraLoop()
 						}
 					}
 
-					std::this_thread::sleep_for(std::chrono::milliseconds(1));
 				}
 			}
 			catch (const k4a::error& e)
@@ -521,6 +605,10 @@ void AzureKinect::CameraLoop()
 		// stop statistics
 		statistics.StopCounting();
 
+		// captures still being registered or decoded are dropped
+		if (capturePipeline)
+			capturePipeline->Stop();
+
 		// let other threads know that we are not capturing anymore
 		appStatus->UpdateCaptureStatus(false, false);
 
@@ -560,8 +648,52 @@ bool AzureKinect::LoadConfigurationSettings()
 		// first figure out which cameras have been loaded
 		if (configuration->IsColorCameraEnabled())
 		{
-			//kinectConfiguration.color_format = K4A_IMAGE_FORMAT_COLOR_BGRA32; // for now, we force BGRA32
-			kinectConfiguration.color_format = K4A_IMAGE_FORMAT_COLOR_MJPG; // use mjpg insteads
+			// mjpg by default (least usb bandwidth). nv12 and yuy2 skip decompression and flow straight to the encoders,
+			// but the sensor only outputs them at 720p
+			const std::string colorFormat = configuration->GetCameraCustomString("colorFormat", "mjpg", false);
+			if (colorFormat == "bgra32")
+			{
+				kinectConfiguration.color_format = K4A_IMAGE_FORMAT_COLOR_BGRA32;
+				colorFrameEncoding = FrameType::Encoding::BGRA32;
+			}
+			else if (colorFormat == "nv12")
+			{
+				kinectConfiguration.color_format = K4A_IMAGE_FORMAT_COLOR_NV12;
+				colorFrameEncoding = FrameType::Encoding::NV12;
+			}
+			else if (colorFormat == "yuy2")
+			{
+				kinectConfiguration.color_format = K4A_IMAGE_FORMAT_COLOR_YUY2;
+				colorFrameEncoding = FrameType::Encoding::YUY2;
+			}
+			else {
+				if (colorFormat != "mjpg")
+					Logger::Log(AzureKinectConstStr) << "Unknown color format \"" << colorFormat << "\" - using mjpg instead" << std::endl;
+
+				kinectConfiguration.color_format = K4A_IMAGE_FORMAT_COLOR_MJPG;
+				colorFrameEncoding = FrameType::Encoding::MJPEG; // mjpg frames vary in size, so they are not pooled (nor decoded unless someone needs pixels)
+			}
+
+			// mjpg frames are forwarded as they are, unless pixels are requested (e.g.: "decodeColor": "bgra32")
+			decodeColorFrames = false;
+			const std::string decodeColor = configuration->GetCameraCustomString("decodeColor", "", false);
+			if (!decodeColor.empty() && colorFrameEncoding == FrameType::Encoding::MJPEG)
+			{
+				FrameType::Encoding encoding;
+				if (FrameType::fromString(decodeColor, encoding) && JPEGDecoder::Supports(encoding))
+				{
+					const int scale = configuration->GetCameraCustomInt("decodeScale", 1, false);
+					decodedColorEncoding = encoding;
+					decodedColorScale = JPEGDecoder::NativeScale((unsigned int)std::max(scale, 1));
+					if ((int)decodedColorScale != scale)
+						Logger::Log(AzureKinectConstStr) << "Color frames can only be decoded at 1/2, 1/4 or 1/8 of their size! Using a scale of " << decodedColorScale << " instead of " << scale << std::endl;
+
+					decodeColorFrames = true;
+				}
+				else {
+					Logger::Log(AzureKinectConstStr) << "Cannot decode color frames to \"" << decodeColor << "\" - forwarding mjpg frames instead" << std::endl;
+				}
+			}
 
 			const int requestedWidth = configuration->GetCameraColorWidth();
 			const int requestedHeight = configuration->GetCameraColorHeight();
@@ -615,6 +747,14 @@ bool AzureKinect::LoadConfigurationSettings()
 			if (requestedWidth != newWidth)
 				appStatus->SetCameraColorWidth(newWidth);
 
+			if (FrameType::isYUV(colorFrameEncoding) && kinectConfiguration.color_resolution != K4A_COLOR_RESOLUTION_720P)
+			{
+				Logger::Log(AzureKinectConstStr) << "Color format " << colorFormat << " is only available at 1280x720! Falling back to 720p" << std::endl;
+				kinectConfiguration.color_resolution = K4A_COLOR_RESOLUTION_720P;
+				appStatus->SetCameraColorHeight(720);
+				appStatus->SetCameraColorWidth(1280);
+			}
+
 
 		}
 		else {
@@ -681,6 +821,35 @@ bool AzureKinect::LoadConfigurationSettings()
 			kinectConfiguration.synchronized_images_only = true;
 		}
 
+		// how color and depth line up: warping color into the depth camera (or not warping anything) streams and records a lot less
+		frameRegistration = FrameRegistration::DepthToColor;
+		const std::string registration = configuration->GetCameraCustomString("registration", "depthToColor", false);
+		if (registration == "colorToDepth")
+		{
+			// k4a only warps BGRA32 color (mjpg frames are decoded first)
+			if (colorFrameEncoding == FrameType::Encoding::MJPEG || colorFrameEncoding == FrameType::Encoding::BGRA32)
+				frameRegistration = FrameRegistration::ColorToDepth;
+			else
+				Logger::Log(AzureKinectConstStr) << "Color can only be registered to depth when the color format is mjpg or bgra32 - registering depth to color instead" << std::endl;
+
+			if (frameRegistration == FrameRegistration::ColorToDepth && decodeColorFrames)
+				Logger::Log(AzureKinectConstStr) << "Ignoring decodeColor and decodeScale: color registered to depth is always BGRA32 with the depth resolution" << std::endl;
+		}
+		else if (registration == "none")
+		{
+			frameRegistration = FrameRegistration::None;
+		}
+		else if (registration != "depthToColor")
+		{
+			Logger::Log(AzureKinectConstStr) << "Unknown registration \"" << registration << "\" - using depthToColor instead" << std::endl;
+		}
+
+		// registration and decoding workers (only started when there is something for them to do)
+		capturePipeline.reset(new OrderedWorkerPool<CapturedFrames>("AzureKinectPipeline",
+			(unsigned int)std::max(configuration->GetCameraCustomInt("pipelineThreads", 0, false), 0),
+			(size_t)std::max(configuration->GetCameraCustomInt("pipelineMaxInFlight", 0, false), 0),
+			[this](unsigned long long, CapturedFrames& capture) { OnCaptureProcessed(capture); }));
+
 		// are we able to run at 30 fps?
 		if (canRun30fps)
 		{
@@ -10,6 +10,7 @@
 #include <functional>
 #include <thread>
 #include <memory>
+#include <mutex>
 #include <chrono>
 #include <vector>
 
@@ -18,6 +19,8 @@
 #include "ApplicationStatus.h"
 #include "Frame.h"
 #include "Camera.h"
+#include "JPEGDecoder.h"
+#include "OrderedWorkerPool.h"
 
 // kinect sdk
 #include <k4a/k4a.hpp>
@@ -37,6 +40,17 @@
   * requestDepth: true / false
   * colorWidth x colorHeight: 1280x720, 1920x1080, 2560x1440, 2048x1536, 4096x3072 (15fps)
   * depthWidth x depthHeight: 302x288, 512x512, 640x576, 1024x1024 (15fps)
+  * colorFormat: "mjpg" (default), "bgra32", "nv12" or "yuy2" (nv12 and yuy2 are 720p only)
+  * decodeColor: "bgra32", "bgr24" or "i420" to hand out decoded frames instead of MJPEG (off by default,
+    as MJPEG is forwarded untouched to clients and to the recorder)
+  * decodeScale: 1 (default), 2, 4 or 8 - decoded frames are shrunk by the jpeg decoder itself
+  * registration: how color and depth line up when both are requested. "depthToColor" (default) warps depth
+    into the color camera, "colorToDepth" warps color into the depth camera (BGRA32 frames with the depth
+    resolution - a lot less to stream and record, needs "mjpg" or "bgra32"), and "none" hands both out as
+    captured (version 2 clients get the extrinsics that line them up)
+  * pipelineThreads / pipelineMaxInFlight: size of the stage that registers depth to color and decodes color
+    (defaults to one thread per two cores, and two captures per thread). Captures that do not fit are dropped
+    instead of slowing down capture
   
   Configuration settings currently not supported:
   * serialNumber: We currently grab the first k4a device available
@@ -49,11 +63,84 @@ class AzureKinect : public Camera
 
 	k4a_device_configuration_t kinectConfiguration;
 	k4a::calibration kinectCameraCalibration;
-	k4a::transformation kinectCameraTransformation;
 
 	k4a_calibration_intrinsic_parameters_t* intrinsics_color;
 	k4a_calibration_intrinsic_parameters_t* intrinsics_depth;
 
+	// k4a::transformations are not thread safe (they keep scratch buffers around), so every registration
+	// worker borrows one of its own. Borrowed transformations go back to the pool when released
+	class TransformationPool
+	{
+		std::mutex poolMutex;
+		k4a::calibration calibration;
+		std::vector<std::unique_ptr<k4a::transformation> > transformations;
+		std::vector<k4a::transformation*> idle;
+
+	public:
+		// creates count transformations for a device calibration (forgetting the old ones - nobody can be borrowing them)
+		void Reset(const k4a::calibration& newCalibration, size_t count)
+		{
+			const std::lock_guard<std::mutex> lock(poolMutex);
+			calibration = newCalibration;
+			transformations.clear();
+			idle.clear();
+			for (size_t i = 0; i < count; ++i)
+			{
+				transformations.emplace_back(new k4a::transformation(calibration));
+				idle.push_back(transformations.back().get());
+			}
+		}
+
+		std::shared_ptr<k4a::transformation> Borrow()
+		{
+			const std::lock_guard<std::mutex> lock(poolMutex);
+			if (idle.empty())
+			{
+				transformations.emplace_back(new k4a::transformation(calibration));
+				idle.push_back(transformations.back().get());
+			}
+
+			k4a::transformation* transformation = idle.back();
+			idle.pop_back();
+			return std::shared_ptr<k4a::transformation>(transformation, [this](k4a::transformation* returned)
+			{
+				const std::lock_guard<std::mutex> lock(poolMutex);
+				idle.push_back(returned);
+			});
+		}
+	};
+
+	TransformationPool registrationTransformations;
+
+	// registration (and decoding, when pixels are requested through "decodeColor") runs on worker threads, so
+	// that the capture thread never falls behind the device. Captures are submitted as they arrive, so they
+	// come out in device timestamp order
+	struct CapturedFrames
+	{
+		std::chrono::microseconds timestamp;
+		std::shared_ptr<Frame> color, depth, originalDepth;
+	};
+
+	std::unique_ptr<OrderedWorkerPool<CapturedFrames> > capturePipeline;
+	bool decodeColorFrames;
+	FrameType::Encoding decodedColorEncoding;
+	unsigned int decodedColorScale;
+
+	// registers a depth image to the color camera into a (pooled) frame with the color resolution
+	std::shared_ptr<Frame> RegisterDepthToColor(const k4a::image& depthImage);
+
+	// registers a BGRA32 color frame to the depth camera into a (pooled) frame with the depth resolution
+	std::shared_ptr<Frame> RegisterColorToDepth(const k4a::image& depthImage, const Frame& color);
+
+	// is color warped into the depth camera? (both cameras have to be running)
+	bool IsRegisteringColorToDepth() const
+	{
+		return frameRegistration == FrameRegistration::ColorToDepth && colorCameraEnabled && depthCameraEnabled;
+	}
+
+	// hands a processed capture to whoever is listening
+	void OnCaptureProcessed(CapturedFrames& capture);
+
 
 
 	static const char* AzureKinectConstStr;
@@ -70,7 +157,7 @@ public:
 	}
 
 	AzureKinect(std::shared_ptr<ApplicationStatus> appStatus, std::shared_ptr<Configuration> configuration) : Camera(appStatus, configuration), kinectConfiguration(K4A_DEVICE_CONFIG_INIT_DISABLE_ALL),
-		intrinsics_color(nullptr), intrinsics_depth(nullptr)
+		intrinsics_color(nullptr), intrinsics_depth(nullptr), decodeColorFrames(false), decodedColorEncoding(FrameType::Encoding::BGRA32), decodedColorScale(1)
 	{
 	}
 
@@ -84,6 +171,9 @@ public:
 		// stop thread first
 		Camera::Stop();
 
+		if (capturePipeline)
+			capturePipeline->Stop();
+
 		// frees resources
 		if (IsAnyCameraEnabled())
 		{
@@ -152,6 +242,49 @@ public:
 	}
 
 
+	// decoded and registered color frames come from their own pools
+	virtual std::vector<FrameGeometry> GetFrameGeometries() const
+	{
+		std::vector<FrameGeometry> geometries = Camera::GetFrameGeometries();
+
+		if (IsRegisteringColorToDepth())
+		{
+			// mjpg frames are decoded to BGRA32 first (k4a cannot warp anything else)
+			geometries.emplace_back(depthCameraParameters.resolutionWidth, depthCameraParameters.resolutionHeight, FrameType::Encoding::BGRA32);
+			if (colorFrameEncoding == FrameType::Encoding::MJPEG)
+				geometries.emplace_back(colorCameraParameters.resolutionWidth, colorCameraParameters.resolutionHeight, FrameType::Encoding::BGRA32);
+		}
+		else if (colorCameraEnabled && decodeColorFrames)
+		{
+			geometries.emplace_back(JPEGDecoder::ScaledSize(colorCameraParameters.resolutionWidth, decodedColorScale),
+				JPEGDecoder::ScaledSize(colorCameraParameters.resolutionHeight, decodedColorScale), decodedColorEncoding);
+		}
+
+		return geometries;
+	}
+
+	// decoded color frames might be smaller than what the camera captures
+	virtual CameraParameters GetColorFrameParameters() const
+	{
+		CameraParameters parameters = Camera::GetColorFrameParameters();
+
+		if (colorCameraEnabled && decodeColorFrames && !IsRegisteringColorToDepth() && decodedColorScale > 1)
+		{
+			const int width = (int)JPEGDecoder::ScaledSize(parameters.resolutionWidth, decodedColorScale);
+			const int height = (int)JPEGDecoder::ScaledSize(parameters.resolutionHeight, decodedColorScale);
+			const float scaleX = (float)width / parameters.resolutionWidth, scaleY = (float)height / parameters.resolutionHeight;
+
+			parameters.intrinsics.fx *= scaleX;
+			parameters.intrinsics.cx *= scaleX;
+			parameters.intrinsics.fy *= scaleY;
+			parameters.intrinsics.cy *= scaleY;
+			parameters.resolutionWidth = width;
+			parameters.resolutionHeight = height;
+		}
+
+		return parameters;
+	}
+
 protected:
 
 	// opens the default kinect camera
@@ -8,6 +8,7 @@
 #include <vector>
 
 #include "Frame.h"
+#include "FramePool.h"
 #include "Logger.h"
 
 #include "DataSource.h"
@@ -79,6 +80,32 @@ struct CameraParameters
 };
 
 
+/**
+   Geometry of the frames a camera produces (used to pool frame memory)
+ */
+struct FrameGeometry
+{
+	unsigned long width;
+	unsigned long height;
+	FrameType::Encoding encoding;
+
+	FrameGeometry(unsigned long width, unsigned long height, FrameType::Encoding encoding) :
+		width(width), height(height), encoding(encoding)
+	{
+
+	}
+};
+
+/**
+   How a camera lines up the color and depth frames it hands out
+ */
+enum class FrameRegistration
+{
+	DepthToColor,	// depth is warped into the color camera (depth frames have the color resolution)
+	ColorToDepth,	// color is warped into the depth camera (color frames have the depth resolution)
+	None			// frames are sent as captured (clients line them up with the intrinsics and extrinsics)
+};
+
 /*
  * CameraStatistics are the same as a DataSourceStatistics
  */
@@ -114,6 +141,15 @@ protected:
 	// which camera is running?
 	bool depthCameraEnabled, colorCameraEnabled;
 
+	// encoding of the color frames this camera creates (cameras should update it when it is not BGR24)
+	FrameType::Encoding colorFrameEncoding;
+
+	// how color and depth frames line up when both cameras run (cameras that can do otherwise should update it)
+	FrameRegistration frameRegistration;
+
+	// frame pools registered for the current session (see RegisterFramePools)
+	std::vector<FrameBufferPool*> framePools;
+
 	// all threads use a shared data structure to report their status
 	std::shared_ptr<ApplicationStatus> appStatus;
 
@@ -188,13 +224,14 @@ public:
 	CameraDisconnectedCallback onCameraDisconnect;
 
 	// constructor explicitly defining a configuration file (as well as appStatus)
-	Camera(std::shared_ptr<ApplicationStatus> appStatus, std::shared_ptr<Configuration> configuration) : currentExposure(0), currentGain(0), appStatus(appStatus), configuration(configuration), thread_running(false), depthCameraEnabled(false), colorCameraEnabled(false), getFrameTimeout(1000), getFrameTimeoutMSInt(1000)
+	Camera(std::shared_ptr<ApplicationStatus> appStatus, std::shared_ptr<Configuration> configuration) : currentExposure(0), currentGain(0), appStatus(appStatus), configuration(configuration), thread_running(false), depthCameraEnabled(false), colorCameraEnabled(false), colorFrameEncoding(FrameType::Encoding::BGR24), frameRegistration(FrameRegistration::DepthToColor), getFrameTimeout(1000), getFrameTimeoutMSInt(1000)
 	{
 	}
 
 	~Camera()
 	{
 		Stop();
+		RetireFramePools();
 	}
 
 	inline bool IsThreadRunning()
@@ -260,6 +297,49 @@ public:
 	virtual bool AdjustExposureBy(int exposure_level) = 0;
 
 
+	// Returns the geometry of every frame this camera creates with its current (negotiated) settings
+	// Cameras that register depth to color (k4a, rs2) create depth frames with the color resolution as well
+	virtual std::vector<FrameGeometry> GetFrameGeometries() const
+	{
+		std::vector<FrameGeometry> geometries;
+
+		if (colorCameraEnabled)
+			geometries.emplace_back(colorCameraParameters.resolutionWidth, colorCameraParameters.resolutionHeight, colorFrameEncoding);
+
+		if (depthCameraEnabled)
+		{
+			geometries.emplace_back(depthCameraParameters.resolutionWidth, depthCameraParameters.resolutionHeight, FrameType::Encoding::Mono16);
+
+			if (colorCameraEnabled && frameRegistration == FrameRegistration::DepthToColor)
+				geometries.emplace_back(colorCameraParameters.resolutionWidth, colorCameraParameters.resolutionHeight, FrameType::Encoding::Mono16);
+		}
+
+		return geometries;
+	}
+
+	// Creates frame pools for the frames this camera is about to create (call it once the camera connects)
+	void RegisterFramePools(size_t prewarm, size_t capacity)
+	{
+		// a camera that reconnects might have negotiated a different resolution
+		RetireFramePools();
+
+		for (const FrameGeometry& geometry : GetFrameGeometries())
+		{
+			FrameBufferPool* pool = FramePool::Instance().Register(geometry.width, geometry.height, geometry.encoding, prewarm, capacity);
+			if (pool)
+				framePools.push_back(pool);
+		}
+	}
+
+	// Frees the memory held by the pools registered in RegisterFramePools (call it once the camera disconnects)
+	void RetireFramePools()
+	{
+		for (FrameBufferPool* pool : framePools)
+			FramePool::Instance().Retire(pool);
+
+		framePools.clear();
+	}
+
 	// Returns a json file with a valid OpenCV camera intrinsic matrix
 	virtual std::string OpenCVCameraMatrix(const CameraParameters& param) const;
 
@@ -314,8 +394,22 @@ public:
 	}
 
 	// Camera paremeters
+	// colorCameraParameters.extrinsics take points from the depth camera to the color camera (when known)
 	CameraParameters depthCameraParameters, colorCameraParameters;
 
+	// how color and depth frames line up when both cameras run
+	FrameRegistration GetFrameRegistration() const
+	{
+		return frameRegistration;
+	}
+
+	// parameters of the color frames this camera hands out (color warped into the depth camera looks like depth).
+	// cameras that resize color frames themselves should override it
+	virtual CameraParameters GetColorFrameParameters() const
+	{
+		return (frameRegistration == FrameRegistration::ColorToDepth && colorCameraEnabled && depthCameraEnabled) ? depthCameraParameters : colorCameraParameters;
+	}
+
 	// Camera statistics
 	CameraStatistics statistics;
 
@@ -6,6 +6,8 @@
 #include <iostream>
 #include <chrono>
 #include <map>
+#include <algorithm>
+#include <iterator>
 
 //
 // Local includes, from more generic and widely used to more specific and locally required
@@ -18,18 +20,21 @@
 
 // 2) Abstraction of video capture devices and memory management for frames
 #include "Frame.h"
+#include "FramePool.h"
 #include "Camera.h"
 
 // 3) Applications (threads)
 #include "TCPStreamingServer.h"
 #include "RemoteControlServer.h"
 #include "VideoRecorder.h"
+#include "SharedMemoryServer.h"
 
 // 4) specific cameras supported
 #include "CompilerConfiguration.h"
 #include "AzureKinect.h"
 #include "RealSense.h"
 #include "TCPRelayCamera.h"
+#include "UDPMulticastRelayCamera.h"
 #include "OpenCVVideoCaptureCamera.h"
 
 // 5) version specific 
@@ -37,6 +42,40 @@
 
 using namespace std;
 
+// what version 2 streaming clients are told about a camera's intrinsics
+static TCPStreamingServer::CalibratedIntrinsics ToStreamingIntrinsics(const CameraParameters& parameters)
+{
+	TCPStreamingServer::CalibratedIntrinsics calibrated;
+	const CameraIntrinsics& intrinsics = parameters.intrinsics;
+
+	calibrated.intrinsics.fx = intrinsics.fx;
+	calibrated.intrinsics.fy = intrinsics.fy;
+	calibrated.intrinsics.cx = intrinsics.cx;
+	calibrated.intrinsics.cy = intrinsics.cy;
+	calibrated.intrinsics.k1 = intrinsics.k1;
+	calibrated.intrinsics.k2 = intrinsics.k2;
+	calibrated.intrinsics.k3 = intrinsics.k3;
+	calibrated.intrinsics.k4 = intrinsics.k4;
+	calibrated.intrinsics.k5 = intrinsics.k5;
+	calibrated.intrinsics.k6 = intrinsics.k6;
+	calibrated.intrinsics.p1 = intrinsics.p1;
+	calibrated.intrinsics.p2 = intrinsics.p2;
+	calibrated.intrinsics.metricScale = intrinsics.metricScale;
+	calibrated.width = parameters.resolutionWidth;
+	calibrated.height = parameters.resolutionHeight;
+
+	return calibrated;
+}
+
+// where the depth camera is with respect to the color camera (for clients of cameras that do not register frames)
+static StreamingProtocol::ExtrinsicsV2 ToStreamingExtrinsics(const CameraExtrinsics& extrinsics)
+{
+	StreamingProtocol::ExtrinsicsV2 streamed;
+	std::copy(std::begin(extrinsics.rotation), std::end(extrinsics.rotation), streamed.rotation);
+	std::copy(std::begin(extrinsics.translation), std::end(extrinsics.translation), streamed.translation);
+	return streamed;
+}
+
 int main(int argc, char* argv[])
 {
 
@@ -81,6 +120,11 @@ int main(int argc, char* argv[])
 		{"tcp-relay", &TCPRelayCamera::Create},
 		#endif //  CS_ENABLE_CAMERA_TCPCLIENT_RELAY
 
+		// UDP Multicast Relay support
+		#ifdef CS_ENABLE_CAMERA_MULTICAST_RELAY
+		{"multicast-relay", &UDPMulticastRelayCamera::Create},
+		#endif // CS_ENABLE_CAMERA_MULTICAST_RELAY
+
 		// OpenCV
 		#ifdef CS_ENABLE_CAMERA_CV_VIDEOCAPTURE
 		{"opencv", &CVVideoCaptureCamera::Create},
@@ -111,6 +155,16 @@ int main(int argc, char* argv[])
 	// initializes appStatus based on some default values from the configuration
 	appStatus->UpdateAppStatusFromConfig(*configuration);
 
+	// pools frame geometries listed in the configuration file (cameras add their own when they connect)
+	for (const FramePoolGeometry& geometry : configuration->GetFramePoolGeometries())
+	{
+		FrameType::Encoding encoding;
+		if (FrameType::fromString(geometry.encoding, encoding))
+			FramePool::Instance().Register(geometry.width, geometry.height, encoding, configuration->GetFramePoolPrewarm(), configuration->GetFramePoolCapacity());
+		else
+			Logger::Log("Main") << "Ignoring frame pool geometry " << geometry.width << 'x' << geometry.height << " with unknown encoding \"" << geometry.encoding << '"' << endl;
+	}
+
 	// main application loop where it waits for a user key to stop everything
 	try 
 	{
@@ -118,15 +172,19 @@ int main(int argc, char* argv[])
 		// starts listening but not yet dealing with client connections
 		TCPStreamingServer server(appStatus, configuration);
 		VideoRecorder videoRecorderThread(appStatus, appStatus->GetCameraType());
+		SharedMemoryServer sharedMemoryServer(appStatus, configuration);
 
 		// instantiate the correct camera
 		std::shared_ptr<Camera> camera = SupportedCamerasSet[appStatus->GetCameraType()](appStatus, configuration);
 
 		// set up callbacks
-		camera->onFramesReady = [&](std::chrono::microseconds, std::shared_ptr<Frame> color, std::shared_ptr<Frame> depth, std::shared_ptr<Frame> originalDepth)
+		camera->onFramesReady = [&](std::chrono::microseconds timestamp, std::shared_ptr<Frame> color, std::shared_ptr<Frame> depth, std::shared_ptr<Frame> originalDepth)
 		{
 			// streams to client
-			server.ForwardToAll(color, depth);
+			server.ForwardToAll(timestamp, color, depth);
+
+			// same machine consumers (if enabled)
+			sharedMemoryServer.Publish(color, depth);
 
 			// saves to file 
 			if (appStatusPtr.isRedirectingFramesToRecorder())
@@ -147,13 +205,39 @@ int main(int argc, char* argv[])
 				printedIntrinsicsOnce = true;				
 			}
 
+			// pools the frames the camera is about to create (based on the resolution it negotiated)
+			if (camera)
+			{
+				camera->RegisterFramePools(configuration->GetFramePoolPrewarm(), configuration->GetFramePoolCapacity());
+
+				// shared memory slots fit the largest frames of the new geometry
+				sharedMemoryServer.SetFrameGeometries(camera->GetFrameGeometries());
+			}
+
+			// intrinsics might have changed (e.g.: different resolution), so version 2 clients get them on the next frame.
+			// color warped into the depth camera has the depth intrinsics, and frames that are not registered come with extrinsics
+			if (camera)
+			{
+				TCPStreamingServer::CalibratedIntrinsics colorIntrinsics = ToStreamingIntrinsics(camera->GetColorFrameParameters());
+				colorIntrinsics.intrinsics.metricScale = camera->colorCameraParameters.intrinsics.metricScale;
+
+				if (camera->GetFrameRegistration() == FrameRegistration::None && camera->IsColorCameraEnabled() && camera->IsDepthCameraEnabled())
+				{
+					const StreamingProtocol::ExtrinsicsV2 extrinsics = ToStreamingExtrinsics(camera->colorCameraParameters.extrinsics);
+					server.SetIntrinsics(colorIntrinsics, ToStreamingIntrinsics(camera->depthCameraParameters), &extrinsics);
+				}
+				else {
+					server.SetIntrinsics(colorIntrinsics, ToStreamingIntrinsics(camera->depthCameraParameters));
+				}
+			}
+
 			// also, make sure that the streaming software can handle the content comming from the camera
 			// (this only works to disable streaming in case it was expected)
 			if (appStatus && appStatus->GetStreamingColorEnabled())
 			{
 				appStatus->SetStreamingColorEnabled(camera->IsColorCameraEnabled());
-				appStatus->SetStreamingWidth(camera->colorCameraParameters.resolutionWidth);
-				appStatus->SetStreamingHeight(camera->colorCameraParameters.resolutionHeight);
+				appStatus->SetStreamingWidth(camera->GetColorFrameParameters().resolutionWidth);
+				appStatus->SetStreamingHeight(camera->GetColorFrameParameters().resolutionHeight);
 			}
 
 			if (appStatus && appStatus->GetStreamingDepthEnabled())
@@ -184,6 +268,15 @@ int main(int argc, char* argv[])
 				Logger::Log("Camera") << "Captured " << camera->statistics.framesCaptured << " frames in " << camera->statistics.durationInSeconds() << " seconds (" << ((double)camera->statistics.framesCaptured / (double)camera->statistics.durationInSeconds()) << " fps) - Fails: " << camera->statistics.framesFailed << " times" << std::endl;
 			}
 
+			// how many frames were served without allocating memory?
+			FramePool::Instance().LogStatistics("Camera");
+
+			// frees frame memory until the camera connects again
+			if (camera)
+			{
+				camera->RetireFramePools();
+			}
+
 			if (appStatus && appStatus->isRedirectingFramesToRecorder())
 			{
 				videoRecorderThread.StopRecording();
@@ -192,6 +285,7 @@ int main(int argc, char* argv[])
 
 		camera->Run();
 		server.Run();
+		sharedMemoryServer.Run();
 		videoRecorderThread.Run();
 
 		// finally 
@@ -303,6 +397,9 @@ int main(int argc, char* argv[])
 			// stops tcp server
 			server.Stop();
 
+			// stops publishing to shared memory (removes the ring)
+			sharedMemoryServer.Stop();
+
 			// stops cameras
 			if (camera)
 				camera->Stop();
@@ -347,6 +444,26 @@ int main(int argc, char* argv[])
 				Logger::Log("Remote") << "(changeGain) Error! No value received!" << std::endl;
 			}
 
+		},
+
+
+		// latest frame streamed (what new streaming clients get first, so it is never encoded just for this)
+		[&](std::shared_ptr<RemoteClient> client, const rapidjson::Document& message)
+		{
+			std::shared_ptr<StreamingMessage> latest = server.GetLatestFrame();
+			if (!latest)
+			{
+				client->message("{\"type\": \"latestFrame\", \"available\": false}");
+				Logger::Log("Remote") << "(getLatestFrame) No recent frame to send!" << std::endl;
+				return;
+			}
+
+			// a json reply followed by the frame as streamed (its length field doubles as the message header)
+			std::shared_ptr<std::vector<uchar> > frame = std::make_shared<std::vector<uchar> >();
+			latest->CopyTo(*frame);
+
+			client->message("{\"type\": \"latestFrame\", \"available\": true, \"length\": " + std::to_string(frame->size()) + "}");
+			client->send(frame);
 		});
 
 		// runs the rmeote server with the above callbacks (yeah, I should remove
@@ -391,6 +508,9 @@ int main(int argc, char* argv[])
 		// stops tcp server
 		server.Stop();
 
+		// stops publishing to shared memory (removes the ring)
+		sharedMemoryServer.Stop();
+
 		// stops cameras
 		camera->Stop();
 
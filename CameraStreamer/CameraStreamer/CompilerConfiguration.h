@@ -12,8 +12,17 @@
 #define CS_ENABLE_CAMERA_K4A 1					// azure kinect cameras (needs k4a:x64-windows)
 #define CS_ENABLE_CAMERA_RS2 1					// real sense api       (needs realsense2:x64-windows)
 #define CS_ENABLE_CAMERA_TCPCLIENT_RELAY 1		// camera that relays content from the network (TCP - better for local area network)
+#define CS_ENABLE_CAMERA_MULTICAST_RELAY 1		// camera that relays RTP/JPEG frames sent to a multicast group (UDP)
 #define CS_ENABLE_CAMERA_CV_VIDEOCAPTURE 1	    // using opencv to receive content from connected cameras
 
+#define CS_ENABLE_DEPTH_CODEC_ZSTD 1			// zstd depth compression (needs zstd:x64-windows)
+#define CS_ENABLE_DEPTH_CODEC_LZ4 1				// lz4 depth compression (needs lz4:x64-windows)
+
+// Linux only: boost.asio waits for sockets with io_uring instead of epoll (needs boost 1.78+ and liburing, link with -luring).
+// It saves the streaming server a syscall per write when many clients are connected (see "Benchmarks egress").
+// Every file that uses asio includes this header first, so that they all agree on the backend
+//#define CS_ENABLE_ASIO_IO_URING 1
+
 // ----  WIP ----  (Disabled for now as it is being developed)
 
 //#define CS_ENABLE_CAMERA_VIDEOFILE 1			// video file replay camera (OpenCV)
@@ -22,4 +31,15 @@
 //#define CS_ENABLE_CAMERA_DVI2USB 1			    // DVI2USB camera (needs headers and libraries already packaged in with CameraStreamer)
 
 
+#if defined(CS_ENABLE_ASIO_IO_URING) && !defined(_WIN32)
+#include <boost/version.hpp>
+#if BOOST_VERSION < 107800
+#error "CS_ENABLE_ASIO_IO_URING needs boost 1.78 or newer"
+#endif
+#ifdef BOOST_ASIO_DETAIL_CONFIG_HPP
+#error "CompilerConfiguration.h has to be included before boost.asio when CS_ENABLE_ASIO_IO_URING is enabled"
+#endif
+#define BOOST_ASIO_HAS_IO_URING 1
+#define BOOST_ASIO_DISABLE_EPOLL 1
+#endif
 
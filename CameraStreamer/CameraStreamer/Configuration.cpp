@@ -7,6 +7,7 @@
 
 #include <fstream>
 #include "Logger.h"
+#include "DepthCodec.h"
 
 const char* Configuration::ConfigNameStr = "Config";
 
@@ -16,6 +17,16 @@ const char* Configuration::ConfigNameStr = "Config";
 #define ReadJSONDefaultBool(d,dname,name,destination,defaultvalue,warn) if (d.HasMember(name) && d[name].IsBool()) { destination = d[name].GetBool(); } else { destination = defaultvalue; if (warn) { Logger::Log(ConfigNameStr) << "Error! Element \""##dname##"."<< name << "\" should have a valid boolean! Using default: " << defaultvalue  << std::endl; } }
 #define ReadJSONDefaultString(d,dname,name,destination,defaultvalue,warn) if (d.HasMember(name)) { destination = d[name].GetString(); } else { destination = defaultvalue;  if (warn) { Logger::Log(ConfigNameStr) << "Error! Element \""##dname##"."<< name << "\" should have a valid string! Using default: " << defaultvalue << std::endl; } }
 
+// falls back to "raw" if a depth codec is unknown (or was not compiled in)
+void Configuration::ValidateDepthCodec(const char* section, std::string& codecName)
+{
+	DepthCodec::Type codec;
+	if (!DepthCodec::TypeFromString(codecName, codec) || !DepthCodec::IsAvailable(codec))
+	{
+		Logger::Log(ConfigNameStr) << "Value Error! " << section << ".depthCodec \"" << codecName << "\" is not supported. Using \"raw\" instead!" << std::endl;
+		codecName = "raw";
+	}
+}
 
 bool Configuration::LoadConfiguration(const std::string& filepath)
 {
@@ -192,6 +203,67 @@ void  Configuration::ParseConfiguration(bool warn)
 		isStreamingDepth = false;
 	}
 	
+	// how many frames can be encoded at once (optional)
+	ReadJSONDefaultInt(currentDoc, "streaming", "encoderThreads", streamingEncoderThreads, 0, false);
+	if (streamingEncoderThreads < 0)
+	{
+		Logger::Log(ConfigNameStr) << "Value Error! streaming.encoderThreads should not be negative. Using one thread per two cores instead!" << std::endl;
+		streamingEncoderThreads = 0;
+	}
+
+	// how many threads write to clients (optional)
+	ReadJSONDefaultInt(currentDoc, "streaming", "ioThreads", streamingIOThreads, 1, false);
+	if (streamingIOThreads < 0)
+	{
+		Logger::Log(ConfigNameStr) << "Value Error! streaming.ioThreads should not be negative. Using one thread per two cores instead!" << std::endl;
+		streamingIOThreads = 0;
+	}
+
+	// unix domain socket for local clients (optional)
+	ReadJSONDefaultString(currentDoc, "streaming", "localSocket", streamingLocalSocketPath, "", false);
+
+	// how many bytes can wait in a client socket before newer frames are held back (optional)
+	ReadJSONDefaultInt(currentDoc, "streaming", "sendLowWaterMark", streamingSendLowWaterMark, 16384, false);
+	if (streamingSendLowWaterMark < 0)
+	{
+		Logger::Log(ConfigNameStr) << "Value Error! streaming.sendLowWaterMark should not be negative. Turning it off instead!" << std::endl;
+		streamingSendLowWaterMark = 0;
+	}
+
+	ReadJSONDefaultInt(currentDoc, "streaming", "sendBufferSize", streamingSendBufferSize, 0, false);
+	if (streamingSendBufferSize < 0)
+	{
+		Logger::Log(ConfigNameStr) << "Value Error! streaming.sendBufferSize should not be negative. Using the system default instead!" << std::endl;
+		streamingSendBufferSize = 0;
+	}
+
+	// lower quality for clients that cannot keep up (optional)
+	ReadJSONDefaultBool(currentDoc, "streaming", "adaptiveQuality", streamingAdaptiveQuality, false, false);
+
+	// frames encoded with nobody watching, just for clients that connect later (optional)
+	ReadJSONDefaultBool(currentDoc, "streaming", "keepLatestFrame", streamingKeepLatestFrame, false, false);
+
+	// jpeg compression settings (optional)
+	ReadJSONDefaultInt(currentDoc, "streaming", "jpegQuality", streamingJpegQuality, 95, false);
+	ReadJSONDefaultString(currentDoc, "streaming", "jpegSubsampling", streamingJpegSubsampling, "420", false);
+	ReadJSONDefaultBool(currentDoc, "streaming", "jpegFastDCT", streamingJpegFastDCT, false, false);
+
+	if (streamingJpegQuality < 1 || streamingJpegQuality > 100)
+	{
+		Logger::Log(ConfigNameStr) << "Value Error! streaming.jpegQuality should be between 1 and 100. Using 95 instead!" << std::endl;
+		streamingJpegQuality = 95;
+	}
+
+	if (streamingJpegSubsampling != "444" && streamingJpegSubsampling != "422" && streamingJpegSubsampling != "420" && streamingJpegSubsampling != "gray")
+	{
+		Logger::Log(ConfigNameStr) << "Value Error! streaming.jpegSubsampling should be \"444\", \"422\", \"420\", or \"gray\". Using \"420\" instead!" << std::endl;
+		streamingJpegSubsampling = "420";
+	}
+
+	// depth compression (optional - clients have to support it)
+	ReadJSONDefaultString(currentDoc, "streaming", "depthCodec", streamingDepthCodec, "raw", false);
+	ValidateDepthCodec("streaming", streamingDepthCodec);
+
 	// adjsuting streaming resolutions (same as capture for now)
 	if (requestColorCamera)
 	{
@@ -208,7 +280,7 @@ void  Configuration::ParseConfiguration(bool warn)
 		streamingColorFormat = "jpeg";
 	else
 		streamingColorFormat = "jpeg"; // yeah
-	streamingDepthFormat = "raw16";
+	streamingDepthFormat = (streamingDepthCodec == "raw") ? "raw16" : streamingDepthCodec;
 
 	// validate streaming entries
 	if (isStreamingColor && !requestColorCamera)
@@ -224,6 +296,131 @@ void  Configuration::ParseConfiguration(bool warn)
 	}
 
 
+	// =======================================================================================
+
+	// recording (optional)
+	if (parsedConfigurationFile.HasMember("recording") && parsedConfigurationFile["recording"].IsObject())
+	{
+		currentDoc = parsedConfigurationFile["recording"].GetObject();
+	}
+	else {
+		rapidjson::Value emptyDoc;
+		emptyDoc.SetObject();
+		currentDoc = emptyDoc;
+	}
+
+	ReadJSONDefaultString(currentDoc, "recording", "depthCodec", recordingDepthCodec, "raw", false);
+	ValidateDepthCodec("recording", recordingDepthCodec);
+
+
+	// =======================================================================================
+
+	// shared memory (optional) - raw frames for processes running on the same machine
+	if (parsedConfigurationFile.HasMember("sharedMemory") && parsedConfigurationFile["sharedMemory"].IsObject())
+	{
+		currentDoc = parsedConfigurationFile["sharedMemory"].GetObject();
+	}
+	else {
+		rapidjson::Value emptyDoc;
+		emptyDoc.SetObject();
+		currentDoc = emptyDoc;
+	}
+
+	ReadJSONDefaultBool(currentDoc, "sharedMemory", "enabled", sharedMemoryEnabled, false, false);
+	ReadJSONDefaultString(currentDoc, "sharedMemory", "name", sharedMemoryName, "CameraStreamer", false);
+	ReadJSONDefaultInt(currentDoc, "sharedMemory", "slots", sharedMemorySlots, 4, false);
+
+	if (sharedMemorySlots < 2)
+	{
+		Logger::Log(ConfigNameStr) << "Value Error! sharedMemory.slots should be at least 2. Using 4 instead!" << std::endl;
+		sharedMemorySlots = 4;
+	}
+
+
+	// =======================================================================================
+
+	// multicast (optional) - color frames are sent once to a multicast group regardless of how many machines are watching
+	if (parsedConfigurationFile.HasMember("multicast") && parsedConfigurationFile["multicast"].IsObject())
+	{
+		currentDoc = parsedConfigurationFile["multicast"].GetObject();
+	}
+	else {
+		rapidjson::Value emptyDoc;
+		emptyDoc.SetObject();
+		currentDoc = emptyDoc;
+	}
+
+	ReadJSONDefaultBool(currentDoc, "multicast", "enabled", multicastEnabled, false, false);
+	ReadJSONDefaultString(currentDoc, "multicast", "group", multicastGroup, "239.255.0.1", false);
+	ReadJSONDefaultInt(currentDoc, "multicast", "port", multicastPort, 5004, false);
+	ReadJSONDefaultInt(currentDoc, "multicast", "ttl", multicastTTL, 1, false);
+	ReadJSONDefaultInt(currentDoc, "multicast", "mtu", multicastMTU, 1400, false);
+	ReadJSONDefaultBool(currentDoc, "multicast", "loopback", multicastLoopback, true, false);
+	ReadJSONDefaultString(currentDoc, "multicast", "interface", multicastInterface, "", false);
+
+	if (multicastPort <= 0 || multicastPort > 65535)
+	{
+		Logger::Log(ConfigNameStr) << "Value Error! multicast.port should be between 1 and 65535. Using 5004 instead!" << std::endl;
+		multicastPort = 5004;
+	}
+
+	if (multicastTTL < 0 || multicastTTL > 255)
+	{
+		Logger::Log(ConfigNameStr) << "Value Error! multicast.ttl should be between 0 and 255. Using 1 instead!" << std::endl;
+		multicastTTL = 1;
+	}
+
+	// room for the headers of the first packet of a frame (and no larger than a udp datagram)
+	if (multicastMTU < 512 || multicastMTU > 65507)
+	{
+		Logger::Log(ConfigNameStr) << "Value Error! multicast.mtu should be between 512 and 65507. Using 1400 instead!" << std::endl;
+		multicastMTU = 1400;
+	}
+
+
+	// =======================================================================================
+
+	// frame pool (optional)
+	if (parsedConfigurationFile.HasMember("framePool") && parsedConfigurationFile["framePool"].IsObject())
+	{
+		currentDoc = parsedConfigurationFile["framePool"].GetObject();
+	}
+	else {
+		rapidjson::Value emptyDoc;
+		emptyDoc.SetObject();
+		currentDoc = emptyDoc;
+	}
+
+	ReadJSONDefaultInt(currentDoc, "framePool", "prewarm", framePoolPrewarm, 4, false);
+	ReadJSONDefaultInt(currentDoc, "framePool", "capacity", framePoolCapacity, 8, false);
+
+	if (framePoolPrewarm < 0 || framePoolCapacity < 1)
+	{
+		Logger::Log(ConfigNameStr) << "Value Error! framePool.prewarm should be positive and framePool.capacity greater than zero. Using 4 and 8 instead!" << std::endl;
+		framePoolPrewarm = 4;
+		framePoolCapacity = 8;
+	}
+
+	// extra geometries (e.g.: [{"width": 1024, "height": 768, "encoding": "bgr24"}])
+	framePoolGeometries.clear();
+	if (currentDoc.HasMember("geometries") && currentDoc["geometries"].IsArray())
+	{
+		for (const rapidjson::Value& geometryDoc : currentDoc["geometries"].GetArray())
+		{
+			if (!geometryDoc.IsObject())
+				continue;
+
+			FramePoolGeometry geometry;
+			ReadJSONDefaultInt(geometryDoc, "framePool.geometries", "width", geometry.width, 0, true);
+			ReadJSONDefaultInt(geometryDoc, "framePool.geometries", "height", geometry.height, 0, true);
+			ReadJSONDefaultString(geometryDoc, "framePool.geometries", "encoding", geometry.encoding, "bgr24", true);
+
+			if (geometry.width > 0 && geometry.height > 0)
+				framePoolGeometries.push_back(geometry);
+		}
+	}
+
+
 	// prints a quick status of the configuration
 	std::cout << std::endl;
 
@@ -6,6 +6,13 @@
 #include <vector>
 #include <rapidjson/document.h>
 
+// frame geometry as described in the "framePool" section of the configuration file
+struct FramePoolGeometry
+{
+	int width, height;
+	std::string encoding; // e.g.: "bgr24", "bgra32", "mono16"
+};
+
 class Configuration
 {
 
@@ -48,6 +55,49 @@ protected:
 	// streamer: should we stream depth by default?
 	bool isStreamingDepth;
 
+	// streamer: number of threads encoding frames in parallel (0 means one per two cores)
+	int streamingEncoderThreads;
+
+	// streamer: number of threads serving clients (0 means one per two cores)
+	int streamingIOThreads;
+
+	// streamer: path of a unix domain socket that local clients can connect to (empty means tcp only)
+	std::string streamingLocalSocketPath;
+
+	// streamer: bytes not yet sent below which a client socket is considered writable (TCP_NOTSENT_LOWAT, 0 means off), and the socket send buffer size (0 means system default)
+	int streamingSendLowWaterMark;
+	int streamingSendBufferSize;
+
+	// streamer: clients that drop messages get lower quality streams (see QualityTier)
+	bool streamingAdaptiveQuality;
+
+	// streamer: keeps encoding a frame every now and then while no client is connected (so that new clients and getLatestFrame get one right away)
+	bool streamingKeepLatestFrame;
+
+	// streamer: jpeg quality (1-100), chroma subsampling ("444", "422", "420", or "gray"), and whether to use the fast (less accurate) DCT
+	int streamingJpegQuality;
+	std::string streamingJpegSubsampling;
+	bool streamingJpegFastDCT;
+
+	// streamer: lossless depth compression ("raw", "rvl", "zstd", or "lz4")
+	std::string streamingDepthCodec;
+
+	// recorder: lossless depth compression used in .depth files ("raw", "rvl", "zstd", or "lz4")
+	std::string recordingDepthCodec;
+
+	// shared memory: should raw frames be published to a shared memory ring? (name of the ring and number of frames it holds)
+	bool sharedMemoryEnabled;
+	std::string sharedMemoryName;
+	int sharedMemorySlots;
+
+	// multicast: should color frames be sent to a multicast group over RTP/JPEG? (group address, port, time to live, largest datagram,
+	// whether this machine also gets them, and the address of the network interface used to send them - empty means system default)
+	bool multicastEnabled;
+	std::string multicastGroup;
+	int multicastPort, multicastTTL, multicastMTU;
+	bool multicastLoopback;
+	std::string multicastInterface;
+
 	// camera: what camera should we connect to?
 	std::string cameraType;
 
@@ -75,6 +125,15 @@ protected:
 
 	// camera: how long should we wait before doing something about oncoming frames 
 	unsigned long cameraFrameCaptureTimeout;
+
+	// frame pool: how many buffers are allocated ahead of time for each geometry
+	int framePoolPrewarm;
+
+	// frame pool: how many free buffers each geometry keeps around
+	int framePoolCapacity;
+
+	// frame pool: geometries that should be pooled even before a camera connects
+	std::vector<FramePoolGeometry> framePoolGeometries;
 	
 
 
@@ -93,6 +152,9 @@ private:
 	// saves the contents of class elements into the parsedConfigurationFile
 	void SerializeConfiguration();
 
+	// makes sure that a depth codec name is valid
+	static void ValidateDepthCodec(const char* section, std::string& codecName);
+
 public:
 
 	Configuration() : streamerPort(0), controlPort(0),
@@ -101,11 +163,16 @@ public:
 	streamingColorFormat("jpg"), streamingDepthFormat("raw16"),
 	//streamingColorWidth(0), streamingColorHeight(0),
 	//streamingDepthWidth(0), streamingDepthHeight(0),
-	isStreamingColor(false), isStreamingDepth(false),
+	isStreamingColor(false), isStreamingDepth(false), streamingEncoderThreads(0), streamingIOThreads(1),
+	streamingSendLowWaterMark(16384), streamingSendBufferSize(0), streamingAdaptiveQuality(false), streamingKeepLatestFrame(false),
+	streamingJpegQuality(95), streamingJpegSubsampling("420"), streamingJpegFastDCT(false),
+	streamingDepthCodec("raw"), recordingDepthCodec("raw"),
+	sharedMemoryEnabled(false), sharedMemoryName("CameraStreamer"), sharedMemorySlots(4),
+	multicastEnabled(false), multicastGroup("239.255.0.1"), multicastPort(5004), multicastTTL(1), multicastMTU(1400), multicastLoopback(true),
 	requestDepthCamera(true), requestColorCamera(true),
 	cameraDepthWidth(0), cameraDepthHeight(0),
 	cameraColorWidth(0), cameraColorHeight(0), cameraColorFPS(30), cameraDepthFPS(30), requestFirstCameraAvailable(true),
-	cameraFrameCaptureTimeout(1000) {};
+	cameraFrameCaptureTimeout(1000), framePoolPrewarm(4), framePoolCapacity(8) {};
 
 	//
 	// streaming ports
@@ -181,6 +248,44 @@ public:
 	void SetStreamingTLVJPGProtocol(bool value) { streamingJpegLengthValueProtocol = value; }
 	bool IsStreamingTLVJPGProtocol() const { return streamingJpegLengthValueProtocol;  }
 
+	void SetStreamingEncoderThreads(int value) { streamingEncoderThreads = value; }
+	int GetStreamingEncoderThreads() const { return streamingEncoderThreads; }
+
+	int GetStreamingIOThreads() const { return streamingIOThreads; }
+	const std::string& GetStreamingLocalSocketPath() const { return streamingLocalSocketPath; }
+	int GetStreamingSendLowWaterMark() const { return streamingSendLowWaterMark; }
+	int GetStreamingSendBufferSize() const { return streamingSendBufferSize; }
+	bool IsStreamingAdaptiveQuality() const { return streamingAdaptiveQuality; }
+	bool IsStreamingKeepLatestFrame() const { return streamingKeepLatestFrame; }
+
+	int GetStreamingJpegQuality() const { return streamingJpegQuality; }
+	const std::string& GetStreamingJpegSubsampling() const { return streamingJpegSubsampling; }
+	bool IsStreamingJpegFastDCT() const { return streamingJpegFastDCT; }
+
+	const std::string& GetStreamingDepthCodec() const { return streamingDepthCodec; }
+	const std::string& GetRecordingDepthCodec() const { return recordingDepthCodec; }
+
+	bool IsSharedMemoryEnabled() const { return sharedMemoryEnabled; }
+	const std::string& GetSharedMemoryName() const { return sharedMemoryName; }
+	int GetSharedMemorySlots() const { return sharedMemorySlots; }
+
+	bool IsMulticastEnabled() const { return multicastEnabled; }
+	const std::string& GetMulticastGroup() const { return multicastGroup; }
+	int GetMulticastPort() const { return multicastPort; }
+	int GetMulticastTTL() const { return multicastTTL; }
+	int GetMulticastMTU() const { return multicastMTU; }
+	bool IsMulticastLoopback() const { return multicastLoopback; }
+	const std::string& GetMulticastInterface() const { return multicastInterface; }
+
+
+
+	//
+	// frame pool configuration
+	//
+
+	int GetFramePoolPrewarm() const { return framePoolPrewarm; }
+	int GetFramePoolCapacity() const { return framePoolCapacity; }
+	const std::vector<FramePoolGeometry>& GetFramePoolGeometries() const { return framePoolGeometries; }
 
 
 	//
@@ -0,0 +1,421 @@
+#include "DepthCodec.h"
+#include "Logger.h"
+
+#include <cstring>
+#include <vector>
+
+#ifdef CS_ENABLE_DEPTH_CODEC_ZSTD
+#include <zstd.h>
+#endif
+
+#ifdef CS_ENABLE_DEPTH_CODEC_LZ4
+#include <lz4.h>
+#endif
+
+// name used in logs
+static const char* DepthCodecConstStr = "DepthCodec";
+
+// ============================================================================
+// RVL
+// ============================================================================
+
+// writes 3 bits of a value per nibble (the 4th bit tells whether more nibbles follow)
+class RVLWriter
+{
+	uint32_t* output;
+	uint32_t* const begin;
+	uint32_t word;
+	int nibblesWritten;
+
+public:
+	RVLWriter(unsigned char* buffer) : output((uint32_t*)buffer), begin((uint32_t*)buffer), word(0), nibblesWritten(0) {}
+
+	inline void Encode(uint32_t value)
+	{
+		do
+		{
+			uint32_t nibble = value & 0x7;
+			if (value >>= 3) nibble |= 0x8;
+			word = (word << 4) | nibble;
+			if (++nibblesWritten == 8)
+			{
+				*output++ = word;
+				nibblesWritten = 0;
+				word = 0;
+			}
+		} while (value);
+	}
+
+	// flushes the last word and returns the number of bytes written
+	size_t Finish()
+	{
+		if (nibblesWritten)
+			*output++ = word << (4 * (8 - nibblesWritten));
+		return (output - begin) * sizeof(uint32_t);
+	}
+};
+
+class RVLReader
+{
+	const uint32_t* input;
+	const uint32_t* const end;
+	uint32_t word;
+	int nibblesLeft;
+
+public:
+	bool corrupted;
+
+	RVLReader(const unsigned char* buffer, size_t length) : input((const uint32_t*)buffer),
+		end((const uint32_t*)buffer + length / sizeof(uint32_t)), word(0), nibblesLeft(0), corrupted(false) {}
+
+	inline uint32_t Decode()
+	{
+		uint32_t nibble, value = 0;
+		int bits = 29;
+		do
+		{
+			// values are never longer than 10 nibbles
+			if (bits < 2)
+			{
+				corrupted = true;
+				return 0;
+			}
+
+			if (!nibblesLeft)
+			{
+				if (input == end)
+				{
+					corrupted = true;
+					return 0;
+				}
+				memcpy(&word, input++, sizeof(uint32_t)); // network buffers might not be aligned
+				nibblesLeft = 8;
+			}
+			nibble = word & 0xf0000000;
+			value |= (nibble << 1) >> bits;
+			word <<= 4;
+			--nibblesLeft;
+			bits -= 3;
+		} while (nibble & 0x80000000);
+		return value;
+	}
+};
+
+static size_t CompressRVL(const uint16_t* pixels, size_t count, unsigned char* output)
+{
+	RVLWriter writer(output);
+	const uint16_t* end = pixels + count;
+	int previous = 0;
+
+	while (pixels != end)
+	{
+		uint32_t zeros = 0, nonzeros = 0;
+		for (; pixels != end && !*pixels; ++pixels, ++zeros);
+		writer.Encode(zeros);
+
+		for (const uint16_t* p = pixels; p != end && *p; ++p, ++nonzeros);
+		writer.Encode(nonzeros);
+
+		for (uint32_t i = 0; i < nonzeros; ++i)
+		{
+			const int current = *pixels++;
+			const int delta = current - previous;
+			writer.Encode(((uint32_t)delta << 1) ^ (uint32_t)(delta >> 31));
+			previous = current;
+		}
+	}
+
+	return writer.Finish();
+}
+
+static bool DecompressRVL(const unsigned char* input, size_t length, uint16_t* pixels, size_t count)
+{
+	RVLReader reader(input, length);
+	uint16_t* end = pixels + count;
+	int previous = 0;
+
+	while (pixels != end)
+	{
+		const uint32_t zeros = reader.Decode();
+		if (reader.corrupted || zeros > (size_t)(end - pixels)) return false;
+		memset(pixels, 0, zeros * sizeof(uint16_t));
+		pixels += zeros;
+
+		if (pixels == end) break;
+
+		const uint32_t nonzeros = reader.Decode();
+		if (reader.corrupted || nonzeros > (size_t)(end - pixels)) return false;
+
+		for (uint32_t i = 0; i < nonzeros; ++i)
+		{
+			const uint32_t positive = reader.Decode();
+			const int delta = (int)(positive >> 1) ^ -(int)(positive & 1);
+			previous += delta;
+			*pixels++ = (uint16_t)previous;
+		}
+
+		if (reader.corrupted) return false;
+	}
+
+	return true;
+}
+
+// ============================================================================
+// Delta prediction (used before general purpose compressors)
+// ============================================================================
+
+#if defined(CS_ENABLE_DEPTH_CODEC_ZSTD) || defined(CS_ENABLE_DEPTH_CODEC_LZ4)
+
+// residuals are zigzag mapped and split into a low byte plane followed by a high byte plane:
+// most residuals are small, so the high plane ends up being mostly zeros
+static void DeltaEncodeRows(const uint16_t* pixels, unsigned long width, unsigned long height, unsigned char* planes)
+{
+	const size_t count = (size_t)width * height;
+	unsigned char* low = planes;
+	unsigned char* high = planes + count;
+
+	for (unsigned long y = 0; y < height; ++y)
+	{
+		const uint16_t* row = pixels + (size_t)y * width;
+		uint16_t predicted = (y > 0) ? row[-(long)width] : 0;
+
+		for (unsigned long x = 0; x < width; ++x)
+		{
+			const int16_t delta = (int16_t)(row[x] - predicted);
+			const uint16_t zigzag = (uint16_t)(((uint16_t)delta << 1) ^ (uint16_t)(delta >> 15));
+			*low++ = (unsigned char)(zigzag & 0xff);
+			*high++ = (unsigned char)(zigzag >> 8);
+			predicted = row[x];
+		}
+	}
+}
+
+static void DeltaDecodeRows(const unsigned char* planes, unsigned long width, unsigned long height, uint16_t* pixels)
+{
+	const size_t count = (size_t)width * height;
+	const unsigned char* low = planes;
+	const unsigned char* high = planes + count;
+
+	for (unsigned long y = 0; y < height; ++y)
+	{
+		uint16_t* row = pixels + (size_t)y * width;
+		uint16_t predicted = (y > 0) ? row[-(long)width] : 0;
+
+		for (unsigned long x = 0; x < width; ++x)
+		{
+			const uint16_t zigzag = (uint16_t)(*low++ | (*high++ << 8));
+			const int16_t delta = (int16_t)((zigzag >> 1) ^ -(int16_t)(zigzag & 1));
+			row[x] = (uint16_t)(predicted + delta);
+			predicted = row[x];
+		}
+	}
+}
+
+#endif
+
+// per thread scratch memory and compression contexts
+struct ThreadDepthCodecState
+{
+	std::vector<unsigned char> planes;
+
+#ifdef CS_ENABLE_DEPTH_CODEC_ZSTD
+	ZSTD_CCtx* zstdCompression;
+	ZSTD_DCtx* zstdDecompression;
+
+	ThreadDepthCodecState() : zstdCompression(ZSTD_createCCtx()), zstdDecompression(ZSTD_createDCtx()) {}
+	~ThreadDepthCodecState()
+	{
+		ZSTD_freeCCtx(zstdCompression);
+		ZSTD_freeDCtx(zstdDecompression);
+	}
+#endif
+};
+
+static thread_local ThreadDepthCodecState threadDepthCodecState;
+
+// ============================================================================
+// DepthCodec
+// ============================================================================
+
+bool DepthCodec::TypeFromString(const std::string& name, Type& type)
+{
+	if (name == "raw") type = Type::Raw;
+	else if (name == "rvl") type = Type::RVL;
+	else if (name == "zstd") type = Type::ZstdDelta;
+	else if (name == "lz4") type = Type::LZ4Delta;
+	else return false;
+
+	return true;
+}
+
+const char* DepthCodec::TypeToString(Type type)
+{
+	switch (type)
+	{
+	case Type::RVL: return "rvl";
+	case Type::ZstdDelta: return "zstd";
+	case Type::LZ4Delta: return "lz4";
+	default: return "raw";
+	}
+}
+
+bool DepthCodec::IsAvailable(Type type)
+{
+	switch (type)
+	{
+	case Type::Raw:
+	case Type::RVL:
+		return true;
+#ifdef CS_ENABLE_DEPTH_CODEC_ZSTD
+	case Type::ZstdDelta:
+		return true;
+#endif
+#ifdef CS_ENABLE_DEPTH_CODEC_LZ4
+	case Type::LZ4Delta:
+		return true;
+#endif
+	default:
+		return false;
+	}
+}
+
+size_t DepthCodec::MaxCompressedSize(Type type, size_t pixels)
+{
+	switch (type)
+	{
+	case Type::RVL:
+		// worst case: every other pixel is zero (two run lengths and a 17 bit delta -> 8 nibbles per pixel)
+		return pixels * sizeof(uint32_t) + 2 * sizeof(uint32_t);
+#ifdef CS_ENABLE_DEPTH_CODEC_ZSTD
+	case Type::ZstdDelta:
+		return ZSTD_compressBound(pixels * sizeof(uint16_t));
+#endif
+#ifdef CS_ENABLE_DEPTH_CODEC_LZ4
+	case Type::LZ4Delta:
+		return (size_t)LZ4_compressBound((int)(pixels * sizeof(uint16_t)));
+#endif
+	default:
+		return pixels * sizeof(uint16_t);
+	}
+}
+
+size_t DepthCodec::CompressPixels(Type type, const uint16_t* pixels, unsigned long width, unsigned long height, unsigned char* output, size_t outputCapacity)
+{
+	const size_t count = (size_t)width * height;
+	if (outputCapacity < MaxCompressedSize(type, count))
+		return 0;
+
+	switch (type)
+	{
+	case Type::Raw:
+		memcpy(output, pixels, count * sizeof(uint16_t));
+		return count * sizeof(uint16_t);
+
+	case Type::RVL:
+		return CompressRVL(pixels, count, output);
+
+#ifdef CS_ENABLE_DEPTH_CODEC_ZSTD
+	case Type::ZstdDelta:
+	{
+		std::vector<unsigned char>& planes = threadDepthCodecState.planes;
+		planes.resize(count * sizeof(uint16_t));
+		DeltaEncodeRows(pixels, width, height, planes.data());
+
+		const size_t compressed = ZSTD_compressCCtx(threadDepthCodecState.zstdCompression, output, outputCapacity, planes.data(), planes.size(), 1);
+		return ZSTD_isError(compressed) ? 0 : compressed;
+	}
+#endif
+
+#ifdef CS_ENABLE_DEPTH_CODEC_LZ4
+	case Type::LZ4Delta:
+	{
+		std::vector<unsigned char>& planes = threadDepthCodecState.planes;
+		planes.resize(count * sizeof(uint16_t));
+		DeltaEncodeRows(pixels, width, height, planes.data());
+
+		const int compressed = LZ4_compress_default((const char*)planes.data(), (char*)output, (int)planes.size(), (int)outputCapacity);
+		return (compressed > 0) ? (size_t)compressed : 0;
+	}
+#endif
+
+	default:
+		return 0;
+	}
+}
+
+bool DepthCodec::DecompressPixels(Type type, const unsigned char* input, size_t inputLength, uint16_t* pixels, unsigned long width, unsigned long height)
+{
+	const size_t count = (size_t)width * height;
+
+	switch (type)
+	{
+	case Type::Raw:
+		if (inputLength != count * sizeof(uint16_t)) return false;
+		memcpy(pixels, input, inputLength);
+		return true;
+
+	case Type::RVL:
+		return DecompressRVL(input, inputLength, pixels, count);
+
+#ifdef CS_ENABLE_DEPTH_CODEC_ZSTD
+	case Type::ZstdDelta:
+	{
+		std::vector<unsigned char>& planes = threadDepthCodecState.planes;
+		planes.resize(count * sizeof(uint16_t));
+
+		const size_t decompressed = ZSTD_decompressDCtx(threadDepthCodecState.zstdDecompression, planes.data(), planes.size(), input, inputLength);
+		if (ZSTD_isError(decompressed) || decompressed != planes.size()) return false;
+
+		DeltaDecodeRows(planes.data(), width, height, pixels);
+		return true;
+	}
+#endif
+
+#ifdef CS_ENABLE_DEPTH_CODEC_LZ4
+	case Type::LZ4Delta:
+	{
+		std::vector<unsigned char>& planes = threadDepthCodecState.planes;
+		planes.resize(count * sizeof(uint16_t));
+
+		const int decompressed = LZ4_decompress_safe((const char*)input, (char*)planes.data(), (int)inputLength, (int)planes.size());
+		if (decompressed != (int)planes.size()) return false;
+
+		DeltaDecodeRows(planes.data(), width, height, pixels);
+		return true;
+	}
+#endif
+
+	default:
+		return false;
+	}
+}
+
+std::shared_ptr<EncodedBuffer> DepthCodec::Compress(const Frame& depth)
+{
+	if (type == Type::Raw || depth.getEncoding() != FrameType::Encoding::Mono16 || !depth.isPacked())
+		return nullptr;
+
+	const size_t bufferSize = MaxCompressedSize(type, (size_t)depth.getWidth() * depth.getHeight());
+
+	std::shared_ptr<FrameBufferPool> pool;
+	{
+		const std::lock_guard<std::mutex> lock(outputPoolMutex);
+
+		// geometry changed? buffers from the old pool are freed as they come back
+		if (!outputPool || outputPool->GetBufferSize() != bufferSize)
+			outputPool = std::make_shared<FrameBufferPool>(0, 0, FrameType::Encoding::Custom, bufferSize, OutputPoolCapacity);
+
+		pool = outputPool;
+	}
+
+	std::shared_ptr<EncodedBuffer> output = std::make_shared<EncodedBuffer>(pool);
+	const size_t compressed = CompressPixels(type, (const uint16_t*)depth.getData(), depth.getWidth(), depth.getHeight(), output->data(), output->getCapacity());
+	if (!compressed)
+	{
+		Logger::Log(DepthCodecConstStr) << "Could not compress " << depth.getWidth() << 'x' << depth.getHeight() << " depth frame with " << TypeToString(type) << std::endl;
+		return nullptr;
+	}
+
+	output->resize(compressed);
+	return output;
+}
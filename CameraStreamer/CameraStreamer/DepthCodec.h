@@ -0,0 +1,77 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+
+#include "CompilerConfiguration.h"
+#include "Frame.h"
+#include "EncodedBuffer.h"
+
+/**
+  DepthCodec losslessly compresses Mono16 depth frames.
+
+  - Raw: no compression (what clients expect by default)
+  - RVL: run length of zeros + variable length deltas (Wilson, "Fast Lossless Depth Image Compression", 2017).
+         Designed for depth: very cheap to encode and decode, typically 3-4x smaller
+  - ZstdDelta / LZ4Delta: rows are delta predicted (left neighbor; first pixel from the pixel above),
+         zigzag mapped, split into low/high byte planes and then compressed with zstd (level 1) or LZ4
+
+  When streamed, the codec is flagged in the four most significant bits of the depth length
+  field of the packet header (see PackLength). Raw is 0, so the header is unchanged for
+  clients that did not ask for compression.
+*/
+class DepthCodec
+{
+public:
+	enum class Type : unsigned char
+	{
+		Raw = 0,
+		RVL = 1,
+		ZstdDelta = 2,
+		LZ4Delta = 3
+	};
+
+	// the depth length field keeps the codec in its top 4 bits
+	static const unsigned int CodecShift = 28;
+	static const uint32_t LengthMask = (1u << CodecShift) - 1;
+
+	static uint32_t PackLength(Type type, uint32_t length) { return ((uint32_t)type << CodecShift) | (length & LengthMask); }
+	static Type UnpackType(uint32_t packedLength) { return (Type)(packedLength >> CodecShift); }
+	static uint32_t UnpackLength(uint32_t packedLength) { return packedLength & LengthMask; }
+
+	// parses the names used in configuration files ("raw", "rvl", "zstd", "lz4")
+	static bool TypeFromString(const std::string& name, Type& type);
+	static const char* TypeToString(Type type);
+
+	// false if the library backing a codec was not compiled in (see CompilerConfiguration.h)
+	static bool IsAvailable(Type type);
+
+	// worst case number of bytes needed to compress a given number of pixels
+	static size_t MaxCompressedSize(Type type, size_t pixels);
+
+	// compresses pixels into output (which must hold at least MaxCompressedSize bytes). returns the compressed size (0 on errors)
+	static size_t CompressPixels(Type type, const uint16_t* pixels, unsigned long width, unsigned long height, unsigned char* output, size_t outputCapacity);
+
+	// decompresses exactly width * height pixels. returns false if the input is corrupted
+	static bool DecompressPixels(Type type, const unsigned char* input, size_t inputLength, uint16_t* pixels, unsigned long width, unsigned long height);
+
+private:
+	Type type;
+
+	// buffers sized for the last geometry compressed
+	std::shared_ptr<FrameBufferPool> outputPool;
+	std::mutex outputPoolMutex;
+
+public:
+	// number of output buffers kept around
+	static constexpr size_t OutputPoolCapacity = 8;
+
+	DepthCodec(Type type = Type::Raw) : type(type) {}
+
+	Type GetType() const { return type; }
+
+	// compresses a Mono16 frame into a pooled buffer (nullptr for raw or on errors)
+	std::shared_ptr<EncodedBuffer> Compress(const Frame& depth);
+};
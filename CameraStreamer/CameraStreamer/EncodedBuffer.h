@@ -0,0 +1,41 @@
+#pragma once
+
+#include <memory>
+#include <boost/noncopyable.hpp>
+
+#include "FramePool.h"
+
+/**
+  EncodedBuffer holds the output of an encoder (e.g.: a JPEG image).
+
+  Encoders know the worst case size of their output ahead of time, so buffers
+  have a fixed capacity and are recycled through a FrameBufferPool. Only the
+  first size() bytes are valid.
+*/
+class EncodedBuffer : boost::noncopyable
+{
+	// the pool is shared so that it outlives every buffer it handed out
+	std::shared_ptr<FrameBufferPool> pool;
+	unsigned char* buffer;
+	size_t capacity;
+	size_t length;
+
+public:
+	EncodedBuffer(std::shared_ptr<FrameBufferPool> pool) : pool(pool),
+		buffer(pool->Acquire()), capacity(pool->GetBufferSize()), length(0)
+	{
+	}
+
+	~EncodedBuffer()
+	{
+		pool->Release(buffer);
+		buffer = nullptr;
+	}
+
+	unsigned char* data() const { return buffer; }
+	size_t size() const { return length; }
+	size_t getCapacity() const { return capacity; }
+
+	// how many bytes were written by the encoder
+	void resize(size_t newLength) { length = (newLength < capacity) ? newLength : capacity; }
+};
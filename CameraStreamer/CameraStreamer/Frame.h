@@ -1,178 +1,52 @@
 #pragma once
 
+#include <chrono>
 #include <cstdint>
+#include <cstring>
 #include <memory>
 #include <boost/noncopyable.hpp>
-#include <boost/pool/singleton_pool.hpp>
-
-struct FrameType
-{
-	enum class Encoding : unsigned char
-	{
-		Mono8,
-		Mono16,
-		ABGR32,
-		ARGB32,
-		RGB24,
-		RGBA32,
-		BGRA32,
-		BGR24,
-		//YUY2, // class needs to be refactored to support YUV2 (see getPixelLen and getStride)
-		//I420,
-		Custom
-
-	};
-
-	static unsigned int getPixelLen(Encoding e)
-	{
-		switch (e) {
-		case Encoding::Mono8:
-			return sizeof(unsigned char);
-			break;
-		case Encoding::Mono16:
-			return sizeof(uint16_t);
-			break;
-		case Encoding::RGB24:
-		case Encoding::BGR24:
-			return 3;
-			break;
-		case Encoding::ABGR32:
-		case Encoding::ARGB32:
-		case Encoding::RGBA32:
-		case Encoding::BGRA32:
-			return 4;
-			break;
-
-		default:
-			return 0;
-			break;
-		}
-	}
-
-
-};
-
-
-#define MemoryPoolDefinition(name, width, height, eltype, elcount) \
-struct Resolution##name##_FrameDim { constexpr static unsigned int Size() { return (width*height*sizeof(eltype)*elcount);}}; \
-typedef boost::singleton_pool<Resolution##name##_FrameDim, Resolution##name##_FrameDim::Size()> MemoryPool##name;
-
-#define MemoryPoolAlloc(name) MemoryPool##name##::malloc()
-#define MemoryPoolFree(name, pointer) MemoryPool##name##::free(pointer)
-
-#define CaseAllocMem(name, data) case Resolution##name##_FrameDim::Size(): data = (unsigned char *) MemoryPoolAlloc(name); break;
-#define CaseFreeMem(name, data) case Resolution##name##_FrameDim::Size(): MemoryPoolFree(name, data); break;
-
-
-// k4a specific definitions
-MemoryPoolDefinition(K4ADepth, 640, 576, uint16_t, 1);
-MemoryPoolDefinition(K4ADepthWithColor, 640, 576, uint8_t, 4);
-
-MemoryPoolDefinition(K4APassiveInfrared, 1024, 1024, uint16_t, 1);
-MemoryPoolDefinition(K4APassiveInfraredWithColor, 1024, 1024, uint8_t, 4);
-
-// rs2 specific definitions
-MemoryPoolDefinition(RS2_WVGADepth, 848, 480, uint16_t, 1);
-MemoryPoolDefinition(RS2_WVGADepthWithColor, 848, 480, uint8_t, 3);
-
-// ultrasound specific resolutions
-MemoryPoolDefinition(VGABW, 640, 480, uint8_t, 1);
-MemoryPoolDefinition(SVGABW, 800, 600, uint8_t, 1);
-
-// generic resolutions
-MemoryPoolDefinition(VGA, 640, 480, uint8_t, 3);
-MemoryPoolDefinition(VGADepth, 640, 480, uint16_t, 1)
-
-MemoryPoolDefinition(SVGA, 800, 600, uint8_t, 3);
-MemoryPoolDefinition(SVGADepth, 800, 600, uint16_t, 1)
-
-MemoryPoolDefinition(720P, 1280, 720, uint8_t, 3);
-MemoryPoolDefinition(720PRGBA, 1280, 720, uint8_t, 4);
-MemoryPoolDefinition(720PDepth, 1280, 720, uint16_t, 1);
-
-MemoryPoolDefinition(1080P, 1920, 1080, uint8_t, 3);
-MemoryPoolDefinition(1080PRGBA, 1920, 1080, uint8_t, 4);
-MemoryPoolDefinition(1080PDepth, 1920, 1080, uint16_t, 1);
-
-MemoryPoolDefinition(1440P, 2560, 1440, uint8_t, 3);
-MemoryPoolDefinition(1440PRGBA, 2560, 1440, uint8_t, 4);
-MemoryPoolDefinition(1440PDepth, 2560, 1440, uint16_t, 1);
-
-MemoryPoolDefinition(1536P, 2048, 1536, uint8_t, 3);
-MemoryPoolDefinition(1536PRGBA, 2048, 1536, uint8_t, 4);
-MemoryPoolDefinition(1536PDepth, 2048, 1536, uint16_t, 1);
-
-MemoryPoolDefinition(2160P, 3840, 2160, uint8_t, 3);
-MemoryPoolDefinition(2160PRGBA, 3840, 2160, uint8_t, 4);
-MemoryPoolDefinition(2160PDepth, 3840, 2160, uint16_t, 1);
-
-MemoryPoolDefinition(3072P, 4096, 3072, uint8_t, 3);
-MemoryPoolDefinition(3072PRGBA, 4096, 3072, uint8_t, 4);
-MemoryPoolDefinition(3072PDepth, 4096, 3072, uint16_t, 1);
 
+#include "FrameType.h"
+#include "FramePool.h"
 
 class Frame : boost::noncopyable
 {
-protected:
-	Frame(unsigned long width, unsigned long height, FrameType::Encoding encoding) :
-		customDataAlloc(false), width(width), height(height), customSize(0), usingCustomSize(false), encoding(encoding)
+	// Frames are always created through Frame::Create. The key keeps the constructors
+	// out of reach while still letting std::make_shared allocate the frame and
+	// its control block at once
+	class CreateKey
 	{
-		switch (size())
-		{
-			// k4a specific
-			CaseAllocMem(K4ADepth, data);
-			CaseAllocMem(K4ADepthWithColor, data);
-			CaseAllocMem(K4APassiveInfrared, data);
-			CaseAllocMem(K4APassiveInfraredWithColor, data);
-
-			// real-sense 2 specific
-			CaseAllocMem(RS2_WVGADepth, data);
-			CaseAllocMem(RS2_WVGADepthWithColor, data);
-
-			// application specific
-			CaseAllocMem(VGABW, data);
-			CaseAllocMem(SVGABW, data);
-
-			// generic resolutions
-			CaseAllocMem(VGA, data);
-			CaseAllocMem(VGADepth, data);
-			CaseAllocMem(SVGA, data);
-			CaseAllocMem(SVGADepth, data);
-			CaseAllocMem(720P, data);
-			CaseAllocMem(720PRGBA, data);
-			CaseAllocMem(720PDepth, data);
-			CaseAllocMem(1080P, data);
-			CaseAllocMem(1080PRGBA, data);
-			CaseAllocMem(1080PDepth, data);
-			CaseAllocMem(1440P, data);
-			CaseAllocMem(1440PRGBA, data);
-			CaseAllocMem(1440PDepth, data);
-			CaseAllocMem(1536P, data);
-			CaseAllocMem(1536PRGBA, data);
-			CaseAllocMem(1536PDepth, data);
-			CaseAllocMem(2160P, data);
-			CaseAllocMem(2160PRGBA, data);
-			CaseAllocMem(2160PDepth, data);
-			CaseAllocMem(3072P, data);
-			CaseAllocMem(3072PRGBA, data);
-			CaseAllocMem(3072PDepth, data);
+		CreateKey() {}
+		friend class Frame;
+	};
 
-		default:
-			data = new unsigned char[size()];
-		}
+public:
+	Frame(const CreateKey&, unsigned long width, unsigned long height, FrameType::Encoding encoding) :
+		customDataAlloc(false), width(width), height(height), customSize(0), usingCustomSize(false), encoding(encoding),
+		stride(width * FrameType::getPixelLen(encoding)), pool(FramePool::Instance().Find(width, height, encoding)), captureTime(std::chrono::steady_clock::now())
+	{
+		// pooled geometries recycle buffers from a lock-free free-list
+		data = pool ? pool->Acquire() : FramePool::Instance().AllocateUnpooled(size());
 	}
 
-	Frame(unsigned long width, unsigned long height, unsigned long customSize) :
+	Frame(const CreateKey&, unsigned long width, unsigned long height, unsigned long customSize, FrameType::Encoding encoding = FrameType::Encoding::Custom) :
 		customDataAlloc(false), width(width), height(height), customSize(customSize), usingCustomSize(true),
-		encoding(FrameType::Encoding::Custom)
+		encoding(encoding), stride(0), pool(nullptr), captureTime(std::chrono::steady_clock::now())
 	{
-		data = new unsigned char[size()];
+		data = FramePool::Instance().AllocateUnpooled(size());
 	}
 
-
-	Frame(unsigned long width, unsigned long height, FrameType::Encoding encoding, void* data) :
+protected:
+	// stride is the number of bytes between the beginning of two lines of the first plane (0 if tightly packed).
+	// all planes are expected to be stored one after the other
+	Frame(unsigned long width, unsigned long height, FrameType::Encoding encoding, void* data, unsigned long stride = 0) :
 		customDataAlloc(true), width(width), height(height), customSize(0), usingCustomSize(false),
-		encoding(encoding), data((unsigned char*)data)
+		encoding(encoding), stride(stride ? stride : width * FrameType::getPixelLen(encoding)), pool(nullptr), captureTime(std::chrono::steady_clock::now()), data((unsigned char*)data)
+	{ }
+
+	Frame(unsigned long width, unsigned long height, unsigned long customSize, void* data, FrameType::Encoding encoding = FrameType::Encoding::Custom) :
+		customDataAlloc(true), width(width), height(height), customSize(customSize), usingCustomSize(true),
+		encoding(encoding), stride(0), pool(nullptr), captureTime(std::chrono::steady_clock::now()), data((unsigned char*)data)
 	{ }
 
 
@@ -181,84 +55,138 @@ public:
 	// creates a frame with a specific encoding and pre-allocates its memory
 	static std::shared_ptr<Frame> Create(unsigned long width, unsigned long height, FrameType::Encoding encoding)
 	{
-		std::shared_ptr<Frame> f(new Frame(width, height, encoding));
-		return f;
+		return std::make_shared<Frame>(CreateKey(), width, height, encoding);
 	}
 
-	// creates a frame with custom encoding
-	static std::shared_ptr<Frame> Create(unsigned long width, unsigned long height, unsigned long size)
+	// creates a frame with custom encoding (or any other compressed encoding, such as MJPEG)
+	static std::shared_ptr<Frame> Create(unsigned long width, unsigned long height, unsigned long size, FrameType::Encoding encoding = FrameType::Encoding::Custom)
 	{
-		std::shared_ptr<Frame> f(new Frame(width, height, size));
-		return f;
+		return std::make_shared<Frame>(CreateKey(), width, height, size, encoding);
 	}
 
+	// creates a frame that points to memory owned by someone else (e.g.: a k4a::image or a rs2::frame)
+	// without copying it. owner is kept alive until the last consumer drops the frame.
+	// SDKs serve frames from small pools, so wrapped frames should not be held for long: consumers
+	// only keep a bounded number of them (encoders: maxInFlight, shared memory: the latest one),
+	// and the ones that queue frames without a bound (VideoRecorder) Duplicate them first
+	template <class Owner>
+	static std::shared_ptr<Frame> Wrap(unsigned long width, unsigned long height, FrameType::Encoding encoding, void* data, Owner owner);
+
+	// same as above, but for images with padding at the end of each line (e.g.: webcams, NV12 frames from the Kinect)
+	template <class Owner>
+	static std::shared_ptr<Frame> Wrap(unsigned long width, unsigned long height, FrameType::Encoding encoding, void* data, unsigned long stride, Owner owner);
+
+	// same as above, but for frames with custom encoding (or any other compressed encoding, such as MJPEG)
+	template <class Owner>
+	static std::shared_ptr<Frame> Wrap(unsigned long width, unsigned long height, unsigned long size, void* data, Owner owner, FrameType::Encoding encoding = FrameType::Encoding::Custom);
+
 	// duplicates a frames
 	static std::shared_ptr<Frame> Duplicate(std::shared_ptr<Frame> src)
 	{
 		if (!src) return src;
+		if (src->isCompressed())
+		{
+			std::shared_ptr<Frame> copy = Frame::Create(src->getWidth(), src->getHeight(), src->size(), src->getEncoding());
+			memcpy(copy->data, src->data, src->size());
+			copy->captureTime = src->captureTime;
+			return copy;
+		}
+
+		// copies line by line so that the copy is tightly packed
 		std::shared_ptr<Frame> copy = Frame::Create(src->getWidth(), src->getHeight(), src->getEncoding());
-		memcpy(copy->data, src->data, src->size());
+		src->copyTo(*copy);
+		copy->captureTime = src->captureTime;
 		return copy;
 	}
 
 	virtual ~Frame()
 	{
 		if (customDataAlloc) return; // no dellocation required
-		//if (encoding == FrameType::Encoding::Custom) delete[] data; already cover by the default case below
-
-		switch (size())
-		{
-			// k4a specific
-			CaseFreeMem(K4ADepth, data);
-			CaseFreeMem(K4ADepthWithColor, data);
-			CaseFreeMem(K4APassiveInfrared, data);
-			CaseFreeMem(K4APassiveInfraredWithColor, data);
-
-			// real-sense 2 specific
-			CaseFreeMem(RS2_WVGADepth, data);
-			CaseFreeMem(RS2_WVGADepthWithColor, data);
-
-			// application specific
-			CaseFreeMem(VGABW, data);
-			CaseFreeMem(SVGABW, data);
-
-			// generic resolutions
-			CaseFreeMem(VGA, data);
-			CaseFreeMem(VGADepth, data);
-			CaseFreeMem(SVGA, data);
-			CaseFreeMem(SVGADepth, data);
-			CaseFreeMem(720P, data);
-			CaseFreeMem(720PRGBA, data);
-			CaseFreeMem(720PDepth, data);
-			CaseFreeMem(1080P, data);
-			CaseFreeMem(1080PRGBA, data);
-			CaseFreeMem(1080PDepth, data);
-			CaseFreeMem(1440P, data);
-			CaseFreeMem(1440PRGBA, data);
-			CaseFreeMem(1440PDepth, data);
-			CaseFreeMem(1536P, data);
-			CaseFreeMem(1536PRGBA, data);
-			CaseFreeMem(1536PDepth, data);
-			CaseFreeMem(2160P, data);
-			CaseFreeMem(2160PRGBA, data);
-			CaseFreeMem(2160PDepth, data);
-			CaseFreeMem(3072P, data);
-			CaseFreeMem(3072PRGBA, data);
-			CaseFreeMem(3072PDepth, data);
 
-		default:
+		// pooled buffers go back to their free-list
+		if (pool)
+			pool->Release(data);
+		else
 			delete[] data;
-		}
+
 		data = nullptr;
 	}
 
 	unsigned long getWidth() const { return width; }
 	unsigned long getHeight() const { return height; }
 	FrameType::Encoding getEncoding() const { return encoding; }
-	unsigned int  getPixelLen(int plane = 0) const { return FrameType::getPixelLen(encoding); }   // this is only valid when not using custom formats
-	unsigned long getLineSize(int plane = 0) const { return getPixelLen()* getWidth(); }           // this is only valid when not using custom formats
-	unsigned long size() const { return customSize ? customSize : width * height* getPixelLen(); }
+	unsigned int  getPlaneCount() const { return FrameType::getPlaneCount(encoding); }
+	unsigned int  getPixelLen(unsigned int plane = 0) const { return FrameType::getPixelLen(encoding, plane); }   // this is only valid when not using custom formats
+	unsigned long getPlaneWidth(unsigned int plane = 0) const { return FrameType::getPlaneWidth(encoding, width, plane); }
+	unsigned long getPlaneHeight(unsigned int plane = 0) const { return FrameType::getPlaneHeight(encoding, height, plane); }
+	bool isPacked() const { return usingCustomSize || stride == width * getPixelLen(); }
+	bool isCompressed() const { return FrameType::isCompressed(encoding); }
+	bool isWrapped() const { return customDataAlloc; }
+
+	// when the camera handed the pixels over (the time the frame was created). Frames made out of other frames
+	// (decoded, registered, ...) take the time of their source, so that latency is measured from the capture
+	std::chrono::steady_clock::time_point getCaptureTime() const { return captureTime; }
+	void setCaptureTime(std::chrono::steady_clock::time_point time) { captureTime = time; }
+
+	// bytes between the beginning of two lines of a plane (this is only valid when not using custom formats)
+	unsigned long getLineSize(unsigned int plane = 0) const
+	{
+		if (plane == 0) return stride;
+
+		switch (encoding)
+		{
+		case FrameType::Encoding::I420:
+			return (stride + 1) >> 1;
+		case FrameType::Encoding::NV12:
+			return (stride + 1) & ~1ul;
+		default:
+			return 0;
+		}
+	}
+
+	// first byte of a plane
+	unsigned char* getPlaneData(unsigned int plane = 0) const
+	{
+		unsigned char* planeData = data;
+		for (unsigned int i = 0; i < plane; ++i)
+			planeData += (size_t)getLineSize(i) * getPlaneHeight(i);
+		return planeData;
+	}
+
+	// number of bytes used by the frame (including padding)
+	unsigned long size() const
+	{
+		if (usingCustomSize) return customSize;
+
+		unsigned long total = 0;
+		for (unsigned int plane = 0; plane < getPlaneCount(); ++plane)
+			total += getLineSize(plane) * getPlaneHeight(plane);
+		return total;
+	}
+
 	unsigned char* const getData() const { return data; }
+
+	// copies the pixels of this frame into a frame with the same geometry (strides might differ)
+	void copyTo(Frame& dst) const
+	{
+		for (unsigned int plane = 0; plane < getPlaneCount(); ++plane)
+		{
+			const unsigned long lineLength = getPlaneWidth(plane) * getPixelLen(plane);
+			const unsigned char* srcLine = getPlaneData(plane);
+			unsigned char* dstLine = dst.getPlaneData(plane);
+
+			// same layout? single copy
+			if (getLineSize(plane) == lineLength && dst.getLineSize(plane) == lineLength)
+			{
+				memcpy(dstLine, srcLine, (size_t)lineLength * getPlaneHeight(plane));
+				continue;
+			}
+
+			for (unsigned long line = 0; line < getPlaneHeight(plane); ++line, srcLine += getLineSize(plane), dstLine += dst.getLineSize(plane))
+				memcpy(dstLine, srcLine, lineLength);
+		}
+	}
+
 private:
 	bool customDataAlloc;
 
@@ -268,7 +196,58 @@ protected:
 	bool usingCustomSize;
 	unsigned long customSize;
 	FrameType::Encoding encoding;
+
+	// bytes per line of the first plane
+	unsigned long stride;
+
+	// pool that owns data (nullptr when data was not pooled)
+	FrameBufferPool* pool;
+
+	std::chrono::steady_clock::time_point captureTime;
 public:
 	// the last part of the frame is a pointer to the data
 	unsigned char* data;
-};
\ No newline at end of file
+};
+
+
+/**
+  WrappedFrame keeps the object that owns the frame data (typically a reference counted
+  SDK handle) alive for as long as the frame is alive. Releasing the frame releases the
+  handle, which gives the buffer back to the SDK.
+*/
+template <class Owner>
+class WrappedFrame : public Frame
+{
+	Owner owner;
+
+public:
+	WrappedFrame(unsigned long width, unsigned long height, FrameType::Encoding encoding, void* data, Owner owner) :
+		Frame(width, height, encoding, data), owner(std::move(owner))
+	{ }
+
+	WrappedFrame(unsigned long width, unsigned long height, FrameType::Encoding encoding, void* data, unsigned long stride, Owner owner) :
+		Frame(width, height, encoding, data, stride), owner(std::move(owner))
+	{ }
+
+	WrappedFrame(unsigned long width, unsigned long height, unsigned long size, void* data, Owner owner, FrameType::Encoding encoding) :
+		Frame(width, height, size, data, encoding), owner(std::move(owner))
+	{ }
+};
+
+template <class Owner>
+std::shared_ptr<Frame> Frame::Wrap(unsigned long width, unsigned long height, FrameType::Encoding encoding, void* data, Owner owner)
+{
+	return std::make_shared<WrappedFrame<Owner> >(width, height, encoding, data, std::move(owner));
+}
+
+template <class Owner>
+std::shared_ptr<Frame> Frame::Wrap(unsigned long width, unsigned long height, FrameType::Encoding encoding, void* data, unsigned long stride, Owner owner)
+{
+	return std::make_shared<WrappedFrame<Owner> >(width, height, encoding, data, stride, std::move(owner));
+}
+
+template <class Owner>
+std::shared_ptr<Frame> Frame::Wrap(unsigned long width, unsigned long height, unsigned long size, void* data, Owner owner, FrameType::Encoding encoding)
+{
+	return std::make_shared<WrappedFrame<Owner> >(width, height, size, data, std::move(owner), encoding);
+}
@@ -0,0 +1,175 @@
+#pragma once
+
+#include "Frame.h"
+#include "JPEGDecoder.h"
+
+#include <algorithm>
+#include <cstring>
+#include <memory>
+
+#include <opencv2/opencv.hpp>
+
+/**
+  FrameConversion bridges Frames and OpenCV. Packed RGB frames are wrapped (no copies),
+  while YUV frames are converted to BGR for code paths that cannot consume them natively.
+  MJPEG frames are only decoded here, when someone asks for their pixels.
+
+  It also shrinks frames for clients that get a lower quality stream (see QualityTier).
+*/
+struct FrameConversion
+{
+	// returns a cv::Mat that can be handed to cv::imencode / cv::VideoWriter.
+	// the Mat might point to the frame memory, so the frame has to outlive it.
+	// returns false for custom and depth frames
+	static bool ToBGRMat(const Frame& frame, cv::Mat& out)
+	{
+		const int width = (int)frame.getWidth(), height = (int)frame.getHeight();
+
+		switch (frame.getEncoding())
+		{
+		case FrameType::Encoding::RGB24:
+		case FrameType::Encoding::BGR24:
+			out = cv::Mat(height, width, CV_8UC3, frame.getData(), frame.getLineSize());
+			return true;
+
+		case FrameType::Encoding::ABGR32:
+		case FrameType::Encoding::ARGB32:
+		case FrameType::Encoding::RGBA32:
+		case FrameType::Encoding::BGRA32:
+			out = cv::Mat(height, width, CV_8UC4, frame.getData(), frame.getLineSize());
+			return true;
+
+		case FrameType::Encoding::Mono8:
+			out = cv::Mat(height, width, CV_8UC1, frame.getData(), frame.getLineSize());
+			return true;
+
+		case FrameType::Encoding::YUY2:
+			cv::cvtColor(cv::Mat(height, width, CV_8UC2, frame.getData(), frame.getLineSize()), out, cv::COLOR_YUV2BGR_YUY2);
+			return true;
+
+		case FrameType::Encoding::MJPEG:
+		{
+			std::shared_ptr<Frame> decoded = JPEGDecoder::Decode(frame, FrameType::Encoding::BGR24);
+			if (!decoded)
+				return false;
+
+			// the Mat gets its own copy (nobody keeps the decoded frame)
+			cv::Mat((int)decoded->getHeight(), (int)decoded->getWidth(), CV_8UC3, decoded->getData(), decoded->getLineSize()).copyTo(out);
+			return true;
+		}
+
+		case FrameType::Encoding::I420:
+		case FrameType::Encoding::NV12:
+		{
+			// OpenCV expects 4:2:0 frames as a single channel image with 1.5x the height
+			if ((width & 1) || (height & 1))
+				return false;
+
+			// that only works if every plane is tightly packed: padded lines (e.g.: Kinect NV12 frames, relayed frames)
+			// would shear the chroma planes, so those are packed into a scratch buffer first
+			cv::Mat yuv;
+			if (frame.isPacked())
+			{
+				yuv = cv::Mat(height + (height >> 1), width, CV_8UC1, frame.getData(), frame.getLineSize());
+			}
+			else {
+				yuv.create(height + (height >> 1), width, CV_8UC1);
+				unsigned char* dst = yuv.data;
+				for (unsigned int plane = 0; plane < frame.getPlaneCount(); ++plane)
+				{
+					const size_t lineBytes = (size_t)frame.getPlaneWidth(plane) * frame.getPixelLen(plane);
+					const unsigned char* src = frame.getPlaneData(plane);
+					for (unsigned long y = 0; y < frame.getPlaneHeight(plane); ++y, dst += lineBytes, src += frame.getLineSize(plane))
+						memcpy(dst, src, lineBytes);
+				}
+			}
+
+			cv::cvtColor(yuv, out, (frame.getEncoding() == FrameType::Encoding::I420) ? cv::COLOR_YUV2BGR_I420 : cv::COLOR_YUV2BGR_NV12);
+			return true;
+		}
+
+		default:
+			return false;
+		}
+	}
+
+	// shrinks a color frame by an integer factor (area average). Packed frames and I420 frames keep their
+	// encoding, other YUV frames become BGR24. MJPEG frames are decoded (to BGR24) at the smaller size,
+	// and custom frames are returned as they are
+	static std::shared_ptr<Frame> Downscale(const std::shared_ptr<Frame>& frame, unsigned int factor)
+	{
+		if (factor <= 1 || !frame || frame->getEncoding() == FrameType::Encoding::Custom || frame->getEncoding() == FrameType::Encoding::Mono16)
+			return frame;
+
+		if (frame->getEncoding() == FrameType::Encoding::MJPEG)
+		{
+			std::shared_ptr<Frame> decoded = JPEGDecoder::Decode(*frame, FrameType::Encoding::BGR24, factor);
+			return decoded ? decoded : frame;
+		}
+
+		// 4:2:0 chroma planes need even dimensions
+		unsigned long width = std::max(frame->getWidth() / factor, 2ul) & ~1ul;
+		unsigned long height = std::max(frame->getHeight() / factor, 2ul) & ~1ul;
+
+		switch (frame->getEncoding())
+		{
+		case FrameType::Encoding::I420:
+		{
+			std::shared_ptr<Frame> scaled = Frame::Create(width, height, FrameType::Encoding::I420);
+			for (unsigned int plane = 0; plane < 3; ++plane)
+			{
+				cv::Mat src((int)frame->getPlaneHeight(plane), (int)frame->getPlaneWidth(plane), CV_8UC1, frame->getPlaneData(plane), frame->getLineSize(plane));
+				cv::Mat dst((int)scaled->getPlaneHeight(plane), (int)scaled->getPlaneWidth(plane), CV_8UC1, scaled->getPlaneData(plane), scaled->getLineSize(plane));
+				cv::resize(src, dst, dst.size(), 0, 0, cv::INTER_AREA);
+			}
+			return scaled;
+		}
+
+		case FrameType::Encoding::NV12:
+		case FrameType::Encoding::YUY2:
+		{
+			cv::Mat bgr;
+			if (!ToBGRMat(*frame, bgr))
+				return frame;
+
+			std::shared_ptr<Frame> scaled = Frame::Create(width, height, FrameType::Encoding::BGR24);
+			cv::Mat dst((int)height, (int)width, CV_8UC3, scaled->getData(), scaled->getLineSize());
+			cv::resize(bgr, dst, dst.size(), 0, 0, cv::INTER_AREA);
+			return scaled;
+		}
+
+		default:
+		{
+			// packed pixels
+			std::shared_ptr<Frame> scaled = Frame::Create(width, height, frame->getEncoding());
+			const int type = CV_8UC((int)frame->getPixelLen());
+			cv::Mat src((int)frame->getHeight(), (int)frame->getWidth(), type, frame->getData(), frame->getLineSize());
+			cv::Mat dst((int)height, (int)width, type, scaled->getData(), scaled->getLineSize());
+			cv::resize(src, dst, dst.size(), 0, 0, cv::INTER_AREA);
+			return scaled;
+		}
+		}
+	}
+
+	// keeps one out of every factor x factor depth samples. Samples are not averaged: averaging
+	// would make up depths that are not there (e.g.: halfway between an object and the wall behind it)
+	static std::shared_ptr<Frame> Decimate(const std::shared_ptr<Frame>& depth, unsigned int factor)
+	{
+		if (factor <= 1 || !depth || depth->getEncoding() != FrameType::Encoding::Mono16)
+			return depth;
+
+		const unsigned long width = std::max(depth->getWidth() / factor, 1ul);
+		const unsigned long height = std::max(depth->getHeight() / factor, 1ul);
+		std::shared_ptr<Frame> decimated = Frame::Create(width, height, FrameType::Encoding::Mono16);
+
+		for (unsigned long y = 0; y < height; ++y)
+		{
+			const uint16_t* src = (const uint16_t*)(depth->getData() + (size_t)y * factor * depth->getLineSize());
+			uint16_t* dst = (uint16_t*)(decimated->getData() + (size_t)y * decimated->getLineSize());
+			for (unsigned long x = 0; x < width; ++x)
+				dst[x] = src[x * factor];
+		}
+
+		return decimated;
+	}
+};
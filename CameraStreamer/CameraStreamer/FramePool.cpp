@@ -0,0 +1,97 @@
+#include "FramePool.h"
+#include "Logger.h"
+
+// name used in logs
+static const char* FramePoolConstStr = "FramePool";
+
+FramePool::FramePool() : poolCount(0), unpooledAllocations(0)
+{
+	for (std::atomic<FrameBufferPool*>& pool : pools)
+		pool.store(nullptr, std::memory_order_relaxed);
+}
+
+FramePool::~FramePool()
+{
+	const size_t count = poolCount.load(std::memory_order_acquire);
+	for (size_t i = 0; i < count; ++i)
+	{
+		delete pools[i].exchange(nullptr, std::memory_order_acq_rel);
+	}
+}
+
+FrameBufferPool* FramePool::Register(unsigned long width, unsigned long height, FrameType::Encoding encoding, size_t prewarm, size_t capacity)
+{
+	// custom frames have a variable size, so they cannot be pooled
+	const size_t bufferSize = FrameType::getFrameSize(encoding, width, height);
+	if (bufferSize == 0)
+		return nullptr;
+
+	std::lock_guard<std::mutex> guard(registrationMutex);
+
+	// was this geometry registered before? (retired pools are revived)
+	FrameBufferPool* pool = FindAny(width, height, encoding);
+	if (!pool)
+	{
+		const size_t count = poolCount.load(std::memory_order_relaxed);
+		if (count >= MaxPools)
+		{
+			Logger::Log(FramePoolConstStr) << "Cannot pool " << width << 'x' << height << " frames! Maximum number of pools reached (" << MaxPools << ")" << std::endl;
+			return nullptr;
+		}
+
+		// publishes the pool before increasing the count so that readers never see an empty slot
+		pool = new FrameBufferPool(width, height, encoding, bufferSize, (capacity > prewarm) ? capacity : prewarm);
+		pools[count].store(pool, std::memory_order_release);
+		poolCount.store(count + 1, std::memory_order_release);
+	}
+
+	// first registration (or revival)? let everyone know this geometry is pooled
+	if (pool->registrations++ == 0)
+	{
+		pool->active.store(true, std::memory_order_release);
+		Logger::Log(FramePoolConstStr) << "Pooling " << width << 'x' << height << " frames (" << bufferSize << " bytes, " << prewarm << " pre-allocated)" << std::endl;
+	}
+
+	pool->Prewarm(prewarm);
+	return pool;
+}
+
+void FramePool::Retire(FrameBufferPool* pool)
+{
+	if (!pool) return;
+
+	std::lock_guard<std::mutex> guard(registrationMutex);
+
+	if (pool->registrations == 0 || --pool->registrations > 0)
+		return;
+
+	// no one needs this geometry anymore: stop recycling and free the memory
+	// (frames still in flight free their buffers when they are destroyed)
+	pool->active.store(false, std::memory_order_release);
+	pool->Drain();
+
+	Logger::Log(FramePoolConstStr) << "Released " << pool->GetWidth() << 'x' << pool->GetHeight() << " frame pool" << std::endl;
+}
+
+FramePoolStatistics FramePool::GetStatistics() const
+{
+	FramePoolStatistics stats;
+
+	const size_t count = poolCount.load(std::memory_order_acquire);
+	for (size_t i = 0; i < count; ++i)
+	{
+		FrameBufferPool* pool = pools[i].load(std::memory_order_acquire);
+		if (pool)
+			pool->AccumulateStatistics(stats);
+	}
+
+	stats.unpooledAllocations = unpooledAllocations.load(std::memory_order_relaxed);
+	return stats;
+}
+
+void FramePool::LogStatistics(const std::string& module) const
+{
+	FramePoolStatistics stats = GetStatistics();
+	Logger::Log(module) << "[FramePool] " << stats.hits << " hits, " << stats.misses << " misses, " << stats.returned << " returned, "
+		<< stats.discarded << " discarded, " << stats.unpooledAllocations << " unpooled allocations" << std::endl;
+}
@@ -0,0 +1,228 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <boost/noncopyable.hpp>
+#include <boost/lockfree/stack.hpp>
+
+#include "FrameType.h"
+
+/*
+ * FramePoolStatistics summarizes how well frame buffers are being recycled.
+ *
+ * In the steady state, "misses" and "unpooledAllocations" should stop growing:
+ * every frame is served by a buffer that a previous frame returned.
+ */
+struct FramePoolStatistics
+{
+	unsigned long long hits;				// buffers reused from a free-list
+	unsigned long long misses;				// buffers allocated because a free-list was empty
+	unsigned long long returned;			// buffers handed back to a free-list
+	unsigned long long discarded;			// buffers freed because a free-list was full
+	unsigned long long unpooledAllocations; // allocations for geometries without a pool (and custom sized frames)
+
+	FramePoolStatistics() : hits(0), misses(0), returned(0), discarded(0), unpooledAllocations(0) {}
+};
+
+/**
+  FrameBufferPool recycles pixel buffers of a single geometry (width x height x encoding).
+
+  Buffers are kept in a lock-free free-list, so that capture, streaming and recording
+  threads can allocate and release frames without ever taking a lock. The free-list
+  never grows beyond its capacity: extra buffers are freed when they are returned.
+
+  Pools are registered at runtime (e.g.: when a camera connects) and retired when
+  nobody needs them anymore. A retired pool frees its buffers and stops recycling,
+  but the object stays alive so that frames still in flight can return their buffers.
+*/
+class FrameBufferPool : boost::noncopyable
+{
+	const unsigned long width, height;
+	const FrameType::Encoding encoding;
+	const size_t bufferSize;
+
+	// free buffers ready to be reused
+	boost::lockfree::stack<unsigned char*> freeList;
+
+	// false after the pool is retired
+	std::atomic<bool> active;
+
+	// how many components registered this geometry (guarded by FramePool's registration lock)
+	unsigned int registrations;
+	friend class FramePool;
+
+	// pool counters (relaxed - they are only used for reporting)
+	std::atomic<unsigned long long> hits, misses, returned, discarded;
+
+	// frees all buffers currently in the free-list
+	void Drain()
+	{
+		unsigned char* buffer = nullptr;
+		while (freeList.pop(buffer))
+			delete[] buffer;
+	}
+
+public:
+	FrameBufferPool(unsigned long width, unsigned long height, FrameType::Encoding encoding, size_t bufferSize, size_t capacity) :
+		width(width), height(height), encoding(encoding), bufferSize(bufferSize), freeList(capacity),
+		active(true), registrations(0), hits(0), misses(0), returned(0), discarded(0)
+	{
+	}
+
+	~FrameBufferPool()
+	{
+		Drain();
+	}
+
+	inline bool Matches(unsigned long w, unsigned long h, FrameType::Encoding e) const
+	{
+		return width == w && height == h && encoding == e;
+	}
+
+	inline bool IsActive() const { return active.load(std::memory_order_acquire); }
+
+	// returns a buffer of GetBufferSize() bytes (reused whenever possible)
+	unsigned char* Acquire()
+	{
+		unsigned char* buffer = nullptr;
+		if (freeList.pop(buffer))
+		{
+			hits.fetch_add(1, std::memory_order_relaxed);
+			return buffer;
+		}
+
+		misses.fetch_add(1, std::memory_order_relaxed);
+		return new unsigned char[bufferSize];
+	}
+
+	// gives a buffer acquired from this pool back to it
+	void Release(unsigned char* buffer)
+	{
+		if (!buffer) return;
+
+		// bounded_push never allocates - if the free-list is full (or the pool was retired), the buffer is freed instead
+		if (IsActive() && freeList.bounded_push(buffer))
+		{
+			returned.fetch_add(1, std::memory_order_relaxed);
+
+			// the pool was retired between the check and the push (Retire might have drained it already)
+			if (!IsActive())
+				Drain();
+		}
+		else {
+			discarded.fetch_add(1, std::memory_order_relaxed);
+			delete[] buffer;
+		}
+	}
+
+	// allocates buffers ahead of time so that the first frames do not hit the heap
+	void Prewarm(size_t count)
+	{
+		for (size_t i = 0; i < count; ++i)
+		{
+			unsigned char* buffer = new unsigned char[bufferSize];
+			if (!freeList.bounded_push(buffer))
+			{
+				delete[] buffer;
+				break;
+			}
+		}
+	}
+
+	unsigned long GetWidth() const { return width; }
+	unsigned long GetHeight() const { return height; }
+	FrameType::Encoding GetEncoding() const { return encoding; }
+	size_t GetBufferSize() const { return bufferSize; }
+
+	// adds this pool counters to stats
+	void AccumulateStatistics(FramePoolStatistics& stats) const
+	{
+		stats.hits += hits.load(std::memory_order_relaxed);
+		stats.misses += misses.load(std::memory_order_relaxed);
+		stats.returned += returned.load(std::memory_order_relaxed);
+		stats.discarded += discarded.load(std::memory_order_relaxed);
+	}
+};
+
+/**
+  FramePool is the registry of all FrameBufferPools used by Frame::Create.
+
+  Looking up a pool is lock-free: pools are published in a fixed-size array and
+  never removed while the application is running. Only registering and retiring
+  geometries take a lock.
+
+  Geometries are registered at runtime by whoever knows them: the camera's negotiated
+  resolution when it connects, and the "framePool" section of the configuration file.
+  Geometries without a pool fall back to the heap (and are reported as unpooled allocations).
+*/
+class FramePool : boost::noncopyable
+{
+public:
+	// maximum number of geometries the application can pool at once
+	static const size_t MaxPools = 64;
+
+	// number of buffers a free-list keeps around by default
+	static const size_t DefaultCapacity = 8;
+
+private:
+	std::array<std::atomic<FrameBufferPool*>, MaxPools> pools;
+	std::atomic<size_t> poolCount;
+	std::atomic<unsigned long long> unpooledAllocations;
+
+	// only used when registering or retiring a geometry
+	std::mutex registrationMutex;
+
+	FramePool();
+
+	// returns the pool for a given geometry, even if it was retired
+	FrameBufferPool* FindAny(unsigned long width, unsigned long height, FrameType::Encoding encoding) const
+	{
+		const size_t count = poolCount.load(std::memory_order_acquire);
+		for (size_t i = 0; i < count; ++i)
+		{
+			FrameBufferPool* pool = pools[i].load(std::memory_order_acquire);
+			if (pool && pool->Matches(width, height, encoding))
+				return pool;
+		}
+		return nullptr;
+	}
+
+public:
+	~FramePool();
+
+	// there is only one frame pool per application
+	static FramePool& Instance()
+	{
+		static FramePool instance;
+		return instance;
+	}
+
+	// returns the pool for a given geometry (or nullptr if the geometry is not pooled)
+	FrameBufferPool* Find(unsigned long width, unsigned long height, FrameType::Encoding encoding) const
+	{
+		FrameBufferPool* pool = FindAny(width, height, encoding);
+		return (pool && pool->IsActive()) ? pool : nullptr;
+	}
+
+	// creates (or revives) a pool for a given geometry and pre-allocates prewarm buffers.
+	// Every call to Register should be matched by a call to Retire
+	FrameBufferPool* Register(unsigned long width, unsigned long height, FrameType::Encoding encoding, size_t prewarm = 0, size_t capacity = DefaultCapacity);
+
+	// releases a registration - the pool frees its buffers once nobody else registered the same geometry
+	void Retire(FrameBufferPool* pool);
+
+	// heap allocation used for geometries without a pool
+	unsigned char* AllocateUnpooled(size_t size)
+	{
+		unpooledAllocations.fetch_add(1, std::memory_order_relaxed);
+		return new unsigned char[size];
+	}
+
+	// aggregated counters of all pools
+	FramePoolStatistics GetStatistics() const;
+
+	// prints a summary of all counters
+	void LogStatistics(const std::string& module) const;
+};
@@ -0,0 +1,127 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+
+struct FrameType
+{
+	enum class Encoding : unsigned char
+	{
+		Mono8,
+		Mono16,
+		ABGR32,
+		ARGB32,
+		RGB24,
+		RGBA32,
+		BGRA32,
+		BGR24,
+		YUY2,   // packed 4:2:2 (Y0 U Y1 V)
+		I420,   // planar 4:2:0 (Y plane, U plane, V plane)
+		NV12,   // semi-planar 4:2:0 (Y plane, interleaved UV plane)
+		Custom,
+		MJPEG   // a jpeg image per frame (e.g.: the Azure Kinect), sized by the frame itself
+
+	};
+
+	// how many planes are stored in a frame with this encoding
+	static unsigned int getPlaneCount(Encoding e)
+	{
+		switch (e) {
+		case Encoding::I420:
+			return 3;
+		case Encoding::NV12:
+			return 2;
+		default:
+			return 1;
+		}
+	}
+
+	// bytes per pixel (of a given plane). YUY2 pixels take 2 bytes on average, and
+	// every sample in a NV12 chroma plane is made of two bytes (U and V)
+	static unsigned int getPixelLen(Encoding e, unsigned int plane = 0)
+	{
+		switch (e) {
+		case Encoding::Mono8:
+			return sizeof(unsigned char);
+			break;
+		case Encoding::Mono16:
+		case Encoding::YUY2:
+			return sizeof(uint16_t);
+			break;
+		case Encoding::RGB24:
+		case Encoding::BGR24:
+			return 3;
+			break;
+		case Encoding::ABGR32:
+		case Encoding::ARGB32:
+		case Encoding::RGBA32:
+		case Encoding::BGRA32:
+			return 4;
+			break;
+		case Encoding::I420:
+			return (plane < 3) ? 1 : 0;
+			break;
+		case Encoding::NV12:
+			return (plane == 0) ? 1 : ((plane == 1) ? 2 : 0);
+			break;
+
+		default:
+			return 0;
+			break;
+		}
+	}
+
+	// width of a plane in pixels (chroma planes are subsampled)
+	static unsigned long getPlaneWidth(Encoding e, unsigned long width, unsigned int plane)
+	{
+		return (plane > 0 && isYUV(e)) ? (width + 1) >> 1 : width;
+	}
+
+	// height of a plane in lines (chroma planes of 4:2:0 encodings are subsampled)
+	static unsigned long getPlaneHeight(Encoding e, unsigned long height, unsigned int plane)
+	{
+		return (plane > 0 && (e == Encoding::I420 || e == Encoding::NV12)) ? (height + 1) >> 1 : height;
+	}
+
+	// number of bytes used by a tightly packed frame (0 for compressed encodings)
+	static size_t getFrameSize(Encoding e, unsigned long width, unsigned long height)
+	{
+		size_t total = 0;
+		for (unsigned int plane = 0; plane < getPlaneCount(e); ++plane)
+			total += (size_t)getPlaneWidth(e, width, plane) * getPixelLen(e, plane) * getPlaneHeight(e, height, plane);
+		return total;
+	}
+
+	static bool isYUV(Encoding e)
+	{
+		return e == Encoding::YUY2 || e == Encoding::I420 || e == Encoding::NV12;
+	}
+
+	// frames that are not made of pixels: they have a size of their own and are never pooled
+	static bool isCompressed(Encoding e)
+	{
+		return e == Encoding::Custom || e == Encoding::MJPEG;
+	}
+
+	// parses the encoding names used in configuration files (e.g.: "bgr24", "mono16")
+	static bool fromString(const std::string& name, Encoding& e)
+	{
+		if (name == "mono8") e = Encoding::Mono8;
+		else if (name == "mono16") e = Encoding::Mono16;
+		else if (name == "abgr32") e = Encoding::ABGR32;
+		else if (name == "argb32") e = Encoding::ARGB32;
+		else if (name == "rgb24") e = Encoding::RGB24;
+		else if (name == "rgba32") e = Encoding::RGBA32;
+		else if (name == "bgra32") e = Encoding::BGRA32;
+		else if (name == "bgr24") e = Encoding::BGR24;
+		else if (name == "yuy2") e = Encoding::YUY2;
+		else if (name == "i420") e = Encoding::I420;
+		else if (name == "nv12") e = Encoding::NV12;
+		else return false;
+
+		return true;
+	}
+
+
+};
@@ -0,0 +1,188 @@
+#include "JPEGDecoder.h"
+#include "FrameConversion.h"
+#include "Logger.h"
+
+#include <algorithm>
+#include <vector>
+#include <turbojpeg.h>
+#include <libyuv.h>
+
+// name used in logs
+static const char* JPEGDecoderConstStr = "JPEGDecoder";
+
+// turbojpeg handles are not thread safe, so every thread gets its own
+struct ThreadDecompressor
+{
+	tjhandle handle;
+
+	// images that cannot be decoded straight into an I420 frame (e.g.: 4:2:2 images)
+	std::vector<unsigned char> yuvScratch;
+
+	ThreadDecompressor() : handle(tjInitDecompress())
+	{
+		if (!handle)
+			Logger::Log(JPEGDecoderConstStr) << "Could not initialize turbojpeg: " << tjGetErrorStr() << std::endl;
+	}
+
+	~ThreadDecompressor()
+	{
+		if (handle)
+			tjDestroy(handle);
+	}
+};
+
+static thread_local ThreadDecompressor threadDecompressor;
+
+// returns -1 for encodings turbojpeg cannot decode into
+static int ToTurboJPEGPixelFormat(FrameType::Encoding encoding)
+{
+	switch (encoding)
+	{
+	case FrameType::Encoding::BGR24: return TJPF_BGR;
+	case FrameType::Encoding::RGB24: return TJPF_RGB;
+	case FrameType::Encoding::BGRA32: return TJPF_BGRA;
+	case FrameType::Encoding::RGBA32: return TJPF_RGBA;
+	case FrameType::Encoding::Mono8: return TJPF_GRAY;
+	default: return -1;
+	}
+}
+
+// turbojpeg gives up on images it cannot decode, but corrupt images still decode (warnings are not errors)
+static bool Failed(tjhandle handle, int result)
+{
+	return result != 0 && tjGetErrorCode(handle) == TJERR_FATAL;
+}
+
+// jpeg images are stored as YUV, so I420 frames skip color conversion altogether. 4:2:0 images are
+// decoded straight into the frame, while other subsamplings go through scratch planes first
+static std::shared_ptr<Frame> DecodeToI420(tjhandle handle, const Frame& jpeg, int width, int height, int subsampling)
+{
+	std::shared_ptr<Frame> decoded = Frame::Create(width, height, FrameType::Encoding::I420);
+	unsigned char* dst[3];
+	int dstStrides[3];
+	for (unsigned int plane = 0; plane < 3; ++plane)
+	{
+		dst[plane] = decoded->getPlaneData(plane);
+		dstStrides[plane] = (int)decoded->getLineSize(plane);
+	}
+
+	// turbojpeg pads luma to a whole number of chroma samples
+	if (subsampling == TJSAMP_420 && !(width & 1) && !(height & 1))
+		return Failed(handle, tjDecompressToYUVPlanes(handle, jpeg.getData(), (unsigned long)jpeg.size(), dst, width, dstStrides, height, 0)) ? nullptr : decoded;
+
+	std::vector<unsigned char>& scratch = threadDecompressor.yuvScratch;
+
+	// 4:4:0 and 4:1:1 images (hardly ever seen) are decoded to BGRA and converted
+	if (subsampling != TJSAMP_420 && subsampling != TJSAMP_422 && subsampling != TJSAMP_444 && subsampling != TJSAMP_GRAY)
+	{
+		scratch.resize((size_t)width * height * 4);
+		if (Failed(handle, tjDecompress2(handle, jpeg.getData(), (unsigned long)jpeg.size(), scratch.data(), width, width * 4, height, TJPF_BGRA, 0)))
+			return nullptr;
+
+		libyuv::ARGBToI420(scratch.data(), width * 4, dst[0], dstStrides[0], dst[1], dstStrides[1], dst[2], dstStrides[2], width, height);
+		return decoded;
+	}
+
+	const int planeCount = (subsampling == TJSAMP_GRAY) ? 1 : 3;
+	unsigned char* planes[3] = { nullptr, nullptr, nullptr };
+	int strides[3] = { 0, 0, 0 };
+	size_t scratchSize = 0;
+	for (int plane = 0; plane < planeCount; ++plane)
+	{
+		strides[plane] = tjPlaneWidth(plane, width, subsampling);
+		scratchSize += (size_t)strides[plane] * tjPlaneHeight(plane, height, subsampling);
+	}
+
+	scratch.resize(scratchSize);
+	planes[0] = scratch.data();
+	for (int plane = 1; plane < planeCount; ++plane)
+		planes[plane] = planes[plane - 1] + (size_t)strides[plane - 1] * tjPlaneHeight(plane - 1, height, subsampling);
+
+	if (Failed(handle, tjDecompressToYUVPlanes(handle, jpeg.getData(), (unsigned long)jpeg.size(), planes, width, strides, height, 0)))
+		return nullptr;
+
+	switch (subsampling)
+	{
+	case TJSAMP_422:
+		libyuv::I422ToI420(planes[0], strides[0], planes[1], strides[1], planes[2], strides[2], dst[0], dstStrides[0], dst[1], dstStrides[1], dst[2], dstStrides[2], width, height);
+		break;
+	case TJSAMP_444:
+		libyuv::I444ToI420(planes[0], strides[0], planes[1], strides[1], planes[2], strides[2], dst[0], dstStrides[0], dst[1], dstStrides[1], dst[2], dstStrides[2], width, height);
+		break;
+	case TJSAMP_GRAY:
+		libyuv::I400ToI420(planes[0], strides[0], dst[0], dstStrides[0], dst[1], dstStrides[1], dst[2], dstStrides[2], width, height);
+		break;
+	default:
+		// 4:2:0 with odd dimensions
+		libyuv::I420Copy(planes[0], strides[0], planes[1], strides[1], planes[2], strides[2], dst[0], dstStrides[0], dst[1], dstStrides[1], dst[2], dstStrides[2], width, height);
+		break;
+	}
+
+	return decoded;
+}
+
+bool JPEGDecoder::Supports(FrameType::Encoding output)
+{
+	return ToTurboJPEGPixelFormat(output) >= 0 || output == FrameType::Encoding::I420;
+}
+
+unsigned long JPEGDecoder::ScaledSize(unsigned long dimension, unsigned int scale)
+{
+	const tjscalingfactor factor = { 1, (int)NativeScale(scale) };
+	return (unsigned long)TJSCALED((int)dimension, factor);
+}
+
+unsigned int JPEGDecoder::NativeScale(unsigned int scale)
+{
+	for (unsigned int native = 8; native > 1; native >>= 1)
+		if (scale % native == 0)
+			return native;
+	return 1;
+}
+
+std::shared_ptr<Frame> JPEGDecoder::Decode(const Frame& jpeg, FrameType::Encoding output, unsigned int scale)
+{
+	tjhandle handle = threadDecompressor.handle;
+	if (!handle || !Supports(output) || jpeg.getEncoding() != FrameType::Encoding::MJPEG)
+		return nullptr;
+
+	scale = std::max(scale, 1u);
+
+	int width, height, subsampling, colorspace;
+	if (tjDecompressHeader3(handle, jpeg.getData(), (unsigned long)jpeg.size(), &width, &height, &subsampling, &colorspace) != 0)
+	{
+		Logger::Log(JPEGDecoderConstStr) << "Invalid jpeg image: " << tjGetErrorStr2(handle) << std::endl;
+		return nullptr;
+	}
+
+	// the IDCT does as much of the scaling as it can
+	const unsigned int native = NativeScale(scale);
+	const tjscalingfactor factor = { 1, (int)native };
+	const int scaledWidth = TJSCALED(width, factor), scaledHeight = TJSCALED(height, factor);
+
+	std::shared_ptr<Frame> decoded;
+	if (output == FrameType::Encoding::I420)
+	{
+		decoded = DecodeToI420(handle, jpeg, scaledWidth, scaledHeight, subsampling);
+	}
+	else {
+		decoded = Frame::Create(scaledWidth, scaledHeight, output);
+		if (Failed(handle, tjDecompress2(handle, jpeg.getData(), (unsigned long)jpeg.size(), decoded->getData(), scaledWidth, (int)decoded->getLineSize(),
+			scaledHeight, ToTurboJPEGPixelFormat(output), 0)))
+			decoded.reset();
+	}
+
+	if (!decoded)
+	{
+		Logger::Log(JPEGDecoderConstStr) << "Could not decode " << width << 'x' << height << " image: " << tjGetErrorStr2(handle) << std::endl;
+		return nullptr;
+	}
+
+	// decoded pixels were captured when the jpeg was
+	decoded->setCaptureTime(jpeg.getCaptureTime());
+
+	// whatever is left (e.g.: 3 or 6) is done with a resize
+	std::shared_ptr<Frame> scaled = FrameConversion::Downscale(decoded, scale / native);
+	scaled->setCaptureTime(jpeg.getCaptureTime());
+	return scaled;
+}
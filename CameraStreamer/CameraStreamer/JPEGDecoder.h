@@ -0,0 +1,39 @@
+#pragma once
+
+#include <memory>
+
+#include "Frame.h"
+
+/**
+  JPEGDecoder decompresses MJPEG frames with libjpeg-turbo.
+
+  Cameras that compress color themselves (e.g.: the Azure Kinect) hand out MJPEG frames,
+  which are forwarded untouched to clients and to the recorder. Only consumers that need
+  pixels (lower quality tiers, colored point clouds, OpenCV) decode them, and only when
+  they do.
+
+  Images can be shrunk while they are decoded: turbojpeg skips most of the IDCT work when
+  scaling by 1/2, 1/4 or 1/8, which is a lot cheaper than decoding and then resizing. Other
+  factors are decoded at the closest of those and resized afterwards (see FrameConversion).
+
+  Like JPEGEncoder, every thread that decodes gets its own turbojpeg handle.
+
+  Supported outputs: BGR24, RGB24, BGRA32, RGBA32, Mono8, and I420. I420 skips color
+  conversion (4:2:0 images are decoded straight into the frame planes).
+*/
+class JPEGDecoder
+{
+public:
+	// can images be decoded into frames of a given encoding?
+	static bool Supports(FrameType::Encoding output);
+
+	// largest factor that turbojpeg can shrink images by while decoding (1, 2, 4 or 8) that divides scale
+	static unsigned int NativeScale(unsigned int scale);
+
+	// size of an image dimension once decoded with a scale that turbojpeg supports (see NativeScale)
+	static unsigned long ScaledSize(unsigned long dimension, unsigned int scale);
+
+	// decodes an MJPEG frame, shrinking it by an integer factor (to about width / scale x height / scale).
+	// returns nullptr if the frame is not a valid jpeg or the output encoding is not supported
+	static std::shared_ptr<Frame> Decode(const Frame& jpeg, FrameType::Encoding output = FrameType::Encoding::BGR24, unsigned int scale = 1);
+};
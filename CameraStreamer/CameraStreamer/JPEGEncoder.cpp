@@ -0,0 +1,199 @@
+#include "JPEGEncoder.h"
+#include "Logger.h"
+
+#include <algorithm>
+#include <vector>
+#include <turbojpeg.h>
+#include <libyuv.h>
+
+// name used in logs
+static const char* JPEGEncoderConstStr = "JPEGEncoder";
+
+// turbojpeg handles are not thread safe, so every thread gets its own
+struct ThreadCompressor
+{
+	tjhandle handle;
+
+	// frames that have to be repacked before compression (NV12, YUY2)
+	std::vector<unsigned char> yuvScratch;
+
+	ThreadCompressor() : handle(tjInitCompress())
+	{
+		if (!handle)
+			Logger::Log(JPEGEncoderConstStr) << "Could not initialize turbojpeg: " << tjGetErrorStr() << std::endl;
+	}
+
+	~ThreadCompressor()
+	{
+		if (handle)
+			tjDestroy(handle);
+	}
+};
+
+static thread_local ThreadCompressor threadCompressor;
+
+static int ToTurboJPEGSubsampling(JPEGEncoder::Subsampling subsampling)
+{
+	switch (subsampling)
+	{
+	case JPEGEncoder::Subsampling::YUV444: return TJSAMP_444;
+	case JPEGEncoder::Subsampling::YUV422: return TJSAMP_422;
+	case JPEGEncoder::Subsampling::Gray: return TJSAMP_GRAY;
+	default: return TJSAMP_420;
+	}
+}
+
+// returns -1 for encodings that are not packed pixels
+static int ToTurboJPEGPixelFormat(FrameType::Encoding encoding)
+{
+	switch (encoding)
+	{
+	case FrameType::Encoding::BGR24: return TJPF_BGR;
+	case FrameType::Encoding::RGB24: return TJPF_RGB;
+	case FrameType::Encoding::BGRA32: return TJPF_BGRA;
+	case FrameType::Encoding::RGBA32: return TJPF_RGBA;
+	case FrameType::Encoding::Mono8: return TJPF_GRAY;
+
+	// ARGB32 and ABGR32 follow libyuv's naming (which is little endian): ARGB is stored as B, G, R, A
+	case FrameType::Encoding::ARGB32: return TJPF_BGRA;
+	case FrameType::Encoding::ABGR32: return TJPF_RGBA;
+	default: return -1;
+	}
+}
+
+bool JPEGEncoder::SubsamplingFromString(const std::string& name, Subsampling& subsampling)
+{
+	if (name == "444") subsampling = Subsampling::YUV444;
+	else if (name == "422") subsampling = Subsampling::YUV422;
+	else if (name == "420") subsampling = Subsampling::YUV420;
+	else if (name == "gray") subsampling = Subsampling::Gray;
+	else return false;
+
+	return true;
+}
+
+JPEGEncoder::JPEGEncoder(int quality, Subsampling subsampling, bool fastDCT) :
+	quality(quality), subsampling(subsampling), fastDCT(fastDCT)
+{
+	if (this->quality < 1 || this->quality > 100)
+	{
+		Logger::Log(JPEGEncoderConstStr) << "Invalid quality " << quality << "! Using 95 instead" << std::endl;
+		this->quality = 95;
+	}
+}
+
+bool JPEGEncoder::Supports(FrameType::Encoding encoding)
+{
+	return ToTurboJPEGPixelFormat(encoding) >= 0 || FrameType::isYUV(encoding);
+}
+
+std::shared_ptr<EncodedBuffer> JPEGEncoder::AcquireOutputBuffer(unsigned long bufferSize)
+{
+	std::shared_ptr<FrameBufferPool> pool;
+	{
+		const std::lock_guard<std::mutex> lock(outputPoolMutex);
+
+		for (size_t i = 0; i < outputPools.size() && !pool; ++i)
+			if (outputPools[i]->GetBufferSize() == bufferSize)
+				pool = outputPools[i];
+
+		// new geometry? the one not used for the longest goes away (its buffers are freed as they come back)
+		if (!pool)
+		{
+			if (outputPools.size() == MaxOutputPools)
+				outputPools.erase(outputPools.begin());
+
+			pool = std::make_shared<FrameBufferPool>(0, 0, FrameType::Encoding::Custom, bufferSize, OutputPoolCapacity);
+			outputPools.push_back(pool);
+		}
+		else if (pool != outputPools.back())
+		{
+			// most recent last
+			outputPools.erase(std::find(outputPools.begin(), outputPools.end(), pool));
+			outputPools.push_back(pool);
+		}
+	}
+
+	return std::make_shared<EncodedBuffer>(pool);
+}
+
+std::shared_ptr<EncodedBuffer> JPEGEncoder::Encode(const Frame& frame, int quality)
+{
+	tjhandle handle = threadCompressor.handle;
+	if (!handle || !Supports(frame.getEncoding()))
+		return nullptr;
+
+	quality = std::min(std::max(quality, 1), 100);
+
+	const int width = (int)frame.getWidth(), height = (int)frame.getHeight();
+	const int flags = TJFLAG_NOREALLOC | (fastDCT ? TJFLAG_FASTDCT : 0);
+
+	std::shared_ptr<EncodedBuffer> output;
+	unsigned char* jpegBuffer = nullptr;
+	unsigned long jpegSize = 0;
+	int result = -1;
+
+	if (FrameType::isYUV(frame.getEncoding()))
+	{
+		// planar frames skip color conversion altogether: their subsampling is the one of the frame
+		const int yuvSubsampling = (frame.getEncoding() == FrameType::Encoding::YUY2) ? TJSAMP_422 : TJSAMP_420;
+		const unsigned char* planes[3];
+		int strides[3];
+
+		if (frame.getEncoding() == FrameType::Encoding::I420)
+		{
+			for (unsigned int plane = 0; plane < 3; ++plane)
+			{
+				planes[plane] = frame.getPlaneData(plane);
+				strides[plane] = (int)frame.getLineSize(plane);
+			}
+		}
+		else {
+			// NV12 and YUY2 are repacked into planar buffers (420 and 422 respectively)
+			const int chromaWidth = (width + 1) >> 1;
+			const int chromaHeight = (yuvSubsampling == TJSAMP_420) ? (height + 1) >> 1 : height;
+			std::vector<unsigned char>& scratch = threadCompressor.yuvScratch;
+			scratch.resize((size_t)width * height + 2 * (size_t)chromaWidth * chromaHeight);
+
+			unsigned char* y = scratch.data();
+			unsigned char* u = y + (size_t)width * height;
+			unsigned char* v = u + (size_t)chromaWidth * chromaHeight;
+
+			if (frame.getEncoding() == FrameType::Encoding::NV12)
+			{
+				libyuv::NV12ToI420(frame.getPlaneData(0), (int)frame.getLineSize(0), frame.getPlaneData(1), (int)frame.getLineSize(1),
+					y, width, u, chromaWidth, v, chromaWidth, width, height);
+			}
+			else {
+				libyuv::YUY2ToI422(frame.getData(), (int)frame.getLineSize(), y, width, u, chromaWidth, v, chromaWidth, width, height);
+			}
+
+			planes[0] = y; planes[1] = u; planes[2] = v;
+			strides[0] = width; strides[1] = strides[2] = chromaWidth;
+		}
+
+		output = AcquireOutputBuffer(tjBufSize(width, height, yuvSubsampling));
+		jpegBuffer = output->data();
+		jpegSize = (unsigned long)output->getCapacity();
+		result = tjCompressFromYUVPlanes(handle, planes, width, strides, height, yuvSubsampling, &jpegBuffer, &jpegSize, quality, flags);
+	}
+	else {
+		const int pixelFormat = ToTurboJPEGPixelFormat(frame.getEncoding());
+		const int jpegSubsampling = (pixelFormat == TJPF_GRAY) ? TJSAMP_GRAY : ToTurboJPEGSubsampling(subsampling);
+
+		output = AcquireOutputBuffer(tjBufSize(width, height, jpegSubsampling));
+		jpegBuffer = output->data();
+		jpegSize = (unsigned long)output->getCapacity();
+		result = tjCompress2(handle, frame.getData(), width, (int)frame.getLineSize(), height, pixelFormat,
+			&jpegBuffer, &jpegSize, jpegSubsampling, quality, flags);
+	}
+
+	if (result != 0)
+	{
+		Logger::Log(JPEGEncoderConstStr) << "Could not compress " << width << 'x' << height << " frame: " << tjGetErrorStr2(handle) << std::endl;
+		return nullptr;
+	}
+
+	output->resize(jpegSize);
+	return output;
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "Frame.h"
+#include "EncodedBuffer.h"
+
+/**
+  JPEGEncoder compresses frames with libjpeg-turbo.
+
+  Every thread that calls Encode gets its own turbojpeg handle (created once and reused),
+  so a single encoder can be shared by all encoder threads. Compressed images are written
+  into pre-sized pooled buffers (see EncodedBuffer), which means no heap allocations once
+  the stream reaches a steady state. Buffers are pooled per size, so frames of a few
+  different sizes (e.g.: quality tiers) can be encoded side by side.
+
+  Supported encodings: BGR24, RGB24, BGRA32, RGBA32, ARGB32, ABGR32, Mono8, I420, NV12, and YUY2.
+  I420 is compressed straight from its planes; NV12 and YUY2 are repacked as I420 first.
+*/
+class JPEGEncoder
+{
+public:
+	enum class Subsampling { YUV444, YUV422, YUV420, Gray };
+
+	// parses the names used in the configuration file ("444", "422", "420", "gray")
+	static bool SubsamplingFromString(const std::string& name, Subsampling& subsampling);
+
+private:
+	int quality;
+	Subsampling subsampling;
+	bool fastDCT;
+
+	// buffers sized for the last few geometries encoded (most recent last)
+	std::vector<std::shared_ptr<FrameBufferPool> > outputPools;
+	std::mutex outputPoolMutex;
+
+	// returns a buffer that can hold any image of a given size
+	std::shared_ptr<EncodedBuffer> AcquireOutputBuffer(unsigned long bufferSize);
+
+public:
+	// number of output buffers kept around
+	static constexpr size_t OutputPoolCapacity = 8;
+
+	// number of geometries with their own output buffers
+	static constexpr size_t MaxOutputPools = 4;
+
+	JPEGEncoder(int quality = 95, Subsampling subsampling = Subsampling::YUV420, bool fastDCT = false);
+
+	int GetQuality() const { return quality; }
+	Subsampling GetSubsampling() const { return subsampling; }
+	bool IsFastDCT() const { return fastDCT; }
+
+	// can frames of a given encoding be compressed?
+	static bool Supports(FrameType::Encoding encoding);
+
+	// compresses a frame. returns nullptr if the frame encoding is not supported or compression fails
+	std::shared_ptr<EncodedBuffer> Encode(const Frame& frame) { return Encode(frame, quality); }
+
+	// same as above, but with a different quality (1-100) than the one the encoder was created with
+	std::shared_ptr<EncodedBuffer> Encode(const Frame& frame, int quality);
+};
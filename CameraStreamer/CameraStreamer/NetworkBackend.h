@@ -0,0 +1,20 @@
+#pragma once
+
+#include "CompilerConfiguration.h"
+#include <boost/asio.hpp>
+
+// what boost.asio uses to wait for sockets in this build (see CS_ENABLE_ASIO_IO_URING in CompilerConfiguration.h)
+inline const char* NetworkBackendName()
+{
+#if defined(BOOST_ASIO_HAS_IO_URING_AS_DEFAULT)
+	return "io_uring";
+#elif defined(BOOST_ASIO_HAS_IOCP)
+	return "IOCP";
+#elif defined(BOOST_ASIO_HAS_EPOLL)
+	return "epoll";
+#elif defined(BOOST_ASIO_HAS_KQUEUE)
+	return "kqueue";
+#else
+	return "select";
+#endif
+}
@@ -27,9 +27,14 @@ struct NetworkStatistics
 	unsigned long long messagesReceived;
 	unsigned long long bytesReceived;
 
+	// time between a frame being captured and its message being sent (only tracked by streaming sessions)
+	unsigned long long latencySamples;
+	std::chrono::microseconds latencyTotal, latencyMax, latencyLast;
+
 	NetworkStatistics(bool incoming = false) : connectedTime(std::chrono::system_clock::now()),
 		messagesSent(0), messagesDropped(0), bytesSent(0), messagesReceived(0),
-		bytesReceived(0), remotePort(0), localPort(0), incomingConnection(incoming),
+		bytesReceived(0), latencySamples(0), latencyTotal(0), latencyMax(0), latencyLast(0),
+		remotePort(0), localPort(0), incomingConnection(incoming),
 		currentlyConnected(incoming) {}
 
 	void reset(bool currentlyconnected = false)
@@ -41,6 +46,8 @@ struct NetworkStatistics
 		bytesSent = 0;
 		messagesReceived = 0;
 		bytesReceived = 0;
+		latencySamples = 0;
+		latencyTotal = latencyMax = latencyLast = std::chrono::microseconds(0);
 		remotePort = 0;
 		localPort = 0;
 		incomingConnection = false;
@@ -57,6 +64,20 @@ struct NetworkStatistics
 		currentlyConnected = false;
 	}
 
+	void addLatency(std::chrono::microseconds latency)
+	{
+		++latencySamples;
+		latencyTotal += latency;
+		latencyLast = latency;
+		if (latency > latencyMax)
+			latencyMax = latency;
+	}
+
+	inline double averageLatencyMs() const
+	{
+		return latencySamples ? (latencyTotal.count() / 1000.0) / latencySamples : 0.0;
+	}
+
 	inline long long durationInSeconds()
 	{
 		if (currentlyConnected)
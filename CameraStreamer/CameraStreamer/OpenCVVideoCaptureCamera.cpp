@@ -291,8 +291,9 @@ void CVVideoCaptureCamera::CameraLoop()
 								if (!sharedColorFrame)
 									throw std::bad_alloc();
 
-								//assert(colorFrame.get_data_size() == sharedColorFrame->size()); // sanity check for debugging
-								memcpy(sharedColorFrame->data, videoFrame.ptr(), sharedColorFrame->size()); // no suppport for stride! (yet)
+								// copies line by line (videoFrame.step might include padding)
+								cv::Mat frameView(videoFrame.size(), CV_8UC3, sharedColorFrame->getData(), sharedColorFrame->getLineSize());
+								videoFrame.copyTo(frameView);
 
 								// invoke callback
 								if (onFramesReady)
@@ -332,8 +333,9 @@ void CVVideoCaptureCamera::CameraLoop()
 								if (!sharedColorFrame)
 									throw std::bad_alloc();
 
-								//assert(colorFrame.get_data_size() == sharedColorFrame->size()); // sanity check for debugging
-								memcpy(sharedColorFrame->data, videoFrame.ptr(), sharedColorFrame->size()); // no suppport for stride! (yet)
+								// copies line by line (videoFrame.step might include padding)
+								cv::Mat frameView(videoFrame.size(), CV_8UC3, sharedColorFrame->getData(), sharedColorFrame->getLineSize());
+								videoFrame.copyTo(frameView);
 
 								// sleep a little bit (to control frame rate)
 								long long timeleft = periodms - std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::high_resolution_clock::now() - timeSinceLastFrame).count();
@@ -0,0 +1,213 @@
+#pragma once
+
+#include "CompilerConfiguration.h"
+
+#include <atomic>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <boost/asio.hpp>
+#include <boost/noncopyable.hpp>
+
+#include "Logger.h"
+
+/**
+  SequenceReorderBuffer hands results back in the order in which their jobs were submitted.
+
+  Jobs get a sequence number when they are submitted. Results that complete early are
+  parked until every result before them is delivered.
+*/
+template <class Result>
+class SequenceReorderBuffer : boost::noncopyable
+{
+	std::mutex reorderMutex;
+	std::map<unsigned long long, Result> pending;
+	unsigned long long nextSequence;
+
+public:
+	typedef std::function<void(unsigned long long, Result&)> Delivery;
+
+	SequenceReorderBuffer() : nextSequence(0) {}
+
+	// parks a result and delivers every result that is now in order.
+	// deliveries happen under a lock so that they never overtake each other (keep them short!)
+	void Complete(unsigned long long sequence, Result result, const Delivery& deliver)
+	{
+		const std::lock_guard<std::mutex> lock(reorderMutex);
+		pending.emplace(sequence, std::move(result));
+
+		auto it = pending.begin();
+		while (it != pending.end() && it->first == nextSequence)
+		{
+			deliver(it->first, it->second);
+			it = pending.erase(it);
+			++nextSequence;
+		}
+	}
+
+	// forgets parked results and starts counting from a given sequence
+	void Reset(unsigned long long sequence = 0)
+	{
+		const std::lock_guard<std::mutex> lock(reorderMutex);
+		pending.clear();
+		nextSequence = sequence;
+	}
+
+	size_t Pending()
+	{
+		const std::lock_guard<std::mutex> lock(reorderMutex);
+		return pending.size();
+	}
+};
+
+
+/**
+  OrderedWorkerPool runs jobs on a fixed number of threads and delivers
+  their results in submission order.
+
+  The number of jobs in flight is bounded: Submit refuses new jobs (and counts
+  them as dropped) instead of letting work pile up when workers fall behind.
+  A job that throws delivers a default constructed Result, so that results
+  after it are not held back.
+*/
+template <class Result>
+class OrderedWorkerPool : boost::noncopyable
+{
+public:
+	typedef std::function<Result()> Job;
+	typedef typename SequenceReorderBuffer<Result>::Delivery Completion;
+
+private:
+	const std::string name;
+	const unsigned int threadCount;
+	const size_t maxInFlight;
+
+	Completion onCompleted;
+
+	boost::asio::io_context io_context;
+	std::shared_ptr<boost::asio::io_context::work> work;
+	std::vector<std::thread> workers;
+
+	SequenceReorderBuffer<Result> reorderBuffer;
+	// Start resets it while producers might be submitting
+	std::atomic<unsigned long long> nextSequence;
+	std::atomic<size_t> inFlight;
+	std::atomic<unsigned long long> jobsCompleted, jobsDropped, jobsFailed;
+
+	// Submit runs on the producer thread while Start / Stop might run on another one
+	std::atomic<bool> running;
+
+	// jobs that were still queued when the pool stopped belong to an older generation, and are thrown away
+	std::atomic<unsigned long long> generation;
+
+	void RunJob(unsigned long long jobGeneration, unsigned long long sequence, const Job& job)
+	{
+		if (jobGeneration != generation.load())
+			return;
+
+		Result result = Result();
+		try
+		{
+			result = job();
+		}
+		catch (const std::exception& e)
+		{
+			++jobsFailed;
+			Logger::Log(name) << "Job " << sequence << " failed: " << e.what() << std::endl;
+		}
+
+		reorderBuffer.Complete(sequence, std::move(result), onCompleted);
+		--inFlight;
+		++jobsCompleted;
+	}
+
+public:
+	// threads = 0 uses one thread per two cores. maxInFlight = 0 allows two jobs per thread
+	OrderedWorkerPool(const std::string& name, unsigned int threads, size_t maxInFlight, Completion onCompleted) :
+		name(name), threadCount(threads ? threads : DefaultThreadCount()),
+		maxInFlight(maxInFlight ? maxInFlight : 2 * (threads ? threads : DefaultThreadCount())),
+		onCompleted(onCompleted), nextSequence(0), inFlight(0), jobsCompleted(0), jobsDropped(0), jobsFailed(0), running(false), generation(0)
+	{
+	}
+
+	~OrderedWorkerPool()
+	{
+		Stop();
+	}
+
+	static unsigned int DefaultThreadCount()
+	{
+		const unsigned int cores = std::thread::hardware_concurrency();
+		return (cores > 3) ? cores / 2 : 1;
+	}
+
+	bool IsRunning() const { return running.load(); }
+	unsigned int GetThreadCount() const { return threadCount; }
+	size_t GetMaxInFlight() const { return maxInFlight; }
+	unsigned long long GetJobsCompleted() const { return jobsCompleted; }
+	unsigned long long GetJobsDropped() const { return jobsDropped; }
+	unsigned long long GetJobsFailed() const { return jobsFailed; }
+
+	void Start()
+	{
+		if (IsRunning()) return;
+
+		io_context.restart();
+		reorderBuffer.Reset();
+		nextSequence = 0;
+		inFlight = 0;
+
+		// anything posted while the pool was stopped is stale
+		++generation;
+		running = true;
+
+		work = std::make_shared<boost::asio::io_context::work>(io_context);
+		for (unsigned int i = 0; i < threadCount; ++i)
+			workers.emplace_back([this]() { io_context.run(); });
+
+		Logger::Log(name) << "Started " << threadCount << " worker threads (up to " << maxInFlight << " jobs in flight)" << std::endl;
+	}
+
+	// pending jobs are discarded
+	void Stop()
+	{
+		if (!running.exchange(false)) return;
+
+		work = nullptr;
+		io_context.stop();
+		for (std::thread& worker : workers)
+		{
+			if (worker.joinable())
+				worker.join();
+		}
+		workers.clear();
+
+		// queued jobs are released now (along with whatever they hold on to) instead of running when the pool starts again
+		++generation;
+		io_context.restart();
+		io_context.poll();
+
+		Logger::Log(name) << "Stopped after " << jobsCompleted << " jobs (" << jobsDropped << " dropped, " << jobsFailed << " failed)" << std::endl;
+	}
+
+	// queues a job. returns false (and drops it) if the pool is not running or too busy.
+	// results come out in the order jobs were submitted (callers that submit from several threads get the order in which they got here)
+	bool Submit(Job job)
+	{
+		if (!IsRunning() || inFlight.load() >= maxInFlight)
+		{
+			++jobsDropped;
+			return false;
+		}
+
+		++inFlight;
+		const unsigned long long sequence = nextSequence.fetch_add(1);
+		const unsigned long long jobGeneration = generation.load();
+		boost::asio::post(io_context, [this, jobGeneration, sequence, job]() { RunJob(jobGeneration, sequence, job); });
+		return true;
+	}
+};
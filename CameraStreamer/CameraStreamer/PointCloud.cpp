@@ -0,0 +1,293 @@
+#include "PointCloud.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <unordered_map>
+
+#include <opencv2/opencv.hpp>
+
+// x64 always has SSE2 (32 bit builds only if the compiler was told so)
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define CS_POINTCLOUD_SSE2
+#include <emmintrin.h>
+#endif
+
+bool PointCloud::FormatFromString(const std::string& name, Format& format)
+{
+	if (name == "xyz")
+		format = Format::XYZ;
+	else if (name == "xyzrgb")
+		format = Format::XYZRGB;
+	else
+		return false;
+	return true;
+}
+
+const char* PointCloud::FormatToString(Format format)
+{
+	switch (format)
+	{
+	case Format::XYZ: return "xyz";
+	case Format::XYZRGB: return "xyzrgb";
+	default: return "none";
+	}
+}
+
+std::shared_ptr<PointCloud::RayTable> PointCloud::MakeRayTable(const StreamingProtocol::IntrinsicsV2& intrinsics, unsigned long width, unsigned long height)
+{
+	if (intrinsics.fx <= 0 || intrinsics.fy <= 0 || width == 0 || height == 0)
+		return nullptr;
+
+	// same distortion model as the Azure Kinect (rational, 6 radial and 2 tangential coefficients)
+	const cv::Mat cameraMatrix = (cv::Mat_<double>(3, 3) << intrinsics.fx, 0, intrinsics.cx, 0, intrinsics.fy, intrinsics.cy, 0, 0, 1);
+	const cv::Mat distortion = (cv::Mat_<double>(1, 8) << intrinsics.k1, intrinsics.k2, intrinsics.p1, intrinsics.p2,
+		intrinsics.k3, intrinsics.k4, intrinsics.k5, intrinsics.k6);
+
+	std::shared_ptr<RayTable> rays = std::make_shared<RayTable>();
+	rays->width = width;
+	rays->height = height;
+	rays->x.resize((size_t)width * height);
+	rays->y.resize((size_t)width * height);
+
+	// one row at a time (large color cameras have millions of pixels)
+	std::vector<cv::Point2f> pixels(width), undistorted;
+	for (unsigned long y = 0; y < height; ++y)
+	{
+		for (unsigned long x = 0; x < width; ++x)
+			pixels[x] = cv::Point2f((float)x, (float)y);
+
+		cv::undistortPoints(pixels, undistorted, cameraMatrix, distortion);
+
+		for (unsigned long x = 0; x < width; ++x)
+		{
+			rays->x[(size_t)y * width + x] = undistorted[x].x;
+			rays->y[(size_t)y * width + x] = undistorted[x].y;
+		}
+	}
+
+	return rays;
+}
+
+// rounds to the nearest integer (ties to even, like SSE2) and saturates to int16
+static inline int16_t ToMillimeters(float value)
+{
+	value = std::min(std::max(value, -32768.0f), 32767.0f);
+	return (int16_t)std::lrint(value);
+}
+
+void PointCloud::DepthToXYZScalar(const uint16_t* depth, const float* rayX, const float* rayY, size_t count, float millimetersPerUnit, int16_t* x, int16_t* y, int16_t* z)
+{
+	for (size_t i = 0; i < count; ++i)
+	{
+		const float depthInMillimeters = depth[i] * millimetersPerUnit;
+		x[i] = ToMillimeters(rayX[i] * depthInMillimeters);
+		y[i] = ToMillimeters(rayY[i] * depthInMillimeters);
+		z[i] = ToMillimeters(depthInMillimeters);
+	}
+}
+
+void PointCloud::DepthToXYZ(const uint16_t* depth, const float* rayX, const float* rayY, size_t count, float millimetersPerUnit, int16_t* x, int16_t* y, int16_t* z)
+{
+	size_t i = 0;
+
+#ifdef CS_POINTCLOUD_SSE2
+	// 8 pixels at a time: depths are widened to floats, multiplied by their rays, and packed back to int16 (saturated)
+	const __m128 scale = _mm_set1_ps(millimetersPerUnit);
+	const __m128i zero = _mm_setzero_si128();
+	for (; i + 8 <= count; i += 8)
+	{
+		const __m128i depths = _mm_loadu_si128((const __m128i*)(depth + i));
+		const __m128 zLow = _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpacklo_epi16(depths, zero)), scale);
+		const __m128 zHigh = _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpackhi_epi16(depths, zero)), scale);
+
+		const __m128 xLow = _mm_mul_ps(_mm_loadu_ps(rayX + i), zLow);
+		const __m128 xHigh = _mm_mul_ps(_mm_loadu_ps(rayX + i + 4), zHigh);
+		const __m128 yLow = _mm_mul_ps(_mm_loadu_ps(rayY + i), zLow);
+		const __m128 yHigh = _mm_mul_ps(_mm_loadu_ps(rayY + i + 4), zHigh);
+
+		_mm_storeu_si128((__m128i*)(x + i), _mm_packs_epi32(_mm_cvtps_epi32(xLow), _mm_cvtps_epi32(xHigh)));
+		_mm_storeu_si128((__m128i*)(y + i), _mm_packs_epi32(_mm_cvtps_epi32(yLow), _mm_cvtps_epi32(yHigh)));
+		_mm_storeu_si128((__m128i*)(z + i), _mm_packs_epi32(_mm_cvtps_epi32(zLow), _mm_cvtps_epi32(zHigh)));
+	}
+#endif
+
+	// leftovers (or everything without SSE2)
+	DepthToXYZScalar(depth + i, rayX + i, rayY + i, count - i, millimetersPerUnit, x + i, y + i, z + i);
+}
+
+bool PointCloud::HasSIMD()
+{
+#ifdef CS_POINTCLOUD_SSE2
+	return true;
+#else
+	return false;
+#endif
+}
+
+// where red, green and blue are in a pixel
+static bool ColorLayout(FrameType::Encoding encoding, unsigned int& red, unsigned int& green, unsigned int& blue)
+{
+	switch (encoding)
+	{
+	case FrameType::Encoding::Mono8:  red = 0; green = 0; blue = 0; return true;
+	case FrameType::Encoding::RGB24:
+	case FrameType::Encoding::RGBA32: red = 0; green = 1; blue = 2; return true;
+	case FrameType::Encoding::BGR24:
+	case FrameType::Encoding::BGRA32: red = 2; green = 1; blue = 0; return true;
+	case FrameType::Encoding::ABGR32: red = 3; green = 2; blue = 1; return true;
+	case FrameType::Encoding::ARGB32: red = 1; green = 2; blue = 3; return true;
+	default: return false;
+	}
+}
+
+bool PointCloud::CanSampleColor(const Frame& color)
+{
+	unsigned int red, green, blue;
+	return ColorLayout(color.getEncoding(), red, green, blue);
+}
+
+// writes a point (little endian int16 coordinates, then colors)
+static inline unsigned char* WritePoint(unsigned char* output, int16_t x, int16_t y, int16_t z)
+{
+	memcpy(output, &x, sizeof(x));
+	memcpy(output + 2, &y, sizeof(y));
+	memcpy(output + 4, &z, sizeof(z));
+	return output + 6;
+}
+
+// voxel a coordinate falls in (rounded towards -infinity so that voxels do not get twice as big around 0)
+static inline int32_t VoxelOf(int32_t coordinate, int32_t voxelSize)
+{
+	return (coordinate >= 0) ? coordinate / voxelSize : -((-coordinate + voxelSize - 1) / voxelSize);
+}
+
+size_t PointCloud::Compute(const Frame& depth, const Frame* color, const RayTable& rays, float millimetersPerUnit, Format format,
+	unsigned int voxelSize, std::vector<unsigned char>& output)
+{
+	output.clear();
+
+	const unsigned long width = depth.getWidth(), height = depth.getHeight();
+	if (format == Format::None || depth.getEncoding() != FrameType::Encoding::Mono16 || rays.width != width || rays.height != height)
+		return 0;
+
+	// colors are picked from the closest color pixel (color and depth can have different sizes)
+	unsigned int red = 0, green = 0, blue = 0;
+	const bool withColor = (format == Format::XYZRGB) && color && ColorLayout(color->getEncoding(), red, green, blue);
+	std::vector<size_t> colorColumns;
+	if (withColor)
+	{
+		colorColumns.resize(width);
+		for (unsigned long x = 0; x < width; ++x)
+			colorColumns[x] = (size_t)(x * color->getWidth() / width) * color->getPixelLen();
+	}
+
+	const size_t bytesPerPoint = BytesPerPoint(format);
+	std::vector<int16_t> xs(width), ys(width), zs(width);
+
+	// every point is kept
+	if (voxelSize == 0)
+	{
+		output.resize((size_t)width * height * bytesPerPoint);
+		unsigned char* point = output.data();
+
+		for (unsigned long row = 0; row < height; ++row)
+		{
+			const uint16_t* depthRow = (const uint16_t*)(depth.getData() + (size_t)row * depth.getLineSize());
+			DepthToXYZ(depthRow, &rays.x[(size_t)row * width], &rays.y[(size_t)row * width], width, millimetersPerUnit, xs.data(), ys.data(), zs.data());
+
+			const unsigned char* colorRow = withColor ? color->getData() + (size_t)(row * color->getHeight() / height) * color->getLineSize() : nullptr;
+			for (unsigned long x = 0; x < width; ++x)
+			{
+				if (zs[x] <= 0)
+					continue;
+
+				point = WritePoint(point, xs[x], ys[x], zs[x]);
+				if (format == Format::XYZRGB)
+				{
+					const unsigned char* pixel = withColor ? colorRow + colorColumns[x] : nullptr;
+					*point++ = pixel ? pixel[red] : 0;
+					*point++ = pixel ? pixel[green] : 0;
+					*point++ = pixel ? pixel[blue] : 0;
+				}
+			}
+		}
+
+		output.resize(point - output.data());
+		return output.size() / bytesPerPoint;
+	}
+
+	// points are averaged per voxel (large voxels can hold millions of points)
+	struct Voxel
+	{
+		int64_t x, y, z;
+		uint64_t red, green, blue, count;
+	};
+
+	std::vector<Voxel> voxels;
+	std::unordered_map<uint64_t, size_t> voxelIndex;
+	const int32_t size = (int32_t)voxelSize;
+
+	// neighbors usually fall in the same voxel, so the last one is checked before the map
+	uint64_t lastKey = UINT64_MAX;
+	size_t lastIndex = 0;
+
+	for (unsigned long row = 0; row < height; ++row)
+	{
+		const uint16_t* depthRow = (const uint16_t*)(depth.getData() + (size_t)row * depth.getLineSize());
+		DepthToXYZ(depthRow, &rays.x[(size_t)row * width], &rays.y[(size_t)row * width], width, millimetersPerUnit, xs.data(), ys.data(), zs.data());
+
+		const unsigned char* colorRow = withColor ? color->getData() + (size_t)(row * color->getHeight() / height) * color->getLineSize() : nullptr;
+		for (unsigned long x = 0; x < width; ++x)
+		{
+			if (zs[x] <= 0)
+				continue;
+
+			// 21 bits per axis is more than int16 millimeters need, even with 1 mm voxels
+			const uint64_t key = ((uint64_t)(VoxelOf(xs[x], size) & 0x1FFFFF) << 42) | ((uint64_t)(VoxelOf(ys[x], size) & 0x1FFFFF) << 21) |
+				(uint64_t)(VoxelOf(zs[x], size) & 0x1FFFFF);
+
+			if (key != lastKey)
+			{
+				std::pair<std::unordered_map<uint64_t, size_t>::iterator, bool> inserted = voxelIndex.emplace(key, voxels.size());
+				if (inserted.second)
+					voxels.push_back(Voxel{ 0, 0, 0, 0, 0, 0, 0 });
+
+				lastKey = key;
+				lastIndex = inserted.first->second;
+			}
+
+			Voxel& voxel = voxels[lastIndex];
+			voxel.x += xs[x];
+			voxel.y += ys[x];
+			voxel.z += zs[x];
+			++voxel.count;
+
+			if (withColor)
+			{
+				const unsigned char* pixel = colorRow + colorColumns[x];
+				voxel.red += pixel[red];
+				voxel.green += pixel[green];
+				voxel.blue += pixel[blue];
+			}
+		}
+	}
+
+	output.resize(voxels.size() * bytesPerPoint);
+	unsigned char* point = output.data();
+	for (const Voxel& voxel : voxels)
+	{
+		const int64_t count = (int64_t)voxel.count, half = count / 2;
+		point = WritePoint(point, (int16_t)((voxel.x + (voxel.x >= 0 ? half : -half)) / count),
+			(int16_t)((voxel.y + (voxel.y >= 0 ? half : -half)) / count), (int16_t)((voxel.z + half) / count));
+
+		if (format == Format::XYZRGB)
+		{
+			*point++ = (unsigned char)((voxel.red + voxel.count / 2) / voxel.count);
+			*point++ = (unsigned char)((voxel.green + voxel.count / 2) / voxel.count);
+			*point++ = (unsigned char)((voxel.blue + voxel.count / 2) / voxel.count);
+		}
+	}
+
+	return voxels.size();
+}
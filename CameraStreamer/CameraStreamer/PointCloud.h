@@ -0,0 +1,68 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "Frame.h"
+#include "StreamingProtocol.h"
+
+/**
+  PointCloud turns depth frames into points, so that clients get clouds that are
+  ready to be rendered instead of rebuilding them from depth every frame.
+
+  - XYZ: int16 x, y, z in millimeters (6 bytes per point)
+  - XYZRGB: int16 x, y, z in millimeters followed by uint8 r, g, b (9 bytes per point)
+
+  Points are in the camera's coordinate system (x right, y down, z forward), and
+  pixels without depth are skipped. Every pixel has a ray (x / z, y / z) that is
+  computed once from the intrinsics (see MakeRayTable), so a point is just its ray
+  times its depth. The kernel uses SSE2 when the compiler targets it.
+
+  Points can also be averaged into a voxel grid (one point per voxel), which is
+  what thin clients and slow links want: clouds shrink with the voxel size instead
+  of the depth resolution.
+*/
+class PointCloud
+{
+public:
+	enum class Format : unsigned char
+	{
+		None = 0,
+		XYZ = 1,
+		XYZRGB = 2
+	};
+
+	// parses the names clients use when subscribing ("xyz", "xyzrgb")
+	static bool FormatFromString(const std::string& name, Format& format);
+	static const char* FormatToString(Format format);
+
+	static size_t BytesPerPoint(Format format) { return (format == Format::XYZRGB) ? 9 : (format == Format::XYZ ? 6 : 0); }
+
+	// ray of every pixel of an image (x / z and y / z, row by row)
+	struct RayTable
+	{
+		unsigned long width, height;
+		std::vector<float> x, y;
+
+		RayTable() : width(0), height(0) {}
+	};
+
+	// undistorts every pixel of a width x height image (intrinsics have to be scaled to that size). nullptr without intrinsics
+	static std::shared_ptr<RayTable> MakeRayTable(const StreamingProtocol::IntrinsicsV2& intrinsics, unsigned long width, unsigned long height);
+
+	// depths to millimeters (saturated to int16). Uses SSE2 when available, and gives the same results either way
+	static void DepthToXYZ(const uint16_t* depth, const float* rayX, const float* rayY, size_t count, float millimetersPerUnit, int16_t* x, int16_t* y, int16_t* z);
+	static void DepthToXYZScalar(const uint16_t* depth, const float* rayX, const float* rayY, size_t count, float millimetersPerUnit, int16_t* x, int16_t* y, int16_t* z);
+	static bool HasSIMD();
+
+	// true if a color frame can be sampled for XYZRGB points (packed RGB encodings)
+	static bool CanSampleColor(const Frame& color);
+
+	// computes the points of a Mono16 depth frame into output (BytesPerPoint(format) bytes each). color is only used by
+	// XYZRGB and has to be registered to depth (same field of view, any size). voxelSize is in millimeters (0 keeps every point).
+	// returns the number of points
+	static size_t Compute(const Frame& depth, const Frame* color, const RayTable& rays, float millimetersPerUnit, Format format,
+		unsigned int voxelSize, std::vector<unsigned char>& output);
+};
@@ -1,29 +1,59 @@
-//
-// Warning: This is WIP. Not currently in use by our application
-//
-
 #pragma once
 
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <string>
+
 
 /**
-	PacketWriter classes are responsible for creating a network packet
+	PacketWriter classes are responsible for creating network packets
 	given a specific protocol implementation
+
+	Writers do not own sockets. They split a frame into packets and hand
+	each one to a PacketHandler, which sends it (e.g.: as a udp datagram).
+	Packets are a header followed by a payload that points straight into
+	the frame, so nothing is copied on the way to the socket.
 */
-class PacketWriter
+class PacketWriter : std::enable_shared_from_this<PacketWriter>
 {
+public:
+
+	// sends a packet (header and payload are only valid during the call). Returns false to stop sending the frame
+	typedef std::function<bool(const unsigned char* header, size_t headerLength, const unsigned char* payload, size_t payloadLength)> PacketHandler;
 
 protected:
 
 	// true if designed for a stream protocol such as TCP
 	bool streamProtocol;
 
-	// maximum transmission unit (todo: rtp, udp)
-	//int MTU;
+	// maximum transmission unit (largest packet a writer produces, headers included)
+	size_t MTU;
+
+	PacketWriter(bool streamProtocol, size_t MTU) : streamProtocol(streamProtocol), MTU(MTU) {}
 
 public:
 
-	bool isStreamProtocol() { return streamProtocol; }
+	virtual ~PacketWriter() {}
+
+	bool isStreamProtocol() const { return streamProtocol; }
+
+	size_t getMTU() const { return MTU; }
 
+	/// <summary>
+	/// Splits an encoded color frame into packets and hands them to send (in order)
+	/// </summary>
+	/// <param name="data">encoded frame</param>
+	/// <param name="dataLength">encoded frame length in bytes</param>
+	/// <param name="timestamp">when the frame was captured</param>
+	/// <param name="send">invoked once per packet</param>
+	/// <returns>true if every packet of the frame was handed to send</returns>
+	virtual bool WriteFrame(const unsigned char* data, size_t dataLength, std::chrono::microseconds timestamp, const PacketHandler& send) = 0;
 
+	/// <summary>
+	/// Returns a human readable string with the protocol name
+	/// </summary>
+	/// <returns></returns>
+	virtual const std::string ProtocolName() const = 0;
 
-};
\ No newline at end of file
+};
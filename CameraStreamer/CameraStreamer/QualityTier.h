@@ -0,0 +1,47 @@
+#pragma once
+
+#include <algorithm>
+#include <vector>
+
+/**
+  QualityTier describes how frames are encoded for clients that cannot keep up
+  with the full stream: a lower jpeg quality, smaller color and depth images,
+  and fewer frames per second.
+
+  Tier 0 is the stream as configured. Every tier after that costs less to encode
+  and to send than the one before it. Clients are moved between tiers by their
+  StreamingSession (see StreamingPreferences::maxQualityTier) depending on how
+  many messages they drop, and every tier is encoded once per frame no matter
+  how many clients are in it.
+*/
+struct QualityTier
+{
+	// jpeg quality (1-100)
+	int jpegQuality;
+
+	// color images are downscaled by this factor (1 means full resolution)
+	unsigned int downscale;
+
+	// only one out of every N x N depth samples is sent (1 means all of them)
+	unsigned int depthDecimation;
+
+	// frames skipped after every frame sent (0 means every frame is sent)
+	unsigned int frameSkip;
+
+	QualityTier(int jpegQuality = 95, unsigned int downscale = 1, unsigned int depthDecimation = 1, unsigned int frameSkip = 0) :
+		jpegQuality(jpegQuality), downscale(downscale), depthDecimation(depthDecimation), frameSkip(frameSkip) {}
+
+	// does this tier get a given frame?
+	bool SendsFrame(unsigned long long frameNumber) const { return frameNumber % (frameSkip + 1) == 0; }
+
+	// tiers used by the streaming server, starting with the configured jpeg quality
+	static std::vector<QualityTier> Ladder(int jpegQuality)
+	{
+		std::vector<QualityTier> tiers;
+		tiers.emplace_back(jpegQuality, 1, 1, 0);                  // as configured
+		tiers.emplace_back(std::min(jpegQuality, 75), 1, 1, 1);    // half the frame rate
+		tiers.emplace_back(std::min(jpegQuality, 60), 2, 2, 1);    // half the resolution
+		tiers.emplace_back(std::min(jpegQuality, 40), 4, 4, 2);    // a third of the frame rate at a quarter of the resolution
+		return tiers;
+	}
+};
@@ -1,5 +1,5 @@
 #include "RAWYUVProtocolReader.h"
-#include <libyuv.h>
+#include <cstring>
 
 
 
@@ -7,35 +7,22 @@ const char* RAWYUVProtocolReader::RAWYUVProtocolName = "RAWYUV420";
 
 bool RAWYUVProtocolReader::ParseFrame(const unsigned char* data, size_t dataLengthcalc)
 {
-	using namespace libyuv;
-	const unsigned int colorWidthHalf = colorFrameWidth >> 1;
-	const unsigned int colorHeightHalf = colorFrameHeight >> 1;
-	const uint64_t pixelsCount = (uint64_t) colorFrameWidth * (uint64_t) colorFrameHeight;
-	const uint64_t pixelsCountARGB = pixelsCount << 2;
-	const uint64_t pixelsCount4 = pixelsCount >> 2;
-
-	const unsigned char* frameY = data;
-	const unsigned char* frameU = data + pixelsCount;
-	const unsigned char* frameV = frameU + pixelsCount4;
-
-	// makes sure that I4202BGRA will not crash
-	if ((pixelsCount + pixelsCount4 + pixelsCount4) != dataLengthcalc)
+	// frames are kept in I420 (no conversion) - encoders and the recorder consume YUV directly
+	const size_t frameSize = FrameType::getFrameSize(FrameType::Encoding::I420, colorFrameWidth, colorFrameHeight);
+
+	// makes sure that we got a whole frame
+	if (frameSize == 0 || frameSize != dataLengthcalc)
 		return false;
 
-	// creates BGRA frame
-	lastColorFrame = Frame::Create(colorFrameWidth, colorFrameHeight, FrameType::Encoding::ARGB32);
+	// creates I420 frame (the network buffer is reused for the next frame, so data has to be copied)
+	lastColorFrame = Frame::Create(colorFrameWidth, colorFrameHeight, FrameType::Encoding::I420);
 
 	// makes sure that we have enough memory to write a frame
-	if (lastColorFrame && lastColorFrame->size() == pixelsCountARGB)
+	if (lastColorFrame && lastColorFrame->size() == frameSize)
 	{
-		I420ToARGB((const uint8_t*)frameY, colorFrameWidth,
-			(const uint8_t*)frameU, colorWidthHalf,
-			(const uint8_t*)frameV, colorWidthHalf,
-			lastColorFrame->getData(), colorFrameWidth << 2,
-			colorFrameWidth, colorFrameHeight);
-
+		memcpy(lastColorFrame->getData(), data, frameSize);
 		return true;
 	}
 
 	return false;
-}
\ No newline at end of file
+}
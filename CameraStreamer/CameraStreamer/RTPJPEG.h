@@ -0,0 +1,80 @@
+#pragma once
+
+#include <cstdint>
+#include <chrono>
+
+//
+// Constants shared by RTPJPEGPacketWriter and RTPJPEGProtocolReader (RTP payload format for JPEG - RFC 2435)
+//
+// Each packet is: [RTP header][JPEG header][restart marker header][quantization table header][scan data]
+// The restart marker header is only present when the JPEG uses restart markers, and quantization
+// tables only travel in the first packet of each frame.
+//
+namespace RTPJPEG
+{
+	// rtp version 2 without padding, extensions, or contributing sources
+	const uint8_t RTPVersion = 2;
+
+	// static payload type for JPEG (RFC 3551)
+	const uint8_t PayloadType = 26;
+
+	// rtp timestamps for video are expressed in a 90kHz clock
+	const uint32_t ClockRate = 90000;
+
+	const size_t RTPHeaderSize = 12;
+	const size_t JPEGHeaderSize = 8;
+	const size_t RestartMarkerHeaderSize = 4;
+	const size_t QuantizationTableHeaderSize = 4;
+
+	// types 0 and 1 describe how chroma is subsampled (types 64 and 65 are the same with restart markers)
+	const uint8_t Type422 = 0;
+	const uint8_t Type420 = 1;
+	const uint8_t TypeRestartMarkers = 64;
+
+	// Q values of 128 and above mean that quantization tables are sent in-band (255: they may change every frame)
+	const uint8_t QInBandTables = 128;
+	const uint8_t QDynamicTables = 255;
+
+	// width and height travel in blocks of 8 pixels (in one byte)
+	const unsigned int MaxDimension = 255 * 8;
+
+	inline uint32_t Timestamp(std::chrono::microseconds timestamp)
+	{
+		// (90000 / 1000000 = 9 / 100, which does not overflow for timestamps since epoch)
+		return (uint32_t)(timestamp.count() * 9 / 100);
+	}
+
+	inline void WriteUInt16(unsigned char* dest, uint16_t value)
+	{
+		dest[0] = (unsigned char)(value >> 8);
+		dest[1] = (unsigned char)(value);
+	}
+
+	inline void WriteUInt24(unsigned char* dest, uint32_t value)
+	{
+		dest[0] = (unsigned char)(value >> 16);
+		dest[1] = (unsigned char)(value >> 8);
+		dest[2] = (unsigned char)(value);
+	}
+
+	inline void WriteUInt32(unsigned char* dest, uint32_t value)
+	{
+		WriteUInt16(dest, (uint16_t)(value >> 16));
+		WriteUInt16(dest + 2, (uint16_t)value);
+	}
+
+	inline uint16_t ReadUInt16(const unsigned char* src)
+	{
+		return (uint16_t)((src[0] << 8) | src[1]);
+	}
+
+	inline uint32_t ReadUInt24(const unsigned char* src)
+	{
+		return ((uint32_t)src[0] << 16) | ((uint32_t)src[1] << 8) | src[2];
+	}
+
+	inline uint32_t ReadUInt32(const unsigned char* src)
+	{
+		return ((uint32_t)ReadUInt16(src) << 16) | ReadUInt16(src + 2);
+	}
+}
@@ -0,0 +1,218 @@
+#include "RTPJPEGPacketWriter.h"
+
+#include <algorithm>
+#include <cstring>
+#include <random>
+
+using namespace RTPJPEG;
+
+const char* RTPJPEGPacketWriter::RTPJPEGProtocolName = "RTPJPEG";
+
+RTPJPEGPacketWriter::RTPJPEGPacketWriter(size_t MTU) : PacketWriter(false, MTU)
+{
+	// RFC 3550 asks for random initial values (so that streams from different senders can be told apart)
+	std::random_device random;
+	sequenceNumber = (uint16_t)random();
+	ssrc = (uint32_t)random();
+
+	// largest header: first packet of a frame with restart markers
+	header.resize(RTPHeaderSize + JPEGHeaderSize + RestartMarkerHeaderSize + QuantizationTableHeaderSize + 2 * 64);
+}
+
+bool RTPJPEGPacketWriter::ParseJPEG(const unsigned char* data, size_t dataLength, JPEGInfo& info)
+{
+	// start of image
+	if (dataLength < 4 || data[0] != 0xFF || data[1] != 0xD8)
+		return false;
+
+	unsigned char tables[4][64];
+	bool tableFound[4] = { false, false, false, false };
+	int lumaTable = -1, chromaTable = -1;
+
+	info.restartInterval = 0;
+
+	// goes through all markers until the scan begins
+	size_t pos = 2;
+	while (pos + 4 <= dataLength)
+	{
+		if (data[pos] != 0xFF)
+			return false;
+
+		const uint8_t marker = data[pos + 1];
+
+		// fill bytes
+		if (marker == 0xFF)
+		{
+			++pos;
+			continue;
+		}
+
+		pos += 2;
+
+		// markers without a length
+		if (marker == 0x01 || (marker >= 0xD0 && marker <= 0xD7))
+			continue;
+
+		// end of image before any scan
+		if (marker == 0xD9)
+			return false;
+
+		const size_t length = ReadUInt16(data + pos);
+		if (length < 2 || pos + length > dataLength)
+			return false;
+
+		const unsigned char* segment = data + pos + 2;
+		const size_t segmentLength = length - 2;
+
+		switch (marker)
+		{
+		// quantization tables (only 8 bit tables can be sent)
+		case 0xDB:
+			for (size_t i = 0; i < segmentLength; i += 65)
+			{
+				if (i + 65 > segmentLength || (segment[i] >> 4) != 0 || (segment[i] & 0x0F) > 3)
+					return false;
+
+				memcpy(tables[segment[i] & 0x0F], segment + i + 1, 64);
+				tableFound[segment[i] & 0x0F] = true;
+			}
+			break;
+
+		// baseline (and extended sequential with 8 bit samples)
+		case 0xC0:
+		case 0xC1:
+		{
+			// Y, Cb, Cr
+			if (segmentLength < 15 || segment[0] != 8 || segment[5] != 3)
+				return false;
+
+			info.height = ReadUInt16(segment + 1);
+			info.width = ReadUInt16(segment + 3);
+
+			// components are [id][sampling factors][quantization table]
+			const unsigned char* y = segment + 6, *cb = segment + 9, *cr = segment + 12;
+
+			// Y sets the type, Cb and Cr cannot be subsampled and have to share a table
+			if (y[1] == 0x21)
+				info.type = Type422;
+			else if (y[1] == 0x22)
+				info.type = Type420;
+			else
+				return false;
+
+			if (cb[1] != 0x11 || cr[1] != 0x11 || cb[2] != cr[2] || y[2] > 3 || cb[2] > 3)
+				return false;
+
+			lumaTable = y[2];
+			chromaTable = cb[2];
+			break;
+		}
+
+		// progressive, lossless, arithmetic coding, ...
+		case 0xC2: case 0xC3: case 0xC5: case 0xC6: case 0xC7:
+		case 0xC9: case 0xCA: case 0xCB: case 0xCD: case 0xCE: case 0xCF:
+			return false;
+
+		// restart interval
+		case 0xDD:
+			if (segmentLength < 2)
+				return false;
+			info.restartInterval = ReadUInt16(segment);
+			break;
+
+		// start of scan: everything after its header is what we send
+		case 0xDA:
+		{
+			// a single interleaved scan
+			if (lumaTable < 0 || !tableFound[lumaTable] || !tableFound[chromaTable] || segmentLength < 1 || segment[0] != 3)
+				return false;
+
+			memcpy(info.quantizationTables[0], tables[lumaTable], 64);
+			memcpy(info.quantizationTables[1], tables[chromaTable], 64);
+
+			info.scan = segment + segmentLength;
+			info.scanLength = dataLength - (info.scan - data);
+
+			// receivers add the end of image marker
+			if (info.scanLength >= 2 && info.scan[info.scanLength - 2] == 0xFF && info.scan[info.scanLength - 1] == 0xD9)
+				info.scanLength -= 2;
+
+			// fragment offsets have 24 bits
+			return info.scanLength > 0 && info.scanLength < (1 << 24) &&
+				info.width > 0 && info.width <= MaxDimension && info.height > 0 && info.height <= MaxDimension;
+		}
+
+		// application data, comments, huffman tables (standard tables are assumed), ...
+		default:
+			break;
+		}
+
+		pos += length;
+	}
+
+	return false;
+}
+
+bool RTPJPEGPacketWriter::WriteFrame(const unsigned char* data, size_t dataLength, std::chrono::microseconds timestamp, const PacketHandler& send)
+{
+	JPEGInfo info;
+	if (!data || !ParseJPEG(data, dataLength, info))
+		return false;
+
+	const bool restartMarkers = info.restartInterval > 0;
+
+	// [RTP header] version, payload type (the marker bit is set on the last packet), sequence number, timestamp, ssrc
+	unsigned char* rtpHeader = &header[0];
+	rtpHeader[0] = RTPVersion << 6;
+	WriteUInt32(rtpHeader + 4, Timestamp(timestamp));
+	WriteUInt32(rtpHeader + 8, ssrc);
+
+	// [JPEG header] type specific, fragment offset, type, Q, width / 8, height / 8
+	unsigned char* jpegHeader = rtpHeader + RTPHeaderSize;
+	jpegHeader[0] = 0;
+	jpegHeader[4] = info.type | (restartMarkers ? TypeRestartMarkers : 0);
+	jpegHeader[5] = QDynamicTables;
+	jpegHeader[6] = (unsigned char)((info.width + 7) / 8);
+	jpegHeader[7] = (unsigned char)((info.height + 7) / 8);
+
+	size_t fixedHeaderLength = RTPHeaderSize + JPEGHeaderSize;
+
+	// [restart marker header] restart interval, first and last bits set (packets are not aligned with restart intervals), count
+	if (restartMarkers)
+	{
+		WriteUInt16(rtpHeader + fixedHeaderLength, info.restartInterval);
+		WriteUInt16(rtpHeader + fixedHeaderLength + 2, 0xFFFF);
+		fixedHeaderLength += RestartMarkerHeaderSize;
+	}
+
+	// [quantization table header] mbz, precision (8 bits), length, luma and chroma tables - first packet only
+	unsigned char* tableHeader = rtpHeader + fixedHeaderLength;
+	tableHeader[0] = 0;
+	tableHeader[1] = 0;
+	WriteUInt16(tableHeader + 2, sizeof(info.quantizationTables));
+	memcpy(tableHeader + QuantizationTableHeaderSize, info.quantizationTables, sizeof(info.quantizationTables));
+
+	const size_t firstHeaderLength = fixedHeaderLength + QuantizationTableHeaderSize + sizeof(info.quantizationTables);
+	if (MTU <= firstHeaderLength)
+		return false;
+
+	// scan data is split in as many packets as needed
+	size_t offset = 0;
+	while (offset < info.scanLength)
+	{
+		const size_t headerLength = (offset == 0) ? firstHeaderLength : fixedHeaderLength;
+		const size_t payloadLength = std::min(MTU - headerLength, info.scanLength - offset);
+		const bool lastPacket = (offset + payloadLength == info.scanLength);
+
+		rtpHeader[1] = PayloadType | (lastPacket ? 0x80 : 0);
+		WriteUInt16(rtpHeader + 2, sequenceNumber++);
+		WriteUInt24(jpegHeader + 1, (uint32_t)offset);
+
+		if (!send(rtpHeader, headerLength, info.scan + offset, payloadLength))
+			return false;
+
+		offset += payloadLength;
+	}
+
+	return true;
+}
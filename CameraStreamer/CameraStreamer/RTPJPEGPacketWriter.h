@@ -0,0 +1,65 @@
+#pragma once
+#include "ProtocolPacketWriter.h"
+#include "RTPJPEG.h"
+
+#include <memory>
+#include <vector>
+
+/**
+  RTPJPEGPacketWriter splits JPEG images into RTP packets (RFC 2435) that fit
+  in a single udp datagram each.
+
+  RFC 2435 does not carry JPEG headers: receivers rebuild them from a few
+  fields (type, size, quantization tables). Thus, only baseline JPEGs with
+  the standard huffman tables and YUV 4:2:0 or 4:2:2 subsampling can be
+  sent (that's what JPEGEncoder produces with "420" or "422" subsampling).
+  Images are limited to 2040x2040.
+
+  Quantization tables are sent in-band (Q = 255) with every frame, so quality
+  can change at any time.
+*/
+class RTPJPEGPacketWriter : public PacketWriter
+{
+private:
+	static const char* RTPJPEGProtocolName;
+
+	// rtp session state
+	uint16_t sequenceNumber;
+	uint32_t ssrc;
+
+	// what RFC 2435 needs to know about a JPEG image
+	struct JPEGInfo
+	{
+		uint8_t type;
+		unsigned int width, height;
+		uint16_t restartInterval;
+
+		// luma and chroma tables (zig-zag order, as found in the JPEG)
+		unsigned char quantizationTables[2][64];
+
+		// entropy coded data (what is actually sent)
+		const unsigned char* scan;
+		size_t scanLength;
+	};
+
+	// finds everything needed to send a JPEG (false if it can't be represented by RFC 2435)
+	static bool ParseJPEG(const unsigned char* data, size_t dataLength, JPEGInfo& info);
+
+	// packet header (reused for every packet)
+	std::vector<unsigned char> header;
+
+	RTPJPEGPacketWriter(size_t MTU);
+
+public:
+
+	static std::shared_ptr<PacketWriter> Create(size_t MTU)
+	{
+		return std::shared_ptr<PacketWriter>(new RTPJPEGPacketWriter(MTU));
+	}
+
+	virtual bool WriteFrame(const unsigned char* data, size_t dataLength, std::chrono::microseconds timestamp, const PacketHandler& send);
+
+	virtual const std::string ProtocolName() const { return RTPJPEGProtocolName; }
+
+	uint32_t GetSSRC() const { return ssrc; }
+};
@@ -0,0 +1,358 @@
+#include "RTPJPEGProtocolReader.h"
+
+#include <algorithm>
+#include <cstring>
+
+using namespace RTPJPEG;
+
+const char* RTPJPEGProtocolReader::RTPJPEGProtocolName = "RTPJPEG";
+
+//
+// Tables defined by the JPEG standard (Annex K) and used by RFC 2435
+//
+
+// quantization tables used to derive tables from Q (zig-zag order)
+static const unsigned char jpeg_luma_quantizer[64] = {
+	16, 11, 12, 14, 12, 10, 16, 14,
+	13, 14, 18, 17, 16, 19, 24, 40,
+	26, 24, 22, 22, 24, 49, 35, 37,
+	29, 40, 58, 51, 61, 60, 57, 51,
+	56, 55, 64, 72, 92, 78, 64, 68,
+	87, 69, 55, 56, 80, 109, 81, 87,
+	95, 98, 103, 104, 103, 62, 77, 113,
+	121, 112, 100, 120, 92, 101, 103, 99
+};
+
+static const unsigned char jpeg_chroma_quantizer[64] = {
+	17, 18, 18, 24, 21, 24, 47, 26,
+	26, 47, 99, 66, 56, 66, 99, 99,
+	99, 99, 99, 99, 99, 99, 99, 99,
+	99, 99, 99, 99, 99, 99, 99, 99,
+	99, 99, 99, 99, 99, 99, 99, 99,
+	99, 99, 99, 99, 99, 99, 99, 99,
+	99, 99, 99, 99, 99, 99, 99, 99,
+	99, 99, 99, 99, 99, 99, 99, 99
+};
+
+// huffman tables: number of codes of each length (1 to 16) followed by their symbols
+static const unsigned char lum_dc_codelens[16] = { 0, 1, 5, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0, 0, 0 };
+static const unsigned char lum_dc_symbols[12] = { 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11 };
+
+static const unsigned char lum_ac_codelens[16] = { 0, 2, 1, 3, 3, 2, 4, 3, 5, 5, 4, 4, 0, 0, 1, 0x7d };
+static const unsigned char lum_ac_symbols[162] = {
+	0x01, 0x02, 0x03, 0x00, 0x04, 0x11, 0x05, 0x12,
+	0x21, 0x31, 0x41, 0x06, 0x13, 0x51, 0x61, 0x07,
+	0x22, 0x71, 0x14, 0x32, 0x81, 0x91, 0xa1, 0x08,
+	0x23, 0x42, 0xb1, 0xc1, 0x15, 0x52, 0xd1, 0xf0,
+	0x24, 0x33, 0x62, 0x72, 0x82, 0x09, 0x0a, 0x16,
+	0x17, 0x18, 0x19, 0x1a, 0x25, 0x26, 0x27, 0x28,
+	0x29, 0x2a, 0x34, 0x35, 0x36, 0x37, 0x38, 0x39,
+	0x3a, 0x43, 0x44, 0x45, 0x46, 0x47, 0x48, 0x49,
+	0x4a, 0x53, 0x54, 0x55, 0x56, 0x57, 0x58, 0x59,
+	0x5a, 0x63, 0x64, 0x65, 0x66, 0x67, 0x68, 0x69,
+	0x6a, 0x73, 0x74, 0x75, 0x76, 0x77, 0x78, 0x79,
+	0x7a, 0x83, 0x84, 0x85, 0x86, 0x87, 0x88, 0x89,
+	0x8a, 0x92, 0x93, 0x94, 0x95, 0x96, 0x97, 0x98,
+	0x99, 0x9a, 0xa2, 0xa3, 0xa4, 0xa5, 0xa6, 0xa7,
+	0xa8, 0xa9, 0xaa, 0xb2, 0xb3, 0xb4, 0xb5, 0xb6,
+	0xb7, 0xb8, 0xb9, 0xba, 0xc2, 0xc3, 0xc4, 0xc5,
+	0xc6, 0xc7, 0xc8, 0xc9, 0xca, 0xd2, 0xd3, 0xd4,
+	0xd5, 0xd6, 0xd7, 0xd8, 0xd9, 0xda, 0xe1, 0xe2,
+	0xe3, 0xe4, 0xe5, 0xe6, 0xe7, 0xe8, 0xe9, 0xea,
+	0xf1, 0xf2, 0xf3, 0xf4, 0xf5, 0xf6, 0xf7, 0xf8,
+	0xf9, 0xfa
+};
+
+static const unsigned char chm_dc_codelens[16] = { 0, 3, 1, 1, 1, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0 };
+static const unsigned char chm_dc_symbols[12] = { 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11 };
+
+static const unsigned char chm_ac_codelens[16] = { 0, 2, 1, 2, 4, 4, 3, 4, 7, 5, 4, 4, 0, 1, 2, 0x77 };
+static const unsigned char chm_ac_symbols[162] = {
+	0x00, 0x01, 0x02, 0x03, 0x11, 0x04, 0x05, 0x21,
+	0x31, 0x06, 0x12, 0x41, 0x51, 0x07, 0x61, 0x71,
+	0x13, 0x22, 0x32, 0x81, 0x08, 0x14, 0x42, 0x91,
+	0xa1, 0xb1, 0xc1, 0x09, 0x23, 0x33, 0x52, 0xf0,
+	0x15, 0x62, 0x72, 0xd1, 0x0a, 0x16, 0x24, 0x34,
+	0xe1, 0x25, 0xf1, 0x17, 0x18, 0x19, 0x1a, 0x26,
+	0x27, 0x28, 0x29, 0x2a, 0x35, 0x36, 0x37, 0x38,
+	0x39, 0x3a, 0x43, 0x44, 0x45, 0x46, 0x47, 0x48,
+	0x49, 0x4a, 0x53, 0x54, 0x55, 0x56, 0x57, 0x58,
+	0x59, 0x5a, 0x63, 0x64, 0x65, 0x66, 0x67, 0x68,
+	0x69, 0x6a, 0x73, 0x74, 0x75, 0x76, 0x77, 0x78,
+	0x79, 0x7a, 0x82, 0x83, 0x84, 0x85, 0x86, 0x87,
+	0x88, 0x89, 0x8a, 0x92, 0x93, 0x94, 0x95, 0x96,
+	0x97, 0x98, 0x99, 0x9a, 0xa2, 0xa3, 0xa4, 0xa5,
+	0xa6, 0xa7, 0xa8, 0xa9, 0xaa, 0xb2, 0xb3, 0xb4,
+	0xb5, 0xb6, 0xb7, 0xb8, 0xb9, 0xba, 0xc2, 0xc3,
+	0xc4, 0xc5, 0xc6, 0xc7, 0xc8, 0xc9, 0xca, 0xd2,
+	0xd3, 0xd4, 0xd5, 0xd6, 0xd7, 0xd8, 0xd9, 0xda,
+	0xe2, 0xe3, 0xe4, 0xe5, 0xe6, 0xe7, 0xe8, 0xe9,
+	0xea, 0xf2, 0xf3, 0xf4, 0xf5, 0xf6, 0xf7, 0xf8,
+	0xf9, 0xfa
+};
+
+// appends a marker and its length (length includes itself)
+static void AppendMarker(std::vector<unsigned char>& dest, uint8_t marker, size_t length)
+{
+	dest.push_back(0xFF);
+	dest.push_back(marker);
+	dest.push_back((unsigned char)(length >> 8));
+	dest.push_back((unsigned char)length);
+}
+
+static void AppendHuffmanTable(std::vector<unsigned char>& dest, const unsigned char* codelens, const unsigned char* symbols, size_t symbolCount, uint8_t tableClass, uint8_t tableId)
+{
+	AppendMarker(dest, 0xC4, 3 + 16 + symbolCount);
+	dest.push_back((tableClass << 4) | tableId);
+	dest.insert(dest.end(), codelens, codelens + 16);
+	dest.insert(dest.end(), symbols, symbols + symbolCount);
+}
+
+void RTPJPEGProtocolReader::MakeQuantizationTables(uint8_t q)
+{
+	int factor = std::min(std::max((int)q, 1), 99);
+	factor = (factor < 50) ? 5000 / factor : 200 - factor * 2;
+
+	for (int i = 0; i < 64; ++i)
+	{
+		quantizationTables[0][i] = (unsigned char)std::min(std::max((jpeg_luma_quantizer[i] * factor + 50) / 100, 1), 255);
+		quantizationTables[1][i] = (unsigned char)std::min(std::max((jpeg_chroma_quantizer[i] * factor + 50) / 100, 1), 255);
+	}
+
+	quantizationTablesQ = q;
+}
+
+void RTPJPEGProtocolReader::MakeHeaders()
+{
+	jpegHeaders.clear();
+
+	// start of image
+	jpegHeaders.push_back(0xFF);
+	jpegHeaders.push_back(0xD8);
+
+	// quantization tables (luma is 0, chroma is 1)
+	AppendMarker(jpegHeaders, 0xDB, 2 + 2 * 65);
+	for (uint8_t table = 0; table < 2; ++table)
+	{
+		jpegHeaders.push_back(table);
+		jpegHeaders.insert(jpegHeaders.end(), quantizationTables[table], quantizationTables[table] + 64);
+	}
+
+	// frame: 8 bits, height, width, 3 components ([id][sampling factors][quantization table])
+	AppendMarker(jpegHeaders, 0xC0, 17);
+	jpegHeaders.push_back(8);
+	jpegHeaders.push_back((unsigned char)(height >> 8));
+	jpegHeaders.push_back((unsigned char)height);
+	jpegHeaders.push_back((unsigned char)(width >> 8));
+	jpegHeaders.push_back((unsigned char)width);
+	jpegHeaders.push_back(3);
+
+	const unsigned char components[9] = {
+		0, (unsigned char)(((type & ~TypeRestartMarkers) == Type422) ? 0x21 : 0x22), 0,
+		1, 0x11, 1,
+		2, 0x11, 1
+	};
+	jpegHeaders.insert(jpegHeaders.end(), components, components + 9);
+
+	// restart interval
+	if (restartInterval > 0)
+	{
+		AppendMarker(jpegHeaders, 0xDD, 4);
+		jpegHeaders.push_back((unsigned char)(restartInterval >> 8));
+		jpegHeaders.push_back((unsigned char)restartInterval);
+	}
+
+	// standard huffman tables
+	AppendHuffmanTable(jpegHeaders, lum_dc_codelens, lum_dc_symbols, sizeof(lum_dc_symbols), 0, 0);
+	AppendHuffmanTable(jpegHeaders, lum_ac_codelens, lum_ac_symbols, sizeof(lum_ac_symbols), 1, 0);
+	AppendHuffmanTable(jpegHeaders, chm_dc_codelens, chm_dc_symbols, sizeof(chm_dc_symbols), 0, 1);
+	AppendHuffmanTable(jpegHeaders, chm_ac_codelens, chm_ac_symbols, sizeof(chm_ac_symbols), 1, 1);
+
+	// scan: 3 components ([id][dc table | ac table]), spectral selection 0 to 63, no approximation
+	AppendMarker(jpegHeaders, 0xDA, 12);
+	const unsigned char scanComponents[10] = { 3, 0, 0x00, 1, 0x11, 2, 0x11, 0, 63, 0 };
+	jpegHeaders.insert(jpegHeaders.end(), scanComponents, scanComponents + 10);
+}
+
+void RTPJPEGProtocolReader::DropFrame()
+{
+	if (frameInProgress)
+		++framesDropped;
+
+	frameInProgress = false;
+	frameBroken = false;
+	scan.clear();
+}
+
+bool RTPJPEGProtocolReader::ParseHeader(const unsigned char* header, size_t headerLength)
+{
+	// sanity check
+	if (headerLength < FixedHeaderSize()) return false;
+
+	// rtp version 2 carrying jpeg
+	return (header[0] >> 6) == RTPVersion && (header[1] & 0x7F) == PayloadType;
+}
+
+bool RTPJPEGProtocolReader::ParseFrame(const unsigned char* data, size_t dataLength)
+{
+	if (!ParseHeader(data, dataLength))
+		return false;
+
+	//
+	// [RTP header]
+	//
+
+	const bool padding = (data[0] & 0x20) != 0;
+	const bool extension = (data[0] & 0x10) != 0;
+	const size_t contributingSources = data[0] & 0x0F;
+	const bool lastPacket = (data[1] & 0x80) != 0;
+	const uint32_t timestamp = ReadUInt32(data + 4);
+
+	size_t pos = RTPHeaderSize + 4 * contributingSources;
+
+	if (extension)
+	{
+		if (pos + 4 > dataLength) return false;
+		pos += 4 + 4 * (size_t)ReadUInt16(data + pos + 2);
+	}
+
+	if (padding)
+	{
+		if (data[dataLength - 1] > dataLength) return false;
+		dataLength -= data[dataLength - 1];
+	}
+
+	if (pos + JPEGHeaderSize > dataLength)
+		return false;
+
+	// packets from a new frame? (whatever was left of the previous one is not coming)
+	if (!frameInProgress || timestamp != frameTimestamp)
+	{
+		DropFrame();
+		frameInProgress = true;
+		frameTimestamp = timestamp;
+	}
+
+	// waits for the next frame
+	if (frameBroken)
+	{
+		if (lastPacket)
+			DropFrame();
+		return false;
+	}
+
+	//
+	// [JPEG header]
+	//
+
+	const unsigned char* jpegHeader = data + pos;
+	const uint8_t typeSpecific = jpegHeader[0];
+	const uint32_t fragmentOffset = ReadUInt24(jpegHeader + 1);
+	const uint8_t packetType = jpegHeader[4];
+	const uint8_t packetQ = jpegHeader[5];
+	pos += JPEGHeaderSize;
+
+	// packets have to arrive in order and none can be missing (interlaced and custom types are not supported)
+	if (fragmentOffset != scan.size() || typeSpecific != 0 || (packetType & ~TypeRestartMarkers) > Type420)
+	{
+		frameBroken = true;
+		if (lastPacket)
+			DropFrame();
+		return false;
+	}
+
+	// [restart marker header]
+	uint16_t packetRestartInterval = 0;
+	if (packetType & TypeRestartMarkers)
+	{
+		if (pos + RestartMarkerHeaderSize > dataLength) return false;
+		packetRestartInterval = ReadUInt16(data + pos);
+		pos += RestartMarkerHeaderSize;
+	}
+
+	// the first packet describes the frame
+	if (fragmentOffset == 0)
+	{
+		type = packetType;
+		q = packetQ;
+		width = jpegHeader[6] * 8;
+		height = jpegHeader[7] * 8;
+		restartInterval = packetRestartInterval;
+
+		// [quantization table header]
+		if (q >= QInBandTables)
+		{
+			if (pos + QuantizationTableHeaderSize > dataLength) return false;
+
+			const uint8_t precision = data[pos + 1];
+			const size_t length = ReadUInt16(data + pos + 2);
+			pos += QuantizationTableHeaderSize;
+
+			if (pos + length > dataLength) return false;
+
+			if (length > 0)
+			{
+				// only 8 bit tables (luma and chroma, or a single table for both)
+				if (precision != 0 || (length != 64 && length != 128))
+				{
+					frameBroken = true;
+					return false;
+				}
+
+				memcpy(quantizationTables[0], data + pos, 64);
+				memcpy(quantizationTables[1], data + pos + length - 64, 64);
+				quantizationTablesQ = q;
+				pos += length;
+			}
+			else if (quantizationTablesQ != q)
+			{
+				// tables were never sent
+				frameBroken = true;
+				return false;
+			}
+		}
+		else if (quantizationTablesQ != q)
+		{
+			MakeQuantizationTables(q);
+		}
+	}
+
+	scan.insert(scan.end(), data + pos, data + dataLength);
+
+	if (!lastPacket)
+		return false;
+
+	//
+	// got a whole frame: [headers][scan][end of image]
+	//
+
+	frameInProgress = false;
+
+	if (width == 0 || height == 0)
+	{
+		++framesDropped;
+		scan.clear();
+		return false;
+	}
+
+	MakeHeaders();
+
+	lastColorFrame = Frame::Create(width, height, (unsigned long)(jpegHeaders.size() + scan.size() + 2), FrameType::Encoding::MJPEG);
+	unsigned char* jpeg = lastColorFrame->getData();
+	memcpy(jpeg, jpegHeaders.data(), jpegHeaders.size());
+	memcpy(jpeg + jpegHeaders.size(), scan.data(), scan.size());
+	jpeg[jpegHeaders.size() + scan.size()] = 0xFF;
+	jpeg[jpegHeaders.size() + scan.size() + 1] = 0xD9;
+
+	scan.clear();
+
+	colorFrameAvailable = true;
+	colorFrameWidth = width;
+	colorFrameHeight = height;
+	networkFrameSize = lastColorFrame->size();
+
+	// no capture timestamp is available for this protocol (rtp timestamps have a different origin)
+	lastFrameTimestamp = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::high_resolution_clock::now().time_since_epoch());
+
+	return true;
+}
@@ -0,0 +1,86 @@
+#pragma once
+#include "ProtocolPacketReader.h"
+#include "RTPJPEG.h"
+
+#include <memory>
+#include <string>
+#include <vector>
+
+/**
+  RTPJPEGProtocolReader puts JPEG images sent over RTP (RFC 2435) back together
+  (e.g.: frames multicast by RTPMulticastSender).
+
+  Unlike stream protocols, every datagram is a packet on its own: call ParseHeader
+  and then ParseFrame for each datagram received. ParseFrame returns true when the
+  last packet of a frame arrives and the whole frame is available (as a JPEG with
+  custom encoding) through getLastColorFrame(). Frames missing packets are dropped.
+
+  Other RFC 2435 senders (e.g.: ffmpeg, gstreamer) should work as long as they send
+  progressive (not interlaced) images of type 0 or 1.
+*/
+class RTPJPEGProtocolReader : public ProtocolPacketReader
+{
+private:
+	static const char* RTPJPEGProtocolName;
+
+	// frame being put back together
+	bool frameInProgress, frameBroken;
+	uint32_t frameTimestamp;
+
+	// what was announced in the first packet of the frame
+	uint8_t type, q;
+	unsigned int width, height;
+	uint16_t restartInterval;
+
+	// luma and chroma tables (zig-zag order). Tables sent in-band are kept for frames that do not resend them
+	unsigned char quantizationTables[2][64];
+	uint8_t quantizationTablesQ;
+
+	// entropy coded data received so far
+	std::vector<unsigned char> scan;
+
+	// jpeg headers rebuilt for every frame
+	std::vector<unsigned char> jpegHeaders;
+
+	unsigned long long framesDropped;
+
+	// computes tables for Q values between 1 and 99 (RFC 2435 - Appendix A)
+	void MakeQuantizationTables(uint8_t q);
+
+	// rebuilds the headers that were stripped by the sender (RFC 2435 - Appendix B)
+	void MakeHeaders();
+
+	// gives up on the frame being received
+	void DropFrame();
+
+	RTPJPEGProtocolReader() : frameInProgress(false), frameBroken(false), frameTimestamp(0), type(0), q(0), width(0), height(0),
+		restartInterval(0), quantizationTablesQ(0), framesDropped(0)
+	{
+	}
+
+public:
+
+	static std::shared_ptr<ProtocolPacketReader> Create()
+	{
+		return std::shared_ptr<ProtocolPacketReader>(new RTPJPEGProtocolReader());
+	}
+
+	// headers are part of every datagram
+	virtual bool HasFixedHeaderSize() const { return false; }
+	virtual size_t FixedHeaderSize() const { return RTPJPEG::RTPHeaderSize + RTPJPEG::JPEGHeaderSize; }
+
+	// checks that a datagram is an RTP/JPEG packet
+	virtual bool ParseHeader(const unsigned char* header, size_t headerLength);
+
+	// rfc 2435 only supports color
+	virtual bool supportsDepth() const { return false; }
+	virtual bool supportsColor() const { return true; }
+
+	// adds a datagram to the frame being received (true once a frame is complete)
+	virtual bool ParseFrame(const unsigned char* data, size_t dataLength);
+
+	virtual const std::string ProtocolName() const { return RTPJPEGProtocolName; }
+
+	// frames that were incomplete (lost or reordered packets)
+	unsigned long long getFramesDropped() const { return framesDropped; }
+};
@@ -0,0 +1,146 @@
+#pragma once
+
+#include "CompilerConfiguration.h"
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <string>
+#include <boost/asio.hpp>
+
+#include "Logger.h"
+#include "RTPJPEGPacketWriter.h"
+
+using boost::asio::ip::udp;
+
+/**
+  RTPMulticastSender sends JPEG frames to a multicast group as RTP packets (RFC 2435),
+  so every machine that joins the group gets the same datagrams. Egress does not
+  grow with the number of receivers (see UDPMulticastRelayCamera for the other end).
+
+  Frames are packetized and sent on a strand of the io_context it was created with,
+  in the order they were handed over. Sending a frame never waits for a receiver:
+  datagrams that do not make it are simply lost (and so is the frame they belong to).
+  If frames arrive faster than they can be sent, the newest ones are dropped.
+*/
+class RTPMulticastSender
+{
+	udp::socket socket;
+	udp::endpoint group;
+
+	// frames are sent one at a time, in order
+	boost::asio::strand<boost::asio::io_context::executor_type> strand;
+
+	std::shared_ptr<PacketWriter> packetWriter;
+
+	// frames handed over but not sent yet
+	std::atomic<unsigned int> framesPending;
+
+	// statistics (written on the strand)
+	unsigned long long framesSent, packetsSent, bytesSent;
+	std::atomic<unsigned long long> framesDropped;
+
+	// only complains once about frames that cannot be sent
+	bool warnedUnsupportedFrame;
+
+	// a frame is sent as soon as the previous one is done, so one frame waiting is enough
+	static const unsigned int MaxFramesPending = 2;
+
+	void SendFrame(std::shared_ptr<const void> owner, const unsigned char* data, size_t length, std::chrono::microseconds timestamp)
+	{
+		boost::system::error_code error;
+		const bool sent = packetWriter->WriteFrame(data, length, timestamp,
+			[this, &error](const unsigned char* header, size_t headerLength, const unsigned char* payload, size_t payloadLength)
+			{
+				const std::array<boost::asio::const_buffer, 2> packet = { boost::asio::buffer(header, headerLength), boost::asio::buffer(payload, payloadLength) };
+				bytesSent += socket.send_to(packet, group, 0, error);
+				++packetsSent;
+				return !error;
+			});
+
+		--framesPending;
+
+		if (sent)
+		{
+			++framesSent;
+			return;
+		}
+
+		++framesDropped;
+
+		if (error)
+		{
+			Logger::Log("Multicast") << "Error sending frame: " << error.message() << std::endl;
+		}
+		else if (!warnedUnsupportedFrame)
+		{
+			Logger::Log("Multicast") << "Warning! Frames cannot be sent over RTP/JPEG. It needs baseline JPEGs with 420 or 422 subsampling and at most "
+				<< RTPJPEG::MaxDimension << 'x' << RTPJPEG::MaxDimension << " pixels" << std::endl;
+			warnedUnsupportedFrame = true;
+		}
+	}
+
+public:
+	RTPMulticastSender(boost::asio::io_context& io_context, const std::string& groupAddress, int port, int ttl, bool loopback, size_t MTU,
+		const std::string& interfaceAddress = std::string()) : socket(io_context), group(boost::asio::ip::make_address(groupAddress), port),
+		strand(boost::asio::make_strand(io_context)), packetWriter(RTPJPEGPacketWriter::Create(MTU)), framesPending(0),
+		framesSent(0), packetsSent(0), bytesSent(0), framesDropped(0), warnedUnsupportedFrame(false)
+	{
+		socket.open(group.protocol());
+		socket.set_option(boost::asio::ip::multicast::hops(ttl));
+		socket.set_option(boost::asio::ip::multicast::enable_loopback(loopback));
+
+		// room for a few frames worth of datagrams (a frame is sent in a burst)
+		boost::system::error_code error;
+		socket.set_option(boost::asio::socket_base::send_buffer_size(4 * 1024 * 1024), error);
+
+		if (!interfaceAddress.empty())
+			socket.set_option(boost::asio::ip::multicast::outbound_interface(boost::asio::ip::make_address_v4(interfaceAddress)));
+
+		Logger::Log("Multicast") << "Sending " << packetWriter->ProtocolName() << " to " << group.address().to_string() << ':' << group.port()
+			<< " (mtu " << MTU << ", ttl " << ttl << ')' << std::endl;
+	}
+
+	~RTPMulticastSender()
+	{
+		Close();
+	}
+
+	// sends a jpeg frame from any thread (owner has to keep data valid for as long as it is alive)
+	void Post(std::shared_ptr<const void> owner, const unsigned char* data, size_t length, std::chrono::microseconds timestamp)
+	{
+		if (!data || !length)
+			return;
+
+		// falling behind?
+		if (++framesPending > MaxFramesPending)
+		{
+			--framesPending;
+			++framesDropped;
+			return;
+		}
+
+		boost::asio::post(strand, std::bind(&RTPMulticastSender::SendFrame, this, owner, data, length, timestamp));
+	}
+
+	// statistics (only accurate while the io_context is not running)
+	unsigned long long GetFramesSent() const { return framesSent; }
+	unsigned long long GetFramesDropped() const { return framesDropped; }
+	unsigned long long GetPacketsSent() const { return packetsSent; }
+	unsigned long long GetBytesSent() const { return bytesSent; }
+
+	// closes the socket (the io_context should not be running)
+	void Close()
+	{
+		if (!socket.is_open())
+			return;
+
+		boost::system::error_code error;
+		socket.close(error);
+
+		Logger::Log("Multicast") << "[Stats] Sent " << group.address().to_string() << ':' << group.port() << " --> " << bytesSent << " bytes ("
+			<< framesSent << " frames in " << packetsSent << " packets sent and " << framesDropped << " frames dropped)" << std::endl;
+	}
+};
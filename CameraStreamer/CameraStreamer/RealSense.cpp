@@ -303,13 +303,9 @@ void RealSense::CameraLoop()
 							// get color frame
 							rs2::video_frame colorFrame = capture.get_color_frame();
 
-							// copies image to our very own frame
-							sharedColorFrame = Frame::Create(colorFrame.get_width(), colorFrame.get_height(), FrameType::Encoding::BGR24);
-							if (!sharedColorFrame)
-								throw std::bad_alloc();
-
+							// wraps the image without copying it (the frame holds a reference to the rs2::frame)
+							sharedColorFrame = Frame::Wrap(colorFrame.get_width(), colorFrame.get_height(), FrameType::Encoding::BGR24, const_cast<void*>(colorFrame.get_data()), rs2::frame(colorFrame));
 							assert(colorFrame.get_data_size() == sharedColorFrame->size()); // sanity check for debugging
-							memcpy(sharedColorFrame->data, colorFrame.get_data(), sharedColorFrame->size());
 						}
 
 						// get depth frame
@@ -325,12 +321,8 @@ void RealSense::CameraLoop()
 							//filteredDepthFrame = temp_filter->process(filteredDepthFrame);
 							//filteredDepthFrame = disparity_to_depth->process(filteredDepthFrame);
 
-							sharedDepthFrame = Frame::Create(depthFrame.get_width(), depthFrame.get_height(), FrameType::Encoding::Mono16);
-							if (!sharedDepthFrame)
-								throw std::bad_alloc();
-
-							assert(depthFrame.get_data_size() == sharedDepthFrame->size()); // sanity check for debugging
-							memcpy(sharedDepthFrame->data, depthFrame.get_data(), sharedDepthFrame->size());
+							sharedDepthFrame = Frame::Wrap(filteredDepthFrame.get_width(), filteredDepthFrame.get_height(), FrameType::Encoding::Mono16, const_cast<void*>(filteredDepthFrame.get_data()), rs2::frame(filteredDepthFrame));
+							assert(filteredDepthFrame.get_data_size() == sharedDepthFrame->size()); // sanity check for debugging
 						}
 
 						// invoke callback
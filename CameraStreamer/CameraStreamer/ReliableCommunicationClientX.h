@@ -1,5 +1,7 @@
 #pragma once
 
+#include "CompilerConfiguration.h"
+
 #include <chrono>
 #include <queue>
 #include <tuple>
@@ -1,6 +1,8 @@
 #pragma once
 
 
+#include "CompilerConfiguration.h"
+
 #include <iostream>
 #include <functional>
 #include <memory>
@@ -119,7 +121,8 @@ public:
 		std::function<void(std::shared_ptr<RemoteClient>, const rapidjson::Document&)> stopRecordingCallback,
 		std::function<void(std::shared_ptr<RemoteClient>, const rapidjson::Document&)> shutdownCallback,
 		std::function<void(std::shared_ptr<RemoteClient>, const rapidjson::Document&)> changeExposureCallback,
-		std::function<void(std::shared_ptr<RemoteClient>, const rapidjson::Document&)> changeGainCallback) : appStatus(appStatus), io_context(),
+		std::function<void(std::shared_ptr<RemoteClient>, const rapidjson::Document&)> changeGainCallback,
+		std::function<void(std::shared_ptr<RemoteClient>, const rapidjson::Document&)> getLatestFrameCallback) : appStatus(appStatus), io_context(),
 		acceptor(io_context, tcp::endpoint(tcp::v4(), appStatus->GetControlPort()))
 	{
 		using namespace std::placeholders; // for  _1, _2, ...
@@ -130,6 +133,7 @@ public:
 		remoteCommandsCallbacks["shutdown"] = shutdownCallback;
 		remoteCommandsCallbacks["changeExposure"] = changeExposureCallback;
 		remoteCommandsCallbacks["changeGain"] = changeGainCallback;
+		remoteCommandsCallbacks["getLatestFrame"] = getLatestFrameCallback;
 		remoteCommandsCallbacks["ping"] = std::bind(&RemoteControlServer::pingRequest, this, _1, _2);
 	};
 
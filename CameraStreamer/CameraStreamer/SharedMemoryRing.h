@@ -0,0 +1,416 @@
+#pragma once
+
+// SharedMemoryRing.h
+// Header only so that consumers (recorders, viewers, ...) can read frames from CameraStreamer
+// by including this file alone (it only depends on boost).
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <boost/interprocess/mapped_region.hpp>
+#include <boost/interprocess/sync/interprocess_condition.hpp>
+#include <boost/interprocess/sync/interprocess_mutex.hpp>
+#include <boost/interprocess/sync/scoped_lock.hpp>
+#include <boost/date_time/posix_time/posix_time_types.hpp>
+
+#ifdef _WIN32
+#include <boost/interprocess/windows_shared_memory.hpp>
+#else
+#include <boost/interprocess/shared_memory_object.hpp>
+#endif
+
+/*
+  Memory layout of a shared memory ring:
+
+  [SharedMemoryRingHeader][slot 0][slot 1]...[slot N-1]
+
+  Every slot is a SharedMemorySlotHeader followed by the color and depth pixels.
+  Slots are written in a round robin fashion: frame n goes into slot n % N.
+
+  Slots are protected by a sequence number (seqlock): it is 0 while the writer is
+  copying a frame into it and the frame number once the frame is ready. Readers
+  check the sequence number before and after touching a slot to know whether
+  the writer overwrote it in the meantime (see SharedMemoryRingReader::IsValid).
+
+  A writer that goes away (e.g.: the camera reconnected with a different resolution)
+  sets closed in the header first. Readers that see it open the ring again by name.
+*/
+
+static const uint32_t SharedMemoryRingMagic = 0x52534d43; // "CMSR"
+static const uint32_t SharedMemoryRingVersion = 2;
+
+// slots and pixels start at cache line boundaries
+static const size_t SharedMemoryRingAlignment = 64;
+
+static_assert(std::atomic<uint64_t>::is_always_lock_free, "shared memory rings need lock free 64 bit atomics");
+
+struct SharedMemoryRingHeader
+{
+	uint32_t magic;
+	uint32_t version;
+	uint32_t slotCount;
+
+	// set once the writer is done with the ring (readers have to open it again)
+	std::atomic<uint32_t> closed;
+
+	// bytes per slot (header included)
+	uint64_t slotSize;
+
+	// last frame published (0 if nothing was published yet)
+	std::atomic<uint64_t> lastSequence;
+
+	// readers wait on frameAvailable for new frames
+	boost::interprocess::interprocess_mutex mutex;
+	boost::interprocess::interprocess_condition frameAvailable;
+};
+
+// where an image is in a slot (size is 0 if the stream is not available)
+struct SharedMemoryImage
+{
+	uint32_t width, height;
+	uint32_t encoding;		// FrameType::Encoding
+	uint32_t stride;		// bytes per line of the first plane
+	uint64_t offset;		// from the beginning of the slot
+	uint64_t size;
+};
+
+struct SharedMemorySlotHeader
+{
+	std::atomic<uint64_t> sequence;
+
+	// when the frame was published (microseconds since epoch)
+	int64_t timestamp;
+
+	SharedMemoryImage color, depth;
+};
+
+inline size_t SharedMemoryRingAlign(size_t value)
+{
+	return (value + SharedMemoryRingAlignment - 1) & ~(SharedMemoryRingAlignment - 1);
+}
+
+inline size_t SharedMemoryRingSize(size_t slotCount, size_t slotSize)
+{
+	return SharedMemoryRingAlign(sizeof(SharedMemoryRingHeader)) + slotCount * slotSize;
+}
+
+// bytes needed by a slot that holds images of a given size
+inline size_t SharedMemoryRingSlotSize(size_t maxColorSize, size_t maxDepthSize)
+{
+	return SharedMemoryRingAlign(sizeof(SharedMemorySlotHeader)) + SharedMemoryRingAlign(maxColorSize) + SharedMemoryRingAlign(maxDepthSize);
+}
+
+// shared memory segments are named objects on Windows and files in /dev/shm on other platforms
+#ifdef _WIN32
+typedef boost::interprocess::windows_shared_memory SharedMemorySegment;
+#else
+typedef boost::interprocess::shared_memory_object SharedMemorySegment;
+#endif
+
+/**
+  SharedMemoryRingWriter creates a ring and publishes frames into it.
+
+  The ring goes away when the writer is destroyed (on Windows, it lives
+  until the last reader closes it).
+*/
+class SharedMemoryRingWriter
+{
+	std::string name;
+	SharedMemorySegment segment;
+	boost::interprocess::mapped_region region;
+
+	SharedMemoryRingHeader* header;
+	unsigned char* slots;
+	uint64_t nextSequence;
+
+	SharedMemorySlotHeader* Slot(uint64_t sequence)
+	{
+		return (SharedMemorySlotHeader*)(slots + (sequence % header->slotCount) * header->slotSize);
+	}
+
+public:
+	// throws boost::interprocess::interprocess_exception if the ring cannot be created
+	SharedMemoryRingWriter(const std::string& name, size_t slotCount, size_t slotSize) : name(name), header(nullptr), slots(nullptr), nextSequence(1)
+	{
+		using namespace boost::interprocess;
+
+		slotSize = SharedMemoryRingAlign(slotSize);
+		const size_t totalSize = SharedMemoryRingSize(slotCount, slotSize);
+
+#ifdef _WIN32
+		segment = windows_shared_memory(create_only, name.c_str(), read_write, totalSize);
+#else
+		// leftovers from a writer that crashed
+		shared_memory_object::remove(name.c_str());
+		segment = shared_memory_object(create_only, name.c_str(), read_write);
+		segment.truncate(totalSize);
+#endif
+		region = mapped_region(segment, read_write);
+
+		// readers ignore the ring until the magic number is there
+		header = new (region.get_address()) SharedMemoryRingHeader();
+		header->version = SharedMemoryRingVersion;
+		header->slotCount = (uint32_t)slotCount;
+		header->slotSize = slotSize;
+		header->closed.store(0);
+		header->lastSequence.store(0);
+
+		slots = (unsigned char*)region.get_address() + SharedMemoryRingAlign(sizeof(SharedMemoryRingHeader));
+		for (size_t i = 0; i < slotCount; ++i)
+			new (slots + i * slotSize) SharedMemorySlotHeader();
+
+		std::atomic_thread_fence(std::memory_order_release);
+		header->magic = SharedMemoryRingMagic;
+	}
+
+	~SharedMemoryRingWriter()
+	{
+		if (!header)
+			return;
+
+		// wakes up readers so that they let go of this ring
+		{
+			boost::interprocess::scoped_lock<boost::interprocess::interprocess_mutex> lock(header->mutex);
+			header->closed.store(1, std::memory_order_release);
+		}
+		header->frameAvailable.notify_all();
+
+#ifndef _WIN32
+		boost::interprocess::shared_memory_object::remove(name.c_str());
+#endif
+	}
+
+	const std::string& GetName() const { return name; }
+	size_t GetSlotCount() const { return header->slotCount; }
+	size_t GetSlotSize() const { return (size_t)header->slotSize; }
+
+	// largest color + depth images (in bytes) a slot can hold
+	bool Fits(size_t colorSize, size_t depthSize) const
+	{
+		return SharedMemoryRingSlotSize(colorSize, depthSize) <= header->slotSize;
+	}
+
+	// copies images into the next slot and wakes up readers. returns the sequence number of the frame (0 if it doesn't fit)
+	// images are described by SharedMemoryImage (offset is ignored) and data can be null if a stream is not available
+	uint64_t Write(const SharedMemoryImage& color, const void* colorData, const SharedMemoryImage& depth, const void* depthData)
+	{
+		const size_t colorSize = colorData ? (size_t)color.size : 0;
+		const size_t depthSize = depthData ? (size_t)depth.size : 0;
+		if (!Fits(colorSize, depthSize))
+			return 0;
+
+		const uint64_t sequence = nextSequence++;
+		SharedMemorySlotHeader* slot = Slot(sequence);
+		unsigned char* slotData = (unsigned char*)slot;
+
+		// readers that get here from now on know that the slot is being overwritten
+		slot->sequence.store(0, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_release);
+
+		slot->timestamp = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+
+		slot->color = color;
+		slot->color.offset = SharedMemoryRingAlign(sizeof(SharedMemorySlotHeader));
+		slot->color.size = colorSize;
+		if (colorSize)
+			memcpy(slotData + slot->color.offset, colorData, colorSize);
+
+		slot->depth = depth;
+		slot->depth.offset = slot->color.offset + SharedMemoryRingAlign(colorSize);
+		slot->depth.size = depthSize;
+		if (depthSize)
+			memcpy(slotData + slot->depth.offset, depthData, depthSize);
+
+		slot->sequence.store(sequence, std::memory_order_release);
+
+		// lets readers know
+		{
+			boost::interprocess::scoped_lock<boost::interprocess::interprocess_mutex> lock(header->mutex);
+			header->lastSequence.store(sequence, std::memory_order_release);
+		}
+		header->frameAvailable.notify_all();
+
+		return sequence;
+	}
+};
+
+// a frame in shared memory (pointers are valid for as long as the reader is open)
+struct SharedMemoryRingFrame
+{
+	uint64_t sequence;
+	int64_t timestamp;
+	SharedMemoryImage color, depth;
+	const unsigned char* colorData;
+	const unsigned char* depthData;
+
+	SharedMemoryRingFrame() : sequence(0), timestamp(0), color(), depth(), colorData(nullptr), depthData(nullptr) {}
+};
+
+/**
+  SharedMemoryRingReader maps a ring created by CameraStreamer (see the "sharedMemory"
+  section of the configuration file) and reads frames straight from it, without copies.
+
+  Frames are not locked: the writer can overwrite a slot at any time (after another
+  slotCount - 1 frames). Readers should call IsValid once they are done with a frame
+  (or after copying what they need) and discard their work if it returns false.
+
+  If the writer closes the ring, WaitForFrame opens the new one once it is there
+  (frames returned before that are no longer valid).
+
+	SharedMemoryRingReader reader("CameraStreamer");
+	SharedMemoryRingFrame frame;
+	while (reader.WaitForFrame(frame, 1000))
+	{
+		... use frame.colorData / frame.depthData ...
+		if (!reader.IsValid(frame)) ... frame was overwritten (reader too slow) ...
+	}
+*/
+class SharedMemoryRingReader
+{
+	std::string name;
+	SharedMemorySegment segment;
+	boost::interprocess::mapped_region region;
+
+	SharedMemoryRingHeader* header;
+	const unsigned char* slots;
+
+	// last frame returned
+	uint64_t lastSequence;
+
+	const SharedMemorySlotHeader* Slot(uint64_t sequence) const
+	{
+		return (const SharedMemorySlotHeader*)(slots + (sequence % header->slotCount) * header->slotSize);
+	}
+
+	// maps the ring (throws if it does not exist, is not ready or was already closed)
+	void Open()
+	{
+		using namespace boost::interprocess;
+
+		header = nullptr;
+		slots = nullptr;
+		region = mapped_region();
+		segment = SharedMemorySegment(open_only, name.c_str(), read_write);
+		region = mapped_region(segment, read_write);
+
+		SharedMemoryRingHeader* mapped = (SharedMemoryRingHeader*)region.get_address();
+		if (region.get_size() < sizeof(SharedMemoryRingHeader) || mapped->magic != SharedMemoryRingMagic || mapped->version != SharedMemoryRingVersion
+			|| region.get_size() < SharedMemoryRingSize(mapped->slotCount, (size_t)mapped->slotSize))
+		{
+			throw std::runtime_error("Invalid shared memory ring " + name);
+		}
+
+		if (mapped->closed.load(std::memory_order_acquire))
+			throw std::runtime_error("Shared memory ring " + name + " was closed");
+
+		header = mapped;
+		slots = (const unsigned char*)region.get_address() + SharedMemoryRingAlign(sizeof(SharedMemoryRingHeader));
+		lastSequence = 0;
+	}
+
+	// opens the ring again after the writer closed it. returns false if the new one is not there yet
+	bool Reopen()
+	{
+		try
+		{
+			Open();
+		}
+		catch (const std::exception&)
+		{
+			// lets go of the old ring (on Windows, the writer cannot create a new one while it is mapped)
+			header = nullptr;
+			slots = nullptr;
+			region = boost::interprocess::mapped_region();
+			segment = SharedMemorySegment();
+			return false;
+		}
+
+		return true;
+	}
+
+	// reads the latest frame if it is newer than the last one returned
+	bool ReadLatest(SharedMemoryRingFrame& frame)
+	{
+		const uint64_t sequence = header->lastSequence.load(std::memory_order_acquire);
+		if (sequence == 0 || sequence == lastSequence)
+			return false;
+
+		const SharedMemorySlotHeader* slot = Slot(sequence);
+		if (slot->sequence.load(std::memory_order_acquire) != sequence)
+			return false; // already being overwritten
+
+		frame.sequence = sequence;
+		frame.timestamp = slot->timestamp;
+		frame.color = slot->color;
+		frame.depth = slot->depth;
+		frame.colorData = frame.color.size ? (const unsigned char*)slot + frame.color.offset : nullptr;
+		frame.depthData = frame.depth.size ? (const unsigned char*)slot + frame.depth.offset : nullptr;
+
+		if (!IsValid(frame))
+			return false;
+
+		lastSequence = sequence;
+		return true;
+	}
+
+public:
+	// throws boost::interprocess::interprocess_exception if the ring does not exist
+	SharedMemoryRingReader(const std::string& name) : name(name), header(nullptr), slots(nullptr), lastSequence(0)
+	{
+		Open();
+	}
+
+	// waits (up to timeoutMs) for a frame newer than the last one returned. Frames are skipped if the reader is slow
+	bool WaitForFrame(SharedMemoryRingFrame& frame, unsigned int timeoutMs)
+	{
+		const boost::posix_time::ptime deadline = boost::posix_time::microsec_clock::universal_time() + boost::posix_time::milliseconds(timeoutMs);
+		for (;;)
+		{
+			// the writer went away: polls until it creates the ring again
+			if (!header || header->closed.load(std::memory_order_acquire))
+			{
+				if (!Reopen())
+				{
+					if (boost::posix_time::microsec_clock::universal_time() >= deadline)
+						return false;
+
+					std::this_thread::sleep_for(std::chrono::milliseconds(10));
+					continue;
+				}
+			}
+
+			// (the slot might have been overwritten between a wake up and the read, so it tries again)
+			if (ReadLatest(frame))
+				return true;
+
+			{
+				boost::interprocess::scoped_lock<boost::interprocess::interprocess_mutex> lock(header->mutex);
+				while (header->lastSequence.load(std::memory_order_acquire) == lastSequence && !header->closed.load(std::memory_order_acquire))
+				{
+					if (!header->frameAvailable.timed_wait(lock, deadline))
+						return false;
+				}
+			}
+		}
+	}
+
+	// true if the writer did not touch the frame's slot since it was returned
+	bool IsValid(const SharedMemoryRingFrame& frame) const
+	{
+		if (!header || header->closed.load(std::memory_order_acquire))
+			return false;
+
+		std::atomic_thread_fence(std::memory_order_acquire);
+		return Slot(frame.sequence)->sequence.load(std::memory_order_relaxed) == frame.sequence;
+	}
+
+	// false while waiting for the writer to create the ring again
+	bool IsOpen() const { return header && !header->closed.load(std::memory_order_acquire); }
+	size_t GetSlotCount() const { return header ? header->slotCount : 0; }
+	uint64_t GetLastSequence() const { return lastSequence; }
+};
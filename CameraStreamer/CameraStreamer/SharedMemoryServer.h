@@ -0,0 +1,223 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "Camera.h"
+#include "Frame.h"
+#include "Logger.h"
+#include "SharedMemoryRing.h"
+#include "Configuration.h"
+#include "ApplicationStatus.h"
+
+/*
+  The SharedMemoryServer class publishes raw color and depth frames to
+  processes running on the same machine through a shared memory ring
+  (see SharedMemoryRing.h for the reader side).
+
+  Unlike TCPStreamingServer, frames are not encoded: consumers read pixels
+  straight from shared memory. Frames are copied into the ring by a separate
+  thread, so cameras never wait on it. If that thread falls behind, only the
+  latest frame is kept.
+
+  Slots are sized for the largest frames the camera can create (see SetFrameGeometries),
+  so the ring is only created again when the camera reconnects with a different
+  resolution. Readers notice it and open the new ring.
+*/
+class SharedMemoryServer
+{
+	std::shared_ptr<ApplicationStatus> appStatus;
+	std::shared_ptr<Configuration> configuration;
+
+	// thread copying frames into shared memory
+	std::shared_ptr<std::thread> sThread;
+	bool running;
+
+	// latest frames waiting to be published
+	std::shared_ptr<Frame> pendingColor, pendingDepth;
+	bool hasPendingFrame;
+	std::mutex pendingMutex;
+	std::condition_variable pendingCondition;
+
+	// slot size for the camera's current geometries (0 until the camera connects)
+	size_t requestedSlotSize;
+
+	std::unique_ptr<SharedMemoryRingWriter> ring;
+	bool ringFailed;
+
+	// statistics
+	unsigned long long framesPublished;
+	std::atomic<unsigned long long> framesDropped;
+
+	static SharedMemoryImage DescribeFrame(const std::shared_ptr<Frame>& frame)
+	{
+		SharedMemoryImage image = SharedMemoryImage();
+		if (frame)
+		{
+			image.width = frame->getWidth();
+			image.height = frame->getHeight();
+			image.encoding = (uint32_t)frame->getEncoding();
+			image.stride = frame->getLineSize();
+			image.size = frame->size();
+		}
+		return image;
+	}
+
+	// largest frame (in bytes) a geometry can produce. jpegs are sized by their content, but never get bigger than the raw pixels
+	static size_t MaxFrameSize(const FrameGeometry& geometry)
+	{
+		if (FrameType::isCompressed(geometry.encoding))
+			return FrameType::getFrameSize(FrameType::Encoding::BGRA32, geometry.width, geometry.height);
+
+		return FrameType::getFrameSize(geometry.encoding, geometry.width, geometry.height);
+	}
+
+	// creates the ring if there is none or if the camera geometry changed
+	bool PrepareRing(size_t slotSize)
+	{
+		// the camera did not connect yet
+		if (slotSize == 0)
+			return false;
+
+		if (ring && ring->GetSlotSize() == SharedMemoryRingAlign(slotSize))
+			return true;
+
+		// readers open the new ring once they notice that this one was closed
+		ring.reset();
+
+		try
+		{
+			ring.reset(new SharedMemoryRingWriter(configuration->GetSharedMemoryName(), configuration->GetSharedMemorySlots(), slotSize));
+			Logger::Log("SharedMemory") << "Publishing frames to \"" << ring->GetName() << "\" (" << ring->GetSlotCount() << " slots of " << ring->GetSlotSize() / 1024 << " KB)" << std::endl;
+			ringFailed = false;
+		}
+		catch (const std::exception& e)
+		{
+			// on Windows, readers that still map the old ring keep its name taken (tries again with the next frame)
+			if (!ringFailed)
+				Logger::Log("SharedMemory") << "Could not create shared memory \"" << configuration->GetSharedMemoryName() << "\": " << e.what() << std::endl;
+
+			ringFailed = true;
+			return false;
+		}
+
+		return true;
+	}
+
+	void thread_main()
+	{
+		Logger::Log("SharedMemory") << "Thread started" << std::endl;
+
+		std::unique_lock<std::mutex> lock(pendingMutex);
+		while (running)
+		{
+			pendingCondition.wait(lock, [this]() { return hasPendingFrame || !running; });
+			if (!running)
+				break;
+
+			std::shared_ptr<Frame> color, depth;
+			color.swap(pendingColor);
+			depth.swap(pendingDepth);
+			hasPendingFrame = false;
+			const size_t slotSize = requestedSlotSize;
+
+			// copies without holding the lock (cameras can hand over the next frame in the meantime)
+			lock.unlock();
+
+			SharedMemoryImage colorImage = DescribeFrame(color), depthImage = DescribeFrame(depth);
+			if (PrepareRing(slotSize) &&
+				ring->Write(colorImage, color ? color->getData() : nullptr, depthImage, depth ? depth->getData() : nullptr))
+			{
+				++framesPublished;
+			}
+			else {
+				++framesDropped;
+			}
+
+			lock.lock();
+		}
+
+		lock.unlock();
+		ring.reset();
+
+		Logger::Log("SharedMemory") << "Thread ended (" << framesPublished << " frames published, " << framesDropped << " dropped)" << std::endl;
+	}
+
+public:
+	SharedMemoryServer(std::shared_ptr<ApplicationStatus> appStatus, std::shared_ptr<Configuration> configuration) : appStatus(appStatus),
+		configuration(configuration), running(false), hasPendingFrame(false), requestedSlotSize(0), ringFailed(false), framesPublished(0), framesDropped(0)
+	{
+	}
+
+	~SharedMemoryServer()
+	{
+		Stop();
+	}
+
+	bool IsThreadRunning()
+	{
+		return (sThread && sThread->joinable());
+	}
+
+	void Run()
+	{
+		if (IsThreadRunning() || !configuration->IsSharedMemoryEnabled())
+			return;
+
+		running = true;
+		sThread.reset(new std::thread(std::bind(&SharedMemoryServer::thread_main, this)));
+	}
+
+	void Stop()
+	{
+		if (!IsThreadRunning())
+			return;
+
+		{
+			const std::lock_guard<std::mutex> lock(pendingMutex);
+			running = false;
+		}
+		pendingCondition.notify_one();
+
+		sThread->join();
+		sThread = nullptr;
+	}
+
+	// sizes slots for the frames a camera creates (call it once the camera connects). Depth frames are Mono16, the rest are color
+	void SetFrameGeometries(const std::vector<FrameGeometry>& geometries)
+	{
+		size_t maxColorSize = 0, maxDepthSize = 0;
+		for (const FrameGeometry& geometry : geometries)
+		{
+			size_t& maxSize = (geometry.encoding == FrameType::Encoding::Mono16) ? maxDepthSize : maxColorSize;
+			maxSize = std::max(maxSize, MaxFrameSize(geometry));
+		}
+
+		const std::lock_guard<std::mutex> lock(pendingMutex);
+		requestedSlotSize = (maxColorSize || maxDepthSize) ? SharedMemoryRingSlotSize(maxColorSize, maxDepthSize) : 0;
+	}
+
+	// hands frames over to the shared memory thread (a frame that was not published yet is dropped)
+	void Publish(std::shared_ptr<Frame> color, std::shared_ptr<Frame> depth)
+	{
+		if (!sThread)
+			return;
+
+		{
+			const std::lock_guard<std::mutex> lock(pendingMutex);
+			if (hasPendingFrame)
+				++framesDropped;
+
+			pendingColor = color;
+			pendingDepth = depth;
+			hasPendingFrame = true;
+		}
+		pendingCondition.notify_one();
+	}
+};
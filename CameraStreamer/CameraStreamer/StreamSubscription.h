@@ -0,0 +1,132 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <string>
+#include <rapidjson/document.h>
+
+#include "PointCloud.h"
+#include "StreamingProtocol.h"
+
+/**
+  StreamSubscription is what a streaming client asked for: which streams it wants,
+  how big it wants them, and how often.
+
+  Clients subscribe by sending a message any time after connecting (clients that
+  never do get the stream as configured). Messages use the same framing as the
+  remote control server: [uint32 length][json], e.g.:
+
+    {"type": "subscribe", "version": 2, "color": true, "depth": false, "width": 320, "height": 0, "maxFPS": 10}
+
+  Every field is optional:
+  * version: framing wanted (default: 1, see StreamingProtocol.h). Frames sent after the subscription use it
+  * color / depth: streams wanted (default: true). Streams the server is not streaming are never sent
+  * width / height: largest size wanted (default: 0, which means as configured). Frames are shrunk
+    by the smallest integer factor that makes them fit, so their aspect ratio never changes
+  * maxFPS: frames per second wanted (default: 0, which means as many as the server sends)
+  * pointCloud: "xyz" or "xyzrgb" to get points computed from depth instead of depth (version 2 only)
+  * voxelSize: points are averaged into voxels this big, in millimeters (default: 0, which keeps every point)
+*/
+struct StreamSubscription
+{
+	bool color;
+	bool depth;
+
+	unsigned long width;
+	unsigned long height;
+
+	int maxFPS;
+
+	uint16_t version;
+
+	PointCloud::Format pointCloud;
+	unsigned int voxelSize;
+
+	StreamSubscription() : color(true), depth(true), width(0), height(0), maxFPS(0), version(StreamingProtocol::Version1),
+		pointCloud(PointCloud::Format::None), voxelSize(0) {}
+
+	// largest message a client can send us
+	static const uint32_t MaxMessageLength = 64 * 1024;
+
+	// integer factor frames of a given size have to be shrunk by to fit what was asked for (1 means as they are)
+	unsigned int ScaleFor(unsigned long frameWidth, unsigned long frameHeight) const
+	{
+		unsigned long scale = 1;
+		if (width > 0)
+			scale = std::max(scale, (frameWidth + width - 1) / width);
+		if (height > 0)
+			scale = std::max(scale, (frameHeight + height - 1) / height);
+		return (unsigned int)scale;
+	}
+
+	// parses a subscribe message. returns false (and why) if the message is not a valid subscription
+	static bool FromJSON(const char* json, size_t length, StreamSubscription& subscription, std::string& error)
+	{
+		rapidjson::Document message;
+		message.Parse(json, length);
+
+		if (message.HasParseError() || !message.IsObject())
+		{
+			error = "message is not a json object";
+			return false;
+		}
+
+		if (!message.HasMember("type") || !message["type"].IsString() || std::string(message["type"].GetString()) != "subscribe")
+		{
+			error = "message type should be \"subscribe\"";
+			return false;
+		}
+
+		StreamSubscription parsed;
+
+		if (message.HasMember("color") && message["color"].IsBool())
+			parsed.color = message["color"].GetBool();
+		if (message.HasMember("depth") && message["depth"].IsBool())
+			parsed.depth = message["depth"].GetBool();
+
+		if (message.HasMember("width") && message["width"].IsUint())
+			parsed.width = message["width"].GetUint();
+		if (message.HasMember("height") && message["height"].IsUint())
+			parsed.height = message["height"].GetUint();
+
+		if (message.HasMember("maxFPS") && message["maxFPS"].IsInt() && message["maxFPS"].GetInt() >= 0)
+			parsed.maxFPS = message["maxFPS"].GetInt();
+
+		if (message.HasMember("version"))
+		{
+			if (!message["version"].IsUint() || (message["version"].GetUint() != StreamingProtocol::Version1 && message["version"].GetUint() != StreamingProtocol::Version2))
+			{
+				error = "only versions 1 and 2 are supported";
+				return false;
+			}
+			parsed.version = (uint16_t)message["version"].GetUint();
+		}
+
+		if (message.HasMember("pointCloud"))
+		{
+			if (!message["pointCloud"].IsString() || !PointCloud::FormatFromString(message["pointCloud"].GetString(), parsed.pointCloud))
+			{
+				error = "pointCloud should be \"xyz\" or \"xyzrgb\"";
+				return false;
+			}
+
+			if (parsed.version != StreamingProtocol::Version2 || !parsed.depth)
+			{
+				error = "point clouds need version 2 and depth";
+				return false;
+			}
+		}
+
+		if (message.HasMember("voxelSize") && message["voxelSize"].IsUint())
+			parsed.voxelSize = message["voxelSize"].GetUint();
+
+		if (!parsed.color && !parsed.depth)
+		{
+			error = "at least one of color or depth has to be requested";
+			return false;
+		}
+
+		subscription = parsed;
+		return true;
+	}
+};
@@ -0,0 +1,80 @@
+#pragma once
+
+#include "CompilerConfiguration.h"
+
+#include <chrono>
+#include <memory>
+#include <vector>
+#include <boost/asio/buffer.hpp>
+
+/**
+  StreamingMessage is what TCPStreamingServer sends to its clients: a small header
+  followed by a list of segments (e.g.: a compressed color image and a depth frame).
+
+  Segments are never copied. Each one keeps a reference to whatever owns its memory
+  (a Frame, an EncodedBuffer, ...) and the whole message is handed to async_write as
+  a buffer sequence. Messages are immutable once they are built, so the same message
+  can be shared by every client.
+*/
+class StreamingMessage
+{
+	// header bytes (owned by the message)
+	std::vector<unsigned char> header;
+
+	// segments and the objects keeping them alive
+	std::vector<boost::asio::const_buffer> segments;
+	std::vector<std::shared_ptr<const void> > owners;
+
+	size_t totalSize;
+
+	// when the frames in this message were captured (see Frame::getCaptureTime, used to measure latency)
+	std::chrono::steady_clock::time_point captureTime;
+
+public:
+	StreamingMessage() : totalSize(0) {}
+
+	void SetCaptureTime(std::chrono::steady_clock::time_point time) { captureTime = time; }
+	std::chrono::steady_clock::time_point GetCaptureTime() const { return captureTime; }
+
+	// reserves room for the header and returns a pointer to it
+	unsigned char* AllocateHeader(size_t length)
+	{
+		totalSize -= header.size();
+		header.assign(length, 0);
+		totalSize += length;
+		return header.data();
+	}
+
+	// appends a segment (owner has to keep data valid for as long as it is alive)
+	void AddSegment(const void* data, size_t length, std::shared_ptr<const void> owner)
+	{
+		if (!data || !length) return;
+		segments.emplace_back(data, length);
+		owners.push_back(std::move(owner));
+		totalSize += length;
+	}
+
+	// buffers ready to be handed to async_write (header first)
+	std::vector<boost::asio::const_buffer> GetBuffers() const
+	{
+		std::vector<boost::asio::const_buffer> buffers;
+		buffers.reserve(segments.size() + 1);
+		if (!header.empty())
+			buffers.emplace_back(header.data(), header.size());
+		buffers.insert(buffers.end(), segments.begin(), segments.end());
+		return buffers;
+	}
+
+	// copies the whole message into a single buffer (for the few places that cannot take a buffer sequence)
+	void CopyTo(std::vector<unsigned char>& output) const
+	{
+		output.resize(totalSize);
+		boost::asio::buffer_copy(boost::asio::buffer(output), GetBuffers());
+	}
+
+	const std::vector<unsigned char>& GetHeader() const { return header; }
+	size_t GetSegmentCount() const { return segments.size(); }
+
+	// number of bytes sent over the wire
+	size_t size() const { return totalSize; }
+};
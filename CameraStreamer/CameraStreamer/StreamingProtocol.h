@@ -0,0 +1,116 @@
+#pragma once
+
+#include <cstdint>
+
+//
+// Framing used by TCPStreamingServer (all fields are little endian)
+//
+// Version 1 (default): [length][width][height][color length][depth length][color][depth]
+//   Every field is a uint32. length does not include itself, and the top 4 bits of
+//   depth length tell which depth codec was used (see DepthCodec).
+//
+// Version 2 (clients subscribe with "version": 2, see StreamSubscription):
+//   [HeaderV2][IntrinsicsV2 color][IntrinsicsV2 depth][ExtrinsicsV2][color][depth]
+//   Intrinsics are only present when the header has the Keyframe flag set (every
+//   KeyframeInterval frames, and whenever the camera reconnects). Streams not sent
+//   have a descriptor with length 0.
+//
+//   Color and depth are usually registered to each other (same camera, so the same
+//   intrinsics up to scale). Cameras that send them as captured add their extrinsics
+//   to keyframes (HasExtrinsics) so that clients can line them up.
+//
+//   The first message a client gets can be a version 1 frame: the most recent frame is
+//   sent as soon as it connects, before its subscription arrives. Version 2 clients can
+//   tell it apart (no MagicV2) and skip it.
+//
+//   Clients that subscribe to point clouds get points instead of depth (HasPoints):
+//   the depth descriptor has the number of points as its width, 1 as its height, and
+//   the bytes per point as its stride (see PointCloud).
+//
+namespace StreamingProtocol
+{
+	const uint16_t Version1 = 1;
+	const uint16_t Version2 = 2;
+
+	// "CSV2" - lets clients tell version 2 headers apart from version 1 headers
+	const uint32_t MagicV2 = 0x32565343;
+
+	// frames between two keyframes
+	const unsigned long long KeyframeInterval = 30;
+
+	// HeaderV2::flags
+	enum Flags : uint32_t
+	{
+		Keyframe = 1 << 0,	// intrinsics follow the header
+		HasColor = 1 << 1,
+		HasDepth = 1 << 2,
+		HasPoints = 1 << 3,	// the depth stream holds points
+		HasExtrinsics = 1 << 4	// keyframes carry extrinsics after the intrinsics (color and depth are not registered)
+	};
+
+	// how a stream was compressed (depth codecs use the same values as DepthCodec::Type)
+	enum ColorCodec : uint8_t
+	{
+		ColorRaw = 0,
+		ColorJPEG = 1
+	};
+
+	// what points look like (never used by DepthCodec::Type)
+	enum PointsCodec : uint8_t
+	{
+		PointsXYZ = 16,		// int16 x, y, z in millimeters
+		PointsXYZRGB = 17	// int16 x, y, z in millimeters, uint8 r, g, b
+	};
+
+#pragma pack(push, 1)
+
+	// describes one of the streams in a message
+	struct StreamDescriptor
+	{
+		uint32_t width;
+		uint32_t height;
+		uint32_t stride;	// bytes per line once decoded (0 if it depends on the decoder)
+		uint32_t length;	// bytes in the message
+		uint8_t codec;		// ColorCodec, DepthCodec::Type, or PointsCodec
+		uint8_t format;		// FrameType::Encoding of the image that was compressed (MJPEG if the camera compressed it)
+		uint16_t reserved;
+	};
+
+	struct HeaderV2
+	{
+		uint32_t length;			// bytes that follow this field (header, intrinsics, and streams)
+		uint32_t magic;				// MagicV2
+		uint16_t version;			// Version2
+		uint16_t headerSize;		// bytes from the beginning of the header to the first stream (intrinsics included)
+		uint32_t flags;				// Flags
+		uint64_t sequence;			// frames handed to the server before this one (gaps are frames this client did not get)
+		int64_t deviceTimestamp;	// microseconds, as reported by the camera
+		int64_t hostTimestamp;		// microseconds since the unix epoch, when the server got the frame
+		StreamDescriptor color;
+		StreamDescriptor depth;
+	};
+
+	// pinhole model and distortion of a stream (already scaled to the stream's width and height)
+	struct IntrinsicsV2
+	{
+		float fx, fy;
+		float cx, cy;
+		float k1, k2, k3, k4, k5, k6;
+		float p1, p2;
+		float metricScale;	// depth units to meters (0 for color)
+	};
+
+	// rigid transform that takes points from the depth camera to the color camera
+	struct ExtrinsicsV2
+	{
+		float rotation[9];		// row major
+		float translation[3];	// millimeters
+	};
+
+#pragma pack(pop)
+
+	static_assert(sizeof(StreamDescriptor) == 20, "StreamDescriptor has to be 20 bytes");
+	static_assert(sizeof(HeaderV2) == 80, "HeaderV2 has to be 80 bytes");
+	static_assert(sizeof(IntrinsicsV2) == 52, "IntrinsicsV2 has to be 52 bytes");
+	static_assert(sizeof(ExtrinsicsV2) == 48, "ExtrinsicsV2 has to be 48 bytes");
+}
@@ -0,0 +1,472 @@
+#pragma once
+
+#include "CompilerConfiguration.h"
+
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+#include <boost/asio.hpp>
+
+#include "Logger.h"
+#include "NetworkStatistics.h"
+#include "StreamingMessage.h"
+#include "StreamSubscription.h"
+
+using boost::asio::ip::tcp;
+
+// what a client gets from TCPStreamingServer
+struct StreamingPreferences
+{
+	// frames are skipped if they arrive faster than this (0 means no limit)
+	int maxFPS;
+
+	// the socket only reports that it is writable when fewer bytes than this are waiting to be sent (TCP_NOTSENT_LOWAT, 0 means off)
+	int sendLowWaterMark;
+
+	// size of the socket send buffer (SO_SNDBUF, 0 means system default)
+	int sendBufferSize;
+
+	// clients that drop messages are moved down to this quality tier at most (0 means they always get the stream as configured)
+	int maxQualityTier;
+
+	StreamingPreferences() : maxFPS(0), sendLowWaterMark(0), sendBufferSize(0), maxQualityTier(0) {}
+};
+
+/**
+  StreamingSession is a client connected to TCPStreamingServer.
+
+  A session owns its socket, the message waiting to be sent (only the newest one:
+  when the client is slower than the camera, older messages are dropped), its
+  statistics, and its preferences.
+
+  The waiting message is only picked once the socket reports that it is writable.
+  With a low water mark (see StreamingPreferences), that only happens when the
+  kernel is almost done sending the previous message, so frames wait in the
+  session (where newer frames replace them) instead of in the kernel send buffer
+  (where they would go out stale). This bounds how far behind a client on a
+  congested link can fall.
+
+  Sessions also pick the quality tier their client gets (see QualityTier): every
+  second, a client that dropped more than 10% of its messages is moved one tier
+  down, and a client that has not dropped any for 5 seconds is moved one tier up.
+
+  Clients can tell the server what they want to get at any time (see
+  StreamSubscription). Sessions read and keep their client's subscription, and
+  the server encodes frames accordingly.
+
+  Sessions are not thread safe. Their sockets are bound to a strand, so their
+  completion handlers never run concurrently; everything else has to go through
+  that strand as well (see Post) unless the io_context is not running.
+
+  StreamingSession does not know what kind of socket it is writing to (see
+  BasicStreamingSession), so tcp and local clients are served the same way.
+*/
+class StreamingSession : public std::enable_shared_from_this<StreamingSession>
+{
+public:
+	// called once when the connection is lost (not called when the server closes it)
+	typedef std::function<void(std::shared_ptr<StreamingSession>)> DisconnectCallback;
+
+	// all sockets use the same (polymorphic) executor type
+	typedef tcp::socket::executor_type Executor;
+
+protected:
+	typedef std::function<void(const boost::system::error_code&, std::size_t)> WriteHandler;
+	typedef std::function<void(const boost::system::error_code&, std::size_t)> ReadHandler;
+
+	typedef std::function<void(const boost::system::error_code&)> WaitHandler;
+
+	// writes a whole message to the socket
+	virtual void AsyncWrite(const std::vector<boost::asio::const_buffer>& buffers, WriteHandler handler) = 0;
+
+	// reads exactly as many bytes as the buffer can hold
+	virtual void AsyncRead(const boost::asio::mutable_buffer& buffer, ReadHandler handler) = 0;
+
+	// waits until the socket can take more data
+	virtual void AsyncWaitWritable(WaitHandler handler) = 0;
+
+	// shuts down and closes the socket
+	virtual void CloseSocket() = 0;
+
+	StreamingSession(Executor executor, const std::string& remoteAddress, int remotePort, const StreamingPreferences& preferences, DisconnectCallback onDisconnect) :
+		executor(executor), connected(true), waitingForSocket(false), statistics(true),
+		preferences(preferences), onDisconnect(onDisconnect), subscription(std::make_shared<const StreamSubscription>()), incomingMessageLength(0),
+		qualityTier(0), qualityWindowStart(std::chrono::steady_clock::now()), qualityWindowMessages(0), qualityWindowDrops(0), qualityCleanWindows(0)
+	{
+		statistics.remoteAddress = remoteAddress;
+		statistics.remotePort = remotePort;
+	}
+
+private:
+	// executor (strand) the socket was created with
+	Executor executor;
+
+	// false once the socket is closed
+	bool connected;
+
+	// true while waiting for the socket to become writable
+	bool waitingForSocket;
+
+	// newest message waiting to be sent and the one being sent
+	std::shared_ptr<StreamingMessage> pendingMessage;
+	std::shared_ptr<StreamingMessage> messageInFlight;
+
+	NetworkStatistics statistics;
+	StreamingPreferences preferences;
+
+	DisconnectCallback onDisconnect;
+
+	// what the client asked for (replaced as a whole, so other threads can read it)
+	std::shared_ptr<const StreamSubscription> subscription;
+
+	// when the last frame was taken (for maxFPS)
+	std::chrono::steady_clock::time_point lastFrameTime;
+
+	// subscription messages being read
+	uint32_t incomingMessageLength;
+	std::vector<char> incomingMessage;
+
+	// quality tier this client gets (read by the server from other threads)
+	std::atomic<int> qualityTier;
+
+	// messages offered and dropped since the current window started, and windows in a row without drops
+	std::chrono::steady_clock::time_point qualityWindowStart;
+	unsigned int qualityWindowMessages, qualityWindowDrops, qualityCleanWindows;
+
+	// how quality tiers adapt
+	static constexpr std::chrono::milliseconds QualityWindow = std::chrono::milliseconds(1000);
+	static constexpr double QualityStepDownDropRate = 0.1;
+	static constexpr unsigned int QualityStepUpCleanWindows = 5;
+
+	// moves the client to another quality tier depending on how many messages it dropped lately
+	void adapt_quality_tier(std::chrono::steady_clock::time_point now)
+	{
+		if (preferences.maxQualityTier <= 0 || now - qualityWindowStart < QualityWindow)
+			return;
+
+		const int tier = qualityTier;
+		const double dropRate = qualityWindowMessages ? (double)qualityWindowDrops / qualityWindowMessages : 0.0;
+		qualityCleanWindows = (qualityWindowDrops == 0) ? qualityCleanWindows + 1 : 0;
+
+		if (dropRate > QualityStepDownDropRate && tier < preferences.maxQualityTier)
+		{
+			qualityTier = tier + 1;
+			Logger::Log("Streamer") << "Client " << statistics.remoteAddress << ':' << statistics.remotePort << " dropped " << (int)(dropRate * 100)
+				<< "% of its messages. Quality tier " << tier << " -> " << tier + 1 << std::endl;
+		}
+		else if (qualityCleanWindows >= QualityStepUpCleanWindows && tier > 0)
+		{
+			qualityTier = tier - 1;
+			qualityCleanWindows = 0;
+			Logger::Log("Streamer") << "Client " << statistics.remoteAddress << ':' << statistics.remotePort << " caught up. Quality tier " << tier << " -> " << tier - 1 << std::endl;
+		}
+
+		qualityWindowStart = now;
+		qualityWindowMessages = 0;
+		qualityWindowDrops = 0;
+	}
+
+	void write_next_message()
+	{
+		using namespace std::placeholders; // for  _1, _2, ...
+
+		// already writing (or waiting to) or nothing to write
+		if (messageInFlight || waitingForSocket || !pendingMessage || !connected)
+			return;
+
+		// the message is only picked once the socket can take it (newer messages may replace it in the meantime)
+		waitingForSocket = true;
+		AsyncWaitWritable(std::bind(&StreamingSession::socket_writable, shared_from_this(), _1));
+	}
+
+	void socket_writable(const boost::system::error_code& error)
+	{
+		using namespace std::placeholders; // for  _1, _2, ...
+
+		waitingForSocket = false;
+
+		if (error)
+		{
+			connection_lost();
+			return;
+		}
+
+		if (!pendingMessage || !connected)
+			return;
+
+		messageInFlight = pendingMessage;
+		pendingMessage = nullptr;
+
+		// header and frames are gathered straight from their buffers
+		AsyncWrite(messageInFlight->GetBuffers(), std::bind(&StreamingSession::write_done, shared_from_this(), _1, _2));
+	}
+
+	void write_done(const boost::system::error_code& error, std::size_t bytes_transferred)
+	{
+		// there's nothing much we can do here besides remove the client if we get an error sending to it
+		if (error)
+		{
+			if (connected)
+				statistics.messagesDropped++;
+
+			messageInFlight = nullptr;
+			connection_lost();
+			return;
+		}
+
+		// glass to send: from the moment the frame was captured until the kernel took the last byte
+		if (messageInFlight->GetCaptureTime().time_since_epoch().count() != 0)
+			statistics.addLatency(std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - messageInFlight->GetCaptureTime()));
+
+		messageInFlight = nullptr;
+		statistics.messagesSent++;
+		statistics.bytesSent += bytes_transferred;
+
+		// moves on
+		write_next_message();
+	}
+
+	void read_message_header()
+	{
+		using namespace std::placeholders; // for  _1, _2, ...
+		AsyncRead(boost::asio::buffer(&incomingMessageLength, sizeof(incomingMessageLength)), std::bind(&StreamingSession::read_message, shared_from_this(), _1, _2));
+	}
+
+	void read_message(const boost::system::error_code& error, std::size_t bytes_transferred)
+	{
+		using namespace std::placeholders; // for  _1, _2, ...
+
+		// clients that stop sending (or never send anything) still get frames: losing the connection is noticed when writing
+		if (error || !connected)
+			return;
+
+		statistics.bytesReceived += bytes_transferred;
+
+		if (incomingMessageLength == 0 || incomingMessageLength > StreamSubscription::MaxMessageLength)
+		{
+			Logger::Log("Streamer") << "Client " << statistics.remoteAddress << ':' << statistics.remotePort << " sent a message that is too long (" << incomingMessageLength << ")!" << std::endl;
+			connection_lost();
+			return;
+		}
+
+		incomingMessage.resize(incomingMessageLength);
+		AsyncRead(boost::asio::buffer(incomingMessage), std::bind(&StreamingSession::read_message_done, shared_from_this(), _1, _2));
+	}
+
+	void read_message_done(const boost::system::error_code& error, std::size_t bytes_transferred)
+	{
+		if (error || !connected)
+			return;
+
+		statistics.bytesReceived += bytes_transferred;
+		++statistics.messagesReceived;
+
+		StreamSubscription newSubscription;
+		std::string parseError;
+		if (StreamSubscription::FromJSON(incomingMessage.data(), incomingMessage.size(), newSubscription, parseError))
+		{
+			std::atomic_store(&subscription, std::shared_ptr<const StreamSubscription>(std::make_shared<const StreamSubscription>(newSubscription)));
+
+			Logger::Log("Streamer") << "Client " << statistics.remoteAddress << ':' << statistics.remotePort << " subscribed to "
+				<< (newSubscription.color && newSubscription.depth ? "color and depth" : (newSubscription.color ? "color" : "depth"))
+				<< " (up to " << newSubscription.width << 'x' << newSubscription.height << " at " << newSubscription.maxFPS << " fps, 0 means as configured) with protocol version " << newSubscription.version << std::endl;
+		}
+		else {
+			Logger::Log("Streamer") << "Client " << statistics.remoteAddress << ':' << statistics.remotePort << " sent an invalid subscription: " << parseError << std::endl;
+		}
+
+		// clients can change their minds
+		read_message_header();
+	}
+
+	void connection_lost()
+	{
+		// closed by the server? it already took care of everything
+		if (!connected)
+			return;
+
+		Close();
+
+		if (onDisconnect)
+			onDisconnect(shared_from_this());
+	}
+
+public:
+	virtual ~StreamingSession() {}
+
+	// queues a message - has to be called from the session's strand (a message that is still waiting is dropped: only the newest one is worth sending)
+	void Send(const std::shared_ptr<StreamingMessage>& message)
+	{
+		if (!connected)
+			return;
+
+		// a message still waiting means the client is not keeping up
+		++qualityWindowMessages;
+		if (pendingMessage)
+		{
+			statistics.messagesDropped++;
+			++qualityWindowDrops;
+		}
+
+		pendingMessage = message;
+		write_next_message();
+
+		adapt_quality_tier(std::chrono::steady_clock::now());
+	}
+
+	// starts reading subscriptions from the client (call once, right after the session is created)
+	void Start()
+	{
+		boost::asio::post(executor, std::bind(&StreamingSession::read_message_header, shared_from_this()));
+	}
+
+	// does the client want a frame captured at a given time? (maxFPS) - has to be called from a single thread, the one handing out frames
+	bool TakesFrame(std::chrono::steady_clock::time_point captureTime)
+	{
+		// the lowest of what the server allows and what the client asked for
+		int maxFPS = preferences.maxFPS;
+		const int subscribedFPS = GetSubscription()->maxFPS;
+		if (subscribedFPS > 0 && (maxFPS <= 0 || subscribedFPS < maxFPS))
+			maxFPS = subscribedFPS;
+
+		if (maxFPS > 0)
+		{
+			const std::chrono::steady_clock::duration minFrameInterval = std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::seconds(1)) / maxFPS;
+			if (captureTime - lastFrameTime < minFrameInterval)
+				return false;
+		}
+
+		lastFrameTime = captureTime;
+		return true;
+	}
+
+	// sends a message from any thread (it is queued on the session's strand)
+	void Post(const std::shared_ptr<StreamingMessage>& message)
+	{
+		boost::asio::post(executor, std::bind(&StreamingSession::Send, shared_from_this(), message));
+	}
+
+	// closes the connection (messages that were not sent are accounted as dropped)
+	void Close()
+	{
+		if (!connected)
+			return;
+
+		statistics.messagesDropped += (pendingMessage ? 1 : 0) + (messageInFlight ? 1 : 0);
+		pendingMessage = nullptr;
+		statistics.disconnected();
+
+		try
+		{
+			CloseSocket();
+		}
+		catch (const std::exception& e)
+		{
+			Logger::Log("Streamer") << "Error closing connection w/ Client " << statistics.remoteAddress << ':' << statistics.remotePort << std::endl;
+		}
+		connected = false;
+
+		Logger::Log("Streamer") << "Client " << statistics.remoteAddress << ':' << statistics.remotePort << " disconnected" << std::endl;
+		Logger::Log("Streamer") << "[Stats] Sent client " << statistics.remoteAddress << ':' << statistics.remotePort << " --> "
+			<< statistics.bytesSent << " bytes (" << statistics.messagesSent << " packets sent and " << statistics.messagesDropped << " dropped) -"
+			<< " Duration: " << std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now() - statistics.connectedTime).count() / 1000.0f << " sec" << std::endl;
+
+		if (statistics.latencySamples > 0)
+		{
+			Logger::Log("Streamer") << "[Stats] Client " << statistics.remoteAddress << ':' << statistics.remotePort << " latency (capture to sent) --> "
+				<< statistics.averageLatencyMs() << " ms average, " << statistics.latencyMax.count() / 1000.0 << " ms max" << std::endl;
+		}
+	}
+
+	bool IsConnected() const { return connected; }
+
+	const NetworkStatistics& GetStatistics() const { return statistics; }
+	const StreamingPreferences& GetPreferences() const { return preferences; }
+
+	// what the client asked for (safe to call from any thread)
+	std::shared_ptr<const StreamSubscription> GetSubscription() const { return std::atomic_load(&subscription); }
+
+	// quality tier this client should get (safe to call from any thread)
+	int GetQualityTier() const { return qualityTier; }
+
+	const std::string& RemoteAddress() const { return statistics.remoteAddress; }
+	int RemotePort() const { return statistics.remotePort; }
+};
+
+
+// sets TCP_NOTSENT_LOWAT where the platform has it (returns false otherwise)
+inline bool SetNotSentLowWaterMark(tcp::socket& socket, int bytes)
+{
+#ifdef TCP_NOTSENT_LOWAT
+	typedef boost::asio::detail::socket_option::integer<IPPROTO_TCP, TCP_NOTSENT_LOWAT> not_sent_low_water_mark;
+	boost::system::error_code error;
+	socket.set_option(not_sent_low_water_mark(bytes), error);
+	return !error;
+#else
+	return false;
+#endif
+}
+
+// other sockets do not have a low water mark
+template <class Socket>
+inline bool SetNotSentLowWaterMark(Socket& socket, int bytes)
+{
+	return false;
+}
+
+/**
+  BasicStreamingSession is a StreamingSession over a given kind of stream socket
+  (e.g.: tcp::socket or boost::asio::local::stream_protocol::socket).
+*/
+template <class Socket>
+class BasicStreamingSession : public StreamingSession
+{
+	std::shared_ptr<Socket> socket;
+
+	BasicStreamingSession(std::shared_ptr<Socket> connection, const std::string& remoteAddress, int remotePort, const StreamingPreferences& preferences, DisconnectCallback onDisconnect) :
+		StreamingSession(connection->get_executor(), remoteAddress, remotePort, preferences, onDisconnect), socket(connection)
+	{
+		// socket options are best effort (e.g.: unix domain sockets do not have a low water mark)
+		boost::system::error_code error;
+		if (preferences.sendBufferSize > 0)
+			socket->set_option(boost::asio::socket_base::send_buffer_size(preferences.sendBufferSize), error);
+		if (preferences.sendLowWaterMark > 0)
+			SetNotSentLowWaterMark(*socket, preferences.sendLowWaterMark);
+	}
+
+protected:
+	void AsyncWrite(const std::vector<boost::asio::const_buffer>& buffers, WriteHandler handler) override
+	{
+		boost::asio::async_write(*socket, buffers, handler);
+	}
+
+	void AsyncRead(const boost::asio::mutable_buffer& buffer, ReadHandler handler) override
+	{
+		boost::asio::async_read(*socket, buffer, handler);
+	}
+
+	void AsyncWaitWritable(WaitHandler handler) override
+	{
+		socket->async_wait(Socket::wait_write, handler);
+	}
+
+	void CloseSocket() override
+	{
+		boost::system::error_code error;
+		socket->shutdown(Socket::shutdown_both, error);
+		socket->close();
+	}
+
+public:
+	// This is the only way of creating a session
+	static std::shared_ptr<StreamingSession> Create(std::shared_ptr<Socket> connection, const std::string& remoteAddress, int remotePort,
+		const StreamingPreferences& preferences, StreamingSession::DisconnectCallback onDisconnect)
+	{
+		return std::shared_ptr<StreamingSession>(new BasicStreamingSession<Socket>(connection, remoteAddress, remotePort, preferences, onDisconnect));
+	}
+};
+
+typedef BasicStreamingSession<tcp::socket> TCPStreamingSession;
@@ -35,6 +35,7 @@ bool TCPRelayCamera::LoadConfigurationSettings()
 
 		// creates a raw yuv packet reader
 		packetReader = RAWYUVProtocolReader::Create();
+		colorFrameEncoding = FrameType::Encoding::I420;
 
 		// selects correct header parser
 		// (does not need to do anything for now)
@@ -1,21 +1,37 @@
 #pragma once
 
+#include "CompilerConfiguration.h"
 #include "Frame.h"
-
+#include "FrameConversion.h"
+#include "NetworkBackend.h"
+#include "PointCloud.h"
+#include "QualityTier.h"
+#include "JPEGEncoder.h"
+#include "JPEGDecoder.h"
+#include "DepthCodec.h"
+#include "StreamingMessage.h"
+#include "StreamingProtocol.h"
+#include "StreamingSession.h"
+#include "RTPMulticastSender.h"
+
+#include <atomic>
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
 #include <iostream>
 #include <functional>
 #include <memory>
 #include <mutex>
-#include <set>
-#include <map>
-#include <queue>
 #include <thread>
+#include <vector>
 #include <boost/asio.hpp>
 #include <boost/shared_ptr.hpp>
 #include <boost/enable_shared_from_this.hpp>
 #include <opencv2/opencv.hpp>
 
 #include "Logger.h"
+#include "OrderedWorkerPool.h"
 #include "NetworkStatistics.h"
 #include "Configuration.h"
 #include "ApplicationStatus.h"
@@ -29,6 +45,41 @@ using boost::asio::ip::tcp;
   TCPStreamingServer runs on a separate thread and queues up packages
   if encoding rate is not as fast as the rate in which a camera 
   capture frames.
+
+  Frames are encoded by a pool of encoder threads (see "encoderThreads"
+  in the "streaming" section). Encoded messages are handed back to the
+  server thread in the same order frames were captured, so the server
+  thread only deals with sockets.
+
+  Every client is a StreamingSession (socket, send queue, stats, and preferences).
+  Sockets are served by a pool of io threads (see "ioThreads" in the "streaming"
+  section) and every session is bound to its own strand. Encoded messages are handed
+  to each session's strand, so clients are written to in parallel.
+
+  Sessions are kept in a flat vector that is copied whenever a client connects
+  or disconnects (rare), so sending a frame to all clients is a plain loop
+  over a snapshot without locks or lookups.
+
+  Clients can subscribe to the streams, size, and frame rate they want (see
+  StreamSubscription), and clients that cannot keep up are moved to lower quality
+  tiers (see QualityTier and "adaptiveQuality" in the "streaming" section). Every
+  frame is encoded once for each rendition (what a client ends up getting) that
+  clients want, no matter how many clients share it.
+
+  Clients get the version 1 framing unless they subscribe to version 2, which adds
+  sequence numbers, device and host timestamps, per stream codecs and formats, and
+  intrinsics on keyframes (see StreamingProtocol.h). Version 2 clients can also ask for
+  point clouds instead of depth (see PointCloud), computed here once per rendition.
+
+  The most recent frame encoded as configured is kept around: new clients get it as
+  soon as they connect (instead of waiting for the camera), and so does the remote
+  control getLatestFrame request (see GetLatestFrame). While nobody is watching, frames
+  are only encoded for that if "keepLatestFrame" is set in the "streaming" section.
+  The frame uses the version 1 framing (clients have not subscribed yet when they get it).
+
+  Color frames can also be sent to a multicast group (see the "multicast" section
+  and RTPMulticastSender). Multicast frames are sent once no matter how many machines
+  are watching, and they are sent even if no tcp client is connected.
 */
 class TCPStreamingServer
 {
@@ -36,14 +87,65 @@ class TCPStreamingServer
 	std::shared_ptr<ApplicationStatus> appStatus;
 	std::shared_ptr<Configuration> configuration;
 
-	bool streamingColor, streamingDepth, streamingJPEGLengthValue;
+	// written by the server thread (and Stop) while the camera and encoder threads read them
+	std::atomic<bool> streamingColor, streamingDepth, streamingJPEGLengthValue;
 
 public:
 	TCPStreamingServer(std::shared_ptr<ApplicationStatus> appStatus, std::shared_ptr<Configuration> configuration) : appStatus(appStatus),
 		configuration(configuration), streamingColor(false), streamingDepth(false), streamingJPEGLengthValue(false),
-		acceptor(io_context, tcp::endpoint(tcp::v4(), configuration->GetStreamerPort()))
+		acceptor(io_context, tcp::endpoint(tcp::v4(), configuration->GetStreamerPort())),
+		jpegEncoder(configuration->GetStreamingJpegQuality(), JPEGSubsampling(configuration->GetStreamingJpegSubsampling()), configuration->IsStreamingJpegFastDCT()),
+		depthCodec(DepthCodecType(configuration->GetStreamingDepthCodec())),
+		encoderPool("Encoder", configuration->GetStreamingEncoderThreads(), 0,
+			[this](unsigned long long, EncodedFrame& frame)
+			{
+				// encoded messages are handed to every client here, in order (posting keeps this short)
+				if (frame.plan)
+				{
+					SendToAll(frame);
+
+					if (frame.plan->latestRendition != SIZE_MAX)
+						std::atomic_store(&latestMessage, frame.messages[frame.plan->latestRendition]);
+				}
+
+				if (multicastSender && frame.colorData)
+					multicastSender->Post(frame.colorOwner, frame.colorData, frame.colorSize, frame.timestamp);
+			}),
+		qualityTiers(QualityTier::Ladder(configuration->GetStreamingJpegQuality())), frameNumber(0), colorAndDepthRegistered(true), depthToColor(), intrinsicsChanged(false), intrinsicsGeneration(0),
+		sessions(std::make_shared<SessionList>()), sessionCount(0)
 	{
 		Logger::Log("Streamer") << "Listening on " << configuration->GetStreamerPort() << std::endl;
+
+		// local clients can also connect through a unix domain socket (same protocol)
+		if (!configuration->GetStreamingLocalSocketPath().empty())
+		{
+#ifdef BOOST_ASIO_HAS_LOCAL_SOCKETS
+			const std::string& path = configuration->GetStreamingLocalSocketPath();
+
+			// a socket file left behind by a previous run would make bind fail
+			std::error_code removeError;
+			std::filesystem::remove(path, removeError);
+
+			localAcceptor = std::make_shared<boost::asio::local::stream_protocol::acceptor>(io_context, boost::asio::local::stream_protocol::endpoint(path));
+			Logger::Log("Streamer") << "Listening on " << path << std::endl;
+#else
+			Logger::Log("Streamer") << "Warning! Unix domain sockets are not supported on this platform. Ignoring streaming.localSocket" << std::endl;
+#endif
+		}
+
+		// color frames can also be sent once to a multicast group
+		if (configuration->IsMulticastEnabled())
+		{
+			try
+			{
+				multicastSender = std::make_shared<RTPMulticastSender>(io_context, configuration->GetMulticastGroup(), configuration->GetMulticastPort(),
+					configuration->GetMulticastTTL(), configuration->IsMulticastLoopback(), configuration->GetMulticastMTU(), configuration->GetMulticastInterface());
+			}
+			catch (const std::exception& e)
+			{
+				Logger::Log("Streamer") << "Could not send to multicast group " << configuration->GetMulticastGroup() << ':' << configuration->GetMulticastPort() << ": " << e.what() << std::endl;
+			}
+		}
 	}
 
 	~TCPStreamingServer()
@@ -58,12 +160,16 @@ public:
 
 	void Run()
 	{
+		encoderPool.Start();
 		sThread.reset(new std::thread(std::bind(&TCPStreamingServer::thread_main, this)));
 	}
 
 	void Stop()
 	{
 
+		// no more frames to encode
+		encoderPool.Stop();
+
 		if (IsThreadRunning())
 		{
 			// stops io service
@@ -81,152 +187,627 @@ public:
 			sThread = nullptr;
 		}
 
-		// any clients connected?
-		for (std::shared_ptr<tcp::socket> client : clients)
+#ifdef BOOST_ASIO_HAS_LOCAL_SOCKETS
+		// removes the socket file
+		if (localAcceptor && localAcceptor->is_open())
 		{
-			try
-			{
-				// thread is not running, so we need to account for the packets we were about to send, but didn't send in time
-				clientsStatistics[client].messagesDropped += clientsQs[client].size();
-				clientsStatistics[client].disconnected();
-				client->close();
-			}
-			catch (std::exception e)
-			{
-				Logger::Log("Streamer") << "Error closing connection w/ Client " << clientsStatistics[client].remoteAddress << ':' << clientsStatistics[client].remotePort << std::endl;
-			}
+			boost::system::error_code closeError;
+			localAcceptor->close(closeError);
 
-			Logger::Log("Streamer") << "Client " << clientsStatistics[client].remoteAddress << ':' << clientsStatistics[client].remotePort << " disconnected" << std::endl;
-			Logger::Log("Streamer") << "[Stats] Sent client " << clientsStatistics[client].remoteAddress << ':' << clientsStatistics[client].remotePort << ":"
-				<< clientsStatistics[client].bytesSent << " bytes (" << clientsStatistics[client].messagesSent << "packets sent; " << clientsStatistics[client].messagesDropped << " dropped) -"
-				<< " Duration: " << std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now() - clientsStatistics[client].connectedTime).count() / 1000.0f << " sec" << std::endl;
+			std::error_code removeError;
+			std::filesystem::remove(configuration->GetStreamingLocalSocketPath(), removeError);
 		}
+#endif
 
-		// erase list of clients
-		clients.clear();
+		// any clients connected? (threads are not running, so messages that were not sent in time are accounted as dropped)
+		std::shared_ptr<const SessionList> currentSessions;
+		{
+			const std::lock_guard<std::mutex> lock(sessionsMutex);
+			currentSessions = std::atomic_load(&sessions);
+			std::atomic_store(&sessions, std::shared_ptr<const SessionList>(std::make_shared<SessionList>()));
+			sessionCount = 0;
+		}
+
+		for (const std::shared_ptr<StreamingSession>& session : *currentSessions)
+			session->Close();
+
+		if (multicastSender)
+			multicastSender->Close();
 
 	}
 
 
-	// sends a color and depth frame to all clients connected
-	void ForwardToAll(std::shared_ptr<Frame> color, std::shared_ptr<Frame> depth)
+	// intrinsics of a stream at the resolution they were calibrated for
+	struct CalibratedIntrinsics
+	{
+		StreamingProtocol::IntrinsicsV2 intrinsics;
+		unsigned long width, height;
+
+		CalibratedIntrinsics() : intrinsics(), width(0), height(0) {}
+	};
+
+	// intrinsics version 2 clients get on keyframes (call whenever the camera connects). Cameras that do not
+	// register color and depth to each other also pass the extrinsics that take depth to color
+	void SetIntrinsics(const CalibratedIntrinsics& color, const CalibratedIntrinsics& depth, const StreamingProtocol::ExtrinsicsV2* extrinsics = nullptr)
+	{
+		const std::lock_guard<std::mutex> lock(intrinsicsMutex);
+		colorIntrinsics = color;
+		depthIntrinsics = depth;
+		colorAndDepthRegistered = (extrinsics == nullptr);
+		depthToColor = extrinsics ? *extrinsics : StreamingProtocol::ExtrinsicsV2();
+		intrinsicsChanged = true;
+
+		// rays computed from the old ones are useless now
+		++intrinsicsGeneration;
+	}
+
+	// sends a color and depth frame to all clients connected (timestamp is the one reported by the camera)
+	void ForwardToAll(std::chrono::microseconds deviceTimestamp, std::shared_ptr<Frame> color, std::shared_ptr<Frame> depth)
 	{
 		// if not running
 		if (!sThread) return;
 
-		// first, let's make sure that this method gets called from the same thread that
-		// is running the server
-		if (std::this_thread::get_id() != sThread->get_id())
+		// when the camera handed the pixels over (sessions measure latency from here, so capture, registration and decoding count too)
+		std::chrono::steady_clock::time_point captureTime = std::chrono::steady_clock::now();
+		if (color)
+			captureTime = std::min(captureTime, color->getCaptureTime());
+		if (depth)
+			captureTime = std::min(captureTime, depth->getCaptureTime());
+
+		// is what new clients get getting old? (only frames that were actually encoded count, and a refresh is asked for once per interval at most)
+		const std::shared_ptr<StreamingMessage> latest = std::atomic_load(&latestMessage);
+		const bool watched = sessionCount > 0 || multicastSender;
+		const bool refreshLatest = (!latest || captureTime - latest->GetCaptureTime() >= LatestFrameRefreshInterval) &&
+			captureTime - latestRefreshTime >= LatestFrameRefreshInterval && (watched || configuration->IsStreamingKeepLatestFrame());
+
+		// nobody to send it to? let's not waste time encoding it
+		if (!watched && !refreshLatest) return;
+
+		// the server thread might change these at any time, so a frame sticks to what it saw here
+		const bool sendingColor = streamingColor, sendingDepth = streamingDepth;
+
+		// multicast receivers get the time frames were handed to the server
+		const std::chrono::microseconds timestamp = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::system_clock::now().time_since_epoch());
+
+		// who gets this frame, and how? (clients asking for the same thing share renditions)
+		std::shared_ptr<FramePlan> plan = std::make_shared<FramePlan>();
+		plan->sequence = frameNumber;
+		plan->deviceTimestamp = deviceTimestamp;
+		plan->hostTimestamp = timestamp;
+		plan->captureTime = captureTime;
+
+		// keyframes carry intrinsics (version 2)
+		plan->keyframe = (frameNumber % StreamingProtocol::KeyframeInterval == 0) || intrinsicsChanged.exchange(false);
+		if (plan->keyframe)
 		{
-			boost::asio::post(io_context, std::bind(&TCPStreamingServer::ForwardToAll, this, color, depth));
-			return;
+			const std::lock_guard<std::mutex> lock(intrinsicsMutex);
+			plan->colorIntrinsics = colorIntrinsics;
+			plan->depthIntrinsics = depthIntrinsics;
+			plan->hasExtrinsics = !colorAndDepthRegistered;
+			plan->depthToColor = depthToColor;
 		}
 
-		// which streams are enabled?
-		size_t imgWidth = 0, imgHeight = 0, depthImgSize = 0;
+		// multicast gets the stream as configured
+		if (multicastSender && sendingColor)
+			plan->multicastRendition = plan->Add(Rendition(true, false, 1, 1, qualityTiers[0].jpegQuality, StreamingProtocol::Version1));
 
-		// color vector
-		std::vector<uchar> encodedColorImage;
-		
-		// converts color to jpeg
-		if (streamingColor)
+		std::shared_ptr<const SessionList> currentSessions = std::atomic_load(&sessions);
+		for (size_t i = 0; i < currentSessions->size(); ++i)
 		{
-			imgWidth = color->getWidth();
-			imgHeight = color->getHeight();
-
-			if (color->getEncoding() == FrameType::Encoding::Custom) {
-				// enlarge the vector to the size of the image
-				encodedColorImage.resize(color->size());
-				// copy the data
-				memcpy(encodedColorImage.data(), color->getData(), color->size());
-			}
-			else {
+			const std::shared_ptr<StreamingSession>& session = (*currentSessions)[i];
 
-				// todo: better, flexible fix in the future?
-				if (color->getPixelLen() == 3)
-				{
-					cv::Mat colorImage(imgHeight, imgWidth, CV_8UC3, color->getData());
-					cv::imencode(".jpg", colorImage, encodedColorImage); // todo: use jpegturbo or mozjpeg instead of OpenCV
-				}
-				else {
-					cv::Mat colorImage(imgHeight, imgWidth, CV_8UC4, color->getData());
-					cv::imencode(".jpg", colorImage, encodedColorImage); // todo: use jpegturbo or mozjpeg instead of OpenCV
-				}
+			// lower tiers skip frames, and so do clients that asked for fewer frames
+			const QualityTier& tier = qualityTiers[session->GetQualityTier()];
+			if (!tier.SendsFrame(frameNumber) || !session->TakesFrame(captureTime))
+				continue;
+
+			std::shared_ptr<const StreamSubscription> subscription = session->GetSubscription();
+			// color and depth do not share a resolution when they are not registered to each other (or color is warped into depth)
+			const unsigned int colorScale = color ? subscription->ScaleFor(color->getWidth(), color->getHeight()) : 1;
+			const unsigned int depthScale = depth ? subscription->ScaleFor(depth->getWidth(), depth->getHeight()) : 1;
+
+			Rendition rendition(sendingColor && subscription->color, sendingDepth && subscription->depth,
+				colorScale * tier.downscale, depthScale * tier.depthDecimation, tier.jpegQuality, subscription->version);
+			if (rendition.depth)
+			{
+				rendition.pointCloud = subscription->pointCloud;
+				rendition.voxelSize = subscription->voxelSize;
 			}
+
+			// nothing this client wants is being streamed
+			if (!rendition.color && !rendition.depth)
+				continue;
+
+			plan->recipients.emplace_back(session, plan->Add(rendition));
 		}
 
-		if (streamingDepth)
+		// new clients get the stream as configured, so that is what is kept around (encoded just for that once in a while)
+		if (sendingColor || sendingDepth)
 		{
-			imgWidth = depth->getWidth();
-			imgHeight = depth->getHeight();
-			depthImgSize = depth->size();
+			const Rendition configured(sendingColor, sendingDepth, 1, 1, qualityTiers[0].jpegQuality, StreamingProtocol::Version1);
+			plan->latestRendition = plan->Find(configured);
+			if (plan->latestRendition == SIZE_MAX && refreshLatest)
+				plan->latestRendition = plan->Add(configured);
 		}
 
-		// prepares the message
-		std::shared_ptr<std::vector<uchar> > message;
-		
-		if (streamingJPEGLengthValue)
+		++frameNumber;
+		if (plan->renditions.empty()) return;
+
+		// frames are encoded in parallel (if encoders are busy, the frame is dropped and the refresh is asked for again with the next one)
+		if (encoderPool.Submit(std::bind(&TCPStreamingServer::EncodeMessage, this, color, depth, plan)) && refreshLatest)
+			latestRefreshTime = captureTime;
+	}
+
+	// most recent frame encoded as configured (version 1 framing), or nullptr if there is none from the last couple of seconds
+	std::shared_ptr<StreamingMessage> GetLatestFrame() const
+	{
+		std::shared_ptr<StreamingMessage> latest = std::atomic_load(&latestMessage);
+		if (!latest || std::chrono::steady_clock::now() - latest->GetCaptureTime() > LatestFrameMaxAge)
+			return nullptr;
+		return latest;
+	}
+
+private:
+	// subsampling as described in the configuration file (420 if invalid)
+	static JPEGEncoder::Subsampling JPEGSubsampling(const std::string& name)
+	{
+		JPEGEncoder::Subsampling subsampling = JPEGEncoder::Subsampling::YUV420;
+		JPEGEncoder::SubsamplingFromString(name, subsampling);
+		return subsampling;
+	}
+
+	// depth codec as described in the configuration file (raw if invalid)
+	static DepthCodec::Type DepthCodecType(const std::string& name)
+	{
+		DepthCodec::Type type = DepthCodec::Type::Raw;
+		DepthCodec::TypeFromString(name, type);
+		return type;
+	}
+
+	// compressed image and whoever owns its memory
+	struct EncodedImage
+	{
+		std::shared_ptr<const void> owner;
+		const unsigned char* data;
+		size_t size;
+
+		// what goes in the header (e.g.: depth length also tells which codec was used)
+		uint32_t lengthField;
+		unsigned long width, height;
+
+		// what version 2 clients are told about it
+		uint8_t codec;
+		FrameType::Encoding format;
+		uint32_t stride;
+
+		EncodedImage() : data(nullptr), size(0), lengthField(0), width(0), height(0), codec(0), format(FrameType::Encoding::Custom), stride(0) {}
+	};
+
+	// what a client gets: streams, how much they are shrunk, and jpeg quality
+	struct Rendition
+	{
+		bool color, depth;
+		unsigned int colorScale, depthScale;
+		int jpegQuality;
+		uint16_t version;
+
+		// points instead of depth (version 2 only)
+		PointCloud::Format pointCloud;
+		unsigned int voxelSize;
+
+		Rendition(bool color, bool depth, unsigned int colorScale, unsigned int depthScale, int jpegQuality, uint16_t version) :
+			color(color), depth(depth), colorScale(colorScale), depthScale(depthScale), jpegQuality(jpegQuality), version(version),
+			pointCloud(PointCloud::Format::None), voxelSize(0) {}
+
+		// whether two renditions get the same depth stream
+		bool SameDepthAs(const Rendition& other) const
 		{
-			message = std::make_shared<std::vector<uchar> >(1 * sizeof(uint32_t) + encodedColorImage.size());
+			return depth == other.depth && depthScale == other.depthScale && pointCloud == other.pointCloud && voxelSize == other.voxelSize;
+		}
 
-			// header [color jpeg size] - tells clients how many bytes they should read
-			*((uint32_t*)&(*message)[0]) = encodedColorImage.size();
+		bool operator==(const Rendition& other) const
+		{
+			return color == other.color && SameDepthAs(other) && colorScale == other.colorScale &&
+				jpegQuality == other.jpegQuality && version == other.version;
+		}
+	};
+
+	// renditions a frame has to be encoded as, and who gets each of them
+	struct FramePlan
+	{
+		std::vector<Rendition> renditions;
+		std::vector<std::pair<std::shared_ptr<StreamingSession>, size_t> > recipients;
+
+		// rendition sent to the multicast group (if any)
+		size_t multicastRendition;
+
+		// rendition kept around for clients that connect later (if any)
+		size_t latestRendition;
+
+		// what version 2 clients are told about the frame
+		unsigned long long sequence;
+		std::chrono::microseconds deviceTimestamp, hostTimestamp;
+		bool keyframe;
+		CalibratedIntrinsics colorIntrinsics, depthIntrinsics;
+		bool hasExtrinsics;
+		StreamingProtocol::ExtrinsicsV2 depthToColor;
+
+		// when the frame was captured (sessions use it to measure latency)
+		std::chrono::steady_clock::time_point captureTime;
+
+		FramePlan() : multicastRendition(SIZE_MAX), latestRendition(SIZE_MAX), sequence(0), deviceTimestamp(0), hostTimestamp(0), keyframe(false),
+			hasExtrinsics(false), depthToColor() {}
+
+		// index of a rendition (SIZE_MAX if no one asked for it)
+		size_t Find(const Rendition& rendition) const
+		{
+			for (size_t i = 0; i < renditions.size(); ++i)
+				if (renditions[i] == rendition)
+					return i;
+			return SIZE_MAX;
+		}
+
+		// index of a rendition (added if no one asked for it yet)
+		size_t Add(const Rendition& rendition)
+		{
+			const size_t index = Find(rendition);
+			if (index != SIZE_MAX)
+				return index;
+
+			renditions.push_back(rendition);
+			return renditions.size() - 1;
+		}
+	};
+
+	// what encoder threads hand back to the server thread
+	struct EncodedFrame
+	{
+		std::shared_ptr<FramePlan> plan;
+
+		// what tcp clients get (one message per rendition)
+		std::vector<std::shared_ptr<StreamingMessage> > messages;
+
+		// compressed color image on its own (what the multicast group gets)
+		std::shared_ptr<const void> colorOwner;
+		const unsigned char* colorData;
+		size_t colorSize;
+
+		std::chrono::microseconds timestamp;
 
-			// copies color
-			memcpy((unsigned char*)&(*message)[4], &encodedColorImage[0], encodedColorImage.size());
+		EncodedFrame() : colorData(nullptr), colorSize(0), timestamp(0) {}
+	};
 
+	// converts color to jpeg. Frames that are already compressed are sent as they are, unless they are
+	// MJPEG frames that have to be shrunk (those are decoded at the smaller size and compressed again)
+	EncodedImage EncodeColor(const std::shared_ptr<Frame>& color, unsigned int scale, int jpegQuality)
+	{
+		EncodedImage image;
+
+		if (color->isCompressed() && (scale <= 1 || color->getEncoding() != FrameType::Encoding::MJPEG)) {
+			// already compressed (e.g.: mjpeg from the camera)
+			image.owner = color;
+			image.data = color->getData();
+			image.size = color->size();
+			image.width = color->getWidth();
+			image.height = color->getHeight();
+			image.codec = StreamingProtocol::ColorJPEG;
+			image.format = color->getEncoding();
 		}
 		else {
+			std::shared_ptr<Frame> scaled = FrameConversion::Downscale(color, scale);
+			image.width = scaled->getWidth();
+			image.height = scaled->getHeight();
+			image.codec = StreamingProtocol::ColorJPEG;
+			image.format = scaled->getEncoding();
+
+			std::shared_ptr<EncodedBuffer> encodedColorImage = jpegEncoder.Encode(*scaled, jpegQuality);
+			if (encodedColorImage)
+			{
+				image.owner = encodedColorImage;
+				image.data = encodedColorImage->data();
+				image.size = encodedColorImage->size();
+			}
+		}
 
-			message = std::make_shared<std::vector<uchar> >(5 * sizeof(uint32_t) + encodedColorImage.size() + depthImgSize);
+		image.lengthField = (uint32_t) image.size;
+		return image;
+	}
 
-			// header prefix [package length]  - tells clients how many bytes they should read
-			*((uint32_t*)&(*message)[0]) = message->size() - sizeof(uint32_t); // header size doesn't include itself
+	// depth is either compressed or sent as is
+	EncodedImage EncodeDepth(std::shared_ptr<Frame> depth, unsigned int scale)
+	{
+		EncodedImage image;
+
+		// raw depth is sent as is, so lines cannot have padding (decimated frames never have it)
+		depth = FrameConversion::Decimate(depth, scale);
+		if (!depth->isPacked())
+			depth = Frame::Duplicate(depth);
 
-			// header [width][height][rgb length][depth length]
-			*((uint32_t*)&(*message)[4]) = imgWidth;
-			*((uint32_t*)&(*message)[8]) = imgHeight;
-			*((uint32_t*)&(*message)[12]) = encodedColorImage.size();
-			*((uint32_t*)&(*message)[16]) = depthImgSize;
+		image.width = depth->getWidth();
+		image.height = depth->getHeight();
+		image.format = depth->getEncoding();
+		image.stride = depth->getLineSize();
 
-			// write color frame
-			if (streamingColor)
+		std::shared_ptr<EncodedBuffer> compressedDepth = depthCodec.Compress(*depth);
+		if (compressedDepth)
+		{
+			image.owner = compressedDepth;
+			image.data = compressedDepth->data();
+			image.size = compressedDepth->size();
+			image.lengthField = DepthCodec::PackLength(depthCodec.GetType(), (uint32_t) image.size);
+			image.codec = (uint8_t) depthCodec.GetType();
+		}
+		else {
+			// raw (or compression failed)
+			image.owner = depth;
+			image.data = depth->getData();
+			image.size = depth->size();
+			image.lengthField = (uint32_t) image.size;
+		}
+
+		return image;
+	}
+
+	// rays of a depth frame of a given size (cached until intrinsics change). Depth registered to color takes
+	// the rays of the color intrinsics (colorGeometry). nullptr without intrinsics
+	std::shared_ptr<const PointCloud::RayTable> GetRayTable(bool colorGeometry, unsigned long width, unsigned long height)
+	{
+		// encoder threads wait for each other here: tables are big, so they are only computed once
+		const std::lock_guard<std::mutex> lock(rayTablesMutex);
+		const unsigned long long generation = intrinsicsGeneration;
+
+		for (const CachedRayTable& cached : rayTables)
+			if (cached.generation == generation && cached.colorGeometry == colorGeometry && cached.width == width && cached.height == height)
+				return cached.rays;
+
+		CalibratedIntrinsics calibrated;
+		{
+			const std::lock_guard<std::mutex> intrinsicsLock(intrinsicsMutex);
+			calibrated = colorGeometry ? colorIntrinsics : depthIntrinsics;
+		}
+
+		CachedRayTable cached;
+		cached.generation = generation;
+		cached.colorGeometry = colorGeometry;
+		cached.width = width;
+		cached.height = height;
+		cached.rays = PointCloud::MakeRayTable(ScaleIntrinsics(calibrated, width, height), width, height);
+		if (!cached.rays)
+			Logger::Log("Streamer") << "Warning! Cannot compute point clouds without the camera intrinsics" << std::endl;
+
+		// tables from old intrinsics go away, and so does the oldest table if there are too many
+		rayTables.erase(std::remove_if(rayTables.begin(), rayTables.end(), [generation](const CachedRayTable& table) { return table.generation != generation; }), rayTables.end());
+		if (rayTables.size() >= MaxRayTables)
+			rayTables.erase(rayTables.begin());
+		rayTables.push_back(cached);
+
+		return cached.rays;
+	}
+
+	// computes the points of a depth frame (XYZRGB falls back to XYZ if colors cannot be picked from the color frame)
+	EncodedImage EncodePoints(std::shared_ptr<Frame> depth, std::shared_ptr<Frame> color, unsigned int scale, PointCloud::Format format, unsigned int voxelSize)
+	{
+		EncodedImage image;
+		image.codec = StreamingProtocol::PointsXYZ;
+		image.stride = (uint32_t) PointCloud::BytesPerPoint(PointCloud::Format::XYZ);
+		image.height = 1;
+
+		// depth units to millimeters (cameras that do not tell use millimeters)
+		float millimetersPerUnit = 1.0f;
+		bool registered = true;
+		{
+			const std::lock_guard<std::mutex> lock(intrinsicsMutex);
+			if (depthIntrinsics.intrinsics.metricScale > 0)
+				millimetersPerUnit = depthIntrinsics.intrinsics.metricScale * 1000.0f;
+			registered = colorAndDepthRegistered;
+		}
+
+		// colors cannot be picked from a camera that depth is not registered to
+		if (!registered)
+			color = nullptr;
+
+		depth = FrameConversion::Decimate(depth, scale);
+		std::shared_ptr<const PointCloud::RayTable> rays = GetRayTable((bool) color, depth->getWidth(), depth->getHeight());
+		if (!rays)
+			return image;
+
+		// MJPEG frames are decoded close to the size of depth (colors are picked one per point anyway)
+		if (format == PointCloud::Format::XYZRGB && color && color->getEncoding() == FrameType::Encoding::MJPEG)
+			color = JPEGDecoder::Decode(*color, FrameType::Encoding::BGR24, JPEGDecoder::NativeScale(std::max(color->getWidth() / depth->getWidth(), 1ul)));
+
+		// YUV frames are converted once (custom frames have no colors to pick)
+		if (format == PointCloud::Format::XYZRGB && color && !PointCloud::CanSampleColor(*color))
+		{
+			cv::Mat bgr;
+			std::shared_ptr<Frame> converted;
+			if (FrameConversion::ToBGRMat(*color, bgr))
 			{
-				memcpy((unsigned char*)&(*message)[20], &encodedColorImage[0], encodedColorImage.size());
+				converted = Frame::Create(color->getWidth(), color->getHeight(), FrameType::Encoding::BGR24);
+				cv::Mat dst((int)converted->getHeight(), (int)converted->getWidth(), CV_8UC3, converted->getData(), converted->getLineSize());
+				bgr.copyTo(dst);
 			}
+			color = converted;
+		}
+
+		if (format == PointCloud::Format::XYZRGB && !color)
+			format = PointCloud::Format::XYZ;
+
+		std::shared_ptr<std::vector<unsigned char> > points = std::make_shared<std::vector<unsigned char> >();
+		image.width = PointCloud::Compute(*depth, color.get(), *rays, millimetersPerUnit, format, voxelSize, *points);
+		image.owner = points;
+		image.data = points->data();
+		image.size = points->size();
+		image.lengthField = (uint32_t) image.size;
+		image.codec = (format == PointCloud::Format::XYZRGB) ? StreamingProtocol::PointsXYZRGB : StreamingProtocol::PointsXYZ;
+		image.stride = (uint32_t) PointCloud::BytesPerPoint(format);
+
+		return image;
+	}
+
+	// intrinsics scaled to the size of the image that is sent
+	static StreamingProtocol::IntrinsicsV2 ScaleIntrinsics(const CalibratedIntrinsics& calibrated, unsigned long width, unsigned long height)
+	{
+		StreamingProtocol::IntrinsicsV2 intrinsics = calibrated.intrinsics;
+		if (calibrated.width == 0 || calibrated.height == 0 || width == 0 || height == 0)
+			return intrinsics;
+
+		const float scaleX = (float)width / calibrated.width, scaleY = (float)height / calibrated.height;
+		intrinsics.fx *= scaleX;
+		intrinsics.cx *= scaleX;
+		intrinsics.fy *= scaleY;
+		intrinsics.cy *= scaleY;
+		return intrinsics;
+	}
 
-			// write depth frame
-			if (streamingDepth)
+	static void DescribeStream(StreamingProtocol::StreamDescriptor& descriptor, const EncodedImage& image)
+	{
+		descriptor.width = (uint32_t) image.width;
+		descriptor.height = (uint32_t) image.height;
+		descriptor.stride = image.stride;
+		descriptor.length = (uint32_t) image.size;
+		descriptor.codec = image.codec;
+		descriptor.format = (uint8_t) image.format;
+	}
+
+	// prepares a message: a small header followed by the color and depth buffers (no copies)
+	std::shared_ptr<StreamingMessage> MakeMessage(const Rendition& rendition, const EncodedImage& colorImage, const EncodedImage& depthImage, const FramePlan& plan)
+	{
+		std::shared_ptr<StreamingMessage> message = std::make_shared<StreamingMessage>();
+		message->SetCaptureTime(plan.captureTime);
+
+		if (rendition.version == StreamingProtocol::Version2)
+		{
+			using namespace StreamingProtocol;
+
+			// header [intrinsics (and extrinsics) on keyframes]
+			const bool extrinsics = plan.keyframe && plan.hasExtrinsics;
+			const size_t headerSize = sizeof(HeaderV2) + (plan.keyframe ? 2 * sizeof(IntrinsicsV2) : 0) + (extrinsics ? sizeof(ExtrinsicsV2) : 0);
+			unsigned char* headerData = message->AllocateHeader(headerSize);
+			HeaderV2* header = (HeaderV2*) headerData;
+
+			header->length = (uint32_t) (headerSize - sizeof(header->length) + (rendition.color ? colorImage.size : 0) + (rendition.depth ? depthImage.size : 0));
+			header->magic = MagicV2;
+			header->version = Version2;
+			header->headerSize = (uint16_t) headerSize;
+			const bool points = rendition.depth && rendition.pointCloud != PointCloud::Format::None;
+			header->flags = (plan.keyframe ? Keyframe : 0) | (rendition.color ? HasColor : 0) | (rendition.depth ? HasDepth : 0) | (points ? HasPoints : 0) | (extrinsics ? HasExtrinsics : 0);
+			header->sequence = plan.sequence;
+			header->deviceTimestamp = plan.deviceTimestamp.count();
+			header->hostTimestamp = plan.hostTimestamp.count();
+
+			if (rendition.color)
+				DescribeStream(header->color, colorImage);
+			if (rendition.depth)
+				DescribeStream(header->depth, depthImage);
+
+			if (plan.keyframe)
 			{
-				memcpy((unsigned char*)&(*message)[20 + encodedColorImage.size()], (const char*)depth->getData(), depth->size());
+				IntrinsicsV2* intrinsics = (IntrinsicsV2*) (headerData + sizeof(HeaderV2));
+				intrinsics[0] = ScaleIntrinsics(plan.colorIntrinsics, colorImage.width, colorImage.height);
+				intrinsics[1] = points ? plan.depthIntrinsics.intrinsics : ScaleIntrinsics(plan.depthIntrinsics, depthImage.width, depthImage.height);
+
+				if (extrinsics)
+					*(ExtrinsicsV2*) (intrinsics + 2) = plan.depthToColor;
 			}
+
+			if (rendition.color)
+				message->AddSegment(colorImage.data, colorImage.size, colorImage.owner);
+			if (rendition.depth)
+				message->AddSegment(depthImage.data, depthImage.size, depthImage.owner);
 		}
+		else if (streamingJPEGLengthValue)
+		{
+			// header [color jpeg size] - tells clients how many bytes they should read
+			uint32_t* header = (uint32_t*) message->AllocateHeader(1 * sizeof(uint32_t));
+			header[0] = colorImage.lengthField;
+
+			message->AddSegment(colorImage.data, colorImage.size, colorImage.owner);
+		}
+		else {
+
+			uint32_t* header = (uint32_t*) message->AllocateHeader(5 * sizeof(uint32_t));
+
+			// width and height of depth (if streaming it) or color
+			const EncodedImage& sizeImage = rendition.depth ? depthImage : colorImage;
+
+			// header prefix [package length]  - tells clients how many bytes they should read
+			header[0] = 4 * sizeof(uint32_t) + colorImage.size + depthImage.size; // header size doesn't include itself
+
+			// header [width][height][rgb length][depth length] - the top 4 bits of depth length tell which depth codec was used (0 is raw)
+			header[1] = sizeImage.width;
+			header[2] = sizeImage.height;
+			header[3] = colorImage.lengthField;
+			header[4] = depthImage.lengthField;
+
+			// color frame
+			if (rendition.color)
+				message->AddSegment(colorImage.data, colorImage.size, colorImage.owner);
+
+			// depth frame
+			if (rendition.depth)
+				message->AddSegment(depthImage.data, depthImage.size, depthImage.owner);
+		}
+
+		return message;
+	}
 
+	// encodes frames once for every rendition in a plan and prepares their messages (runs on an encoder thread)
+	EncodedFrame EncodeMessage(std::shared_ptr<Frame> color, std::shared_ptr<Frame> depth, std::shared_ptr<FramePlan> plan)
+	{
+		EncodedFrame frame;
+		frame.plan = plan;
+		frame.timestamp = plan->hostTimestamp;
 
+		const std::vector<Rendition>& renditions = plan->renditions;
+		std::vector<EncodedImage> colorImages(renditions.size()), depthImages(renditions.size());
 
-		// sends to all clients
+		for (size_t i = 0; i < renditions.size(); ++i)
 		{
-			const std::lock_guard<std::mutex> lock(clientSetMutex);
+			const Rendition& rendition = renditions[i];
 
-			for (std::shared_ptr< tcp::socket> client : clients)
+			// renditions that look the same share images (e.g.: color and depth, or color only, at the same size)
+			size_t sameColor = i, sameDepth = i;
+			for (size_t other = 0; other < i; ++other)
 			{
-				// pops any message pending 
-				while (clientsQs[client].size() > 1)
-				{
-					clientsQs[client].pop();
-					clientsStatistics[client].messagesDropped++;
-				}
+				if (sameColor == i && renditions[other].color && renditions[other].colorScale == rendition.colorScale && renditions[other].jpegQuality == rendition.jpegQuality)
+					sameColor = other;
+				if (sameDepth == i && renditions[other].depth && renditions[other].SameDepthAs(rendition))
+					sameDepth = other;
+			}
 
-				// adds message to client Q
-				clientsQs[client].push(message);
-				
-				if (clientsQs[client].size() == 1)
-				{
-					// only message? let's send it
-					write_to_client_async(client);
-				}
+			if (rendition.color)
+				colorImages[i] = (sameColor != i) ? colorImages[sameColor] : EncodeColor(color, rendition.colorScale, rendition.jpegQuality);
+
+			if (rendition.depth)
+			{
+				if (sameDepth != i)
+					depthImages[i] = depthImages[sameDepth];
+				else if (rendition.pointCloud != PointCloud::Format::None)
+					depthImages[i] = EncodePoints(depth, color, rendition.depthScale, rendition.pointCloud, rendition.voxelSize);
+				else
+					depthImages[i] = EncodeDepth(depth, rendition.depthScale);
 			}
+
+			frame.messages.push_back(MakeMessage(rendition, colorImages[i], depthImages[i], *plan));
+		}
+
+		if (plan->multicastRendition < renditions.size())
+		{
+			const EncodedImage& multicastImage = colorImages[plan->multicastRendition];
+			frame.colorOwner = multicastImage.owner;
+			frame.colorData = multicastImage.data;
+			frame.colorSize = multicastImage.size;
 		}
+
+		return frame;
+	}
+
+	// hands encoded messages to the clients that get them (every client gets its message on its own strand)
+	void SendToAll(const EncodedFrame& frame)
+	{
+		// sessions drop old messages if they are falling behind (and ignore messages once disconnected)
+		for (const std::pair<std::shared_ptr<StreamingSession>, size_t>& recipient : frame.plan->recipients)
+			recipient.first->Post(frame.messages[recipient.second]);
 	}
 
 private:
@@ -236,20 +817,84 @@ private:
 	// tcp server that listens and waits for clients
 	tcp::acceptor acceptor;
 
+#ifdef BOOST_ASIO_HAS_LOCAL_SOCKETS
+	// unix domain socket for clients running on the same machine (optional)
+	std::shared_ptr<boost::asio::local::stream_protocol::acceptor> localAcceptor;
+#endif
+
 	// pointer to the thread that will be managing client connections
 	std::shared_ptr<std::thread> sThread;
 
-	// TODO: create a class for clients instead of keeping everything here
-	// set with all clients currently connected to the server
-	std::set<std::shared_ptr< tcp::socket> > clients;
-	std::map < std::shared_ptr< tcp::socket>, std::queue < std::shared_ptr < std::vector<uchar> > > > clientsQs;
-	std::map < std::shared_ptr< tcp::socket>, NetworkStatistics > clientsStatistics;
-	std::mutex clientSetMutex;
+	// threads helping sThread with the io_context
+	std::vector<std::thread> ioThreads;
+
+	// compresses color frames (shared by all encoder threads)
+	JPEGEncoder jpegEncoder;
+
+	// compresses depth frames (raw by default)
+	DepthCodec depthCodec;
+
+	// threads encoding frames
+	OrderedWorkerPool<EncodedFrame> encoderPool;
+
+	// sends color frames to a multicast group (optional)
+	std::shared_ptr<RTPMulticastSender> multicastSender;
+
+	// what clients that cannot keep up get (tier 0 is the stream as configured)
+	std::vector<QualityTier> qualityTiers;
+
+	// frames handed to the server so far (camera thread only, used to skip frames in lower tiers and as sequence numbers)
+	unsigned long long frameNumber;
+
+	// what version 2 clients get on keyframes
+	CalibratedIntrinsics colorIntrinsics, depthIntrinsics;
+
+	// cameras that do not register color and depth send where the depth camera is with respect to the color camera
+	bool colorAndDepthRegistered;
+	StreamingProtocol::ExtrinsicsV2 depthToColor;
+	std::atomic<bool> intrinsicsChanged;
+	std::mutex intrinsicsMutex;
+
+	// rays used to compute point clouds (one table per depth size)
+	struct CachedRayTable
+	{
+		unsigned long long generation;
+		bool colorGeometry;
+		unsigned long width, height;
+		std::shared_ptr<const PointCloud::RayTable> rays;
+	};
+
+	std::vector<CachedRayTable> rayTables;
+	std::mutex rayTablesMutex;
+	std::atomic<unsigned long long> intrinsicsGeneration;
+	static const size_t MaxRayTables = 4;
+
+	// most recent message encoded as configured (what new clients get first)
+	std::shared_ptr<StreamingMessage> latestMessage;
+
+	// when a frame was last encoded just to refresh latestMessage (camera thread only). latestMessage itself tells how old the frame is
+	std::chrono::steady_clock::time_point latestRefreshTime;
+
+	// how often a frame is encoded just to be kept around when no client wants it, and how old it can get before it is useless
+	static constexpr std::chrono::milliseconds LatestFrameRefreshInterval = std::chrono::milliseconds(1000);
+	static constexpr std::chrono::milliseconds LatestFrameMaxAge = std::chrono::milliseconds(2000);
+
+	// all clients currently connected to the server. The list is never changed once
+	// published: a new list replaces it when a client connects or disconnects
+	typedef std::vector<std::shared_ptr<StreamingSession> > SessionList;
+	std::shared_ptr<const SessionList> sessions;
+	std::mutex sessionsMutex;
+
+	// number of sessions (read by camera threads before bothering to encode a frame)
+	std::atomic<size_t> sessionCount;
+
+	// what new clients get
+	StreamingPreferences defaultPreferences;
 
 	// this method implements the main thread for TCPStreamingServer
 	void thread_main()
 	{
-		Logger::Log("Streamer") << "Waiting for connections on port " << appStatus->GetStreamerPort() << std::endl;
+		Logger::Log("Streamer") << "Waiting for connections on port " << appStatus->GetStreamerPort() << " (" << NetworkBackendName() << ')' << std::endl;
 	
 		// update application to tell wich streams are being enabled
 		streamingJPEGLengthValue = configuration->IsStreamingTLVJPGProtocol(); // this has precedence over the 
@@ -271,8 +916,64 @@ private:
 			Logger::Log("Streamer") << "Streaming using JPEG Length Value Protocol " << std::endl;
 		}
 
+		if (streamingColor)
+		{
+			Logger::Log("Streamer") << "JPEG quality " << jpegEncoder.GetQuality() << " (" << configuration->GetStreamingJpegSubsampling() << " subsampling"
+				<< (jpegEncoder.IsFastDCT() ? ", fast DCT" : "") << ')' << std::endl;
+		}
+
+		if (streamingDepth && depthCodec.GetType() != DepthCodec::Type::Raw)
+		{
+			Logger::Log("Streamer") << "Compressing depth with " << DepthCodec::TypeToString(depthCodec.GetType()) << std::endl;
+		}
+
+		// rtp/jpeg only carries color (and only what the receiver can rebuild the jpeg headers for)
+		if (multicastSender && !streamingColor)
+		{
+			Logger::Log("Streamer") << "Warning! Multicast only sends color frames, but color is not being streamed" << std::endl;
+		}
+		else if (multicastSender && configuration->GetStreamingJpegSubsampling() != "420" && configuration->GetStreamingJpegSubsampling() != "422")
+		{
+			Logger::Log("Streamer") << "Warning! Multicast needs streaming.jpegSubsampling to be \"420\" or \"422\"" << std::endl;
+		}
+
+		// defaults for all clients
+		defaultPreferences.maxFPS = configuration->IsStreamingThrottleMaxFPS() ? configuration->GetStreamingMaxFPS() : 0;
+		defaultPreferences.sendLowWaterMark = configuration->GetStreamingSendLowWaterMark();
+		defaultPreferences.sendBufferSize = configuration->GetStreamingSendBufferSize();
+		defaultPreferences.maxQualityTier = configuration->IsStreamingAdaptiveQuality() ? (int)qualityTiers.size() - 1 : 0;
+
+		if (configuration->IsStreamingAdaptiveQuality())
+		{
+			Logger::Log("Streamer") << "Clients that cannot keep up get lower quality streams (" << qualityTiers.size() << " tiers)" << std::endl;
+		}
+
+#ifndef TCP_NOTSENT_LOWAT
+		if (defaultPreferences.sendLowWaterMark > 0)
+		{
+			Logger::Log("Streamer") << "Warning! streaming.sendLowWaterMark is not supported on this platform. Use streaming.sendBufferSize to limit how much a client can fall behind" << std::endl;
+		}
+#endif
+
+		// io threads (this one included)
+		int threadCount = configuration->GetStreamingIOThreads();
+		if (threadCount <= 0)
+			threadCount = std::max(1u, std::thread::hardware_concurrency() / 2);
+
+		if (threadCount > 1)
+			Logger::Log("Streamer") << "Serving clients with " << threadCount << " threads" << std::endl;
+
 		aync_accept_connection(); // adds some work to the io_context, otherwise it exits
+
+		for (int i = 1; i < threadCount; ++i)
+			ioThreads.emplace_back([this]() { io_context.run(); });
+
 		io_context.run();	      // starts listening for connections
+
+		// waits for the other io threads
+		for (std::thread& ioThread : ioThreads)
+			ioThread.join();
+		ioThreads.clear();
 		
 		// make sure others knows that the thread is not running
 		streamingColor = false;
@@ -284,86 +985,113 @@ private:
 
 	// waits for connections
 	void aync_accept_connection()
+	{
+		async_accept_connection(acceptor);
+
+#ifdef BOOST_ASIO_HAS_LOCAL_SOCKETS
+		if (localAcceptor)
+			async_accept_connection(*localAcceptor);
+#endif
+	}
+
+	// waits for a connection on a given acceptor (tcp or local)
+	template <class Acceptor>
+	void async_accept_connection(Acceptor& clientAcceptor)
 	{
 		using namespace std::placeholders; // for  _1, _2, ...
+		typedef typename Acceptor::protocol_type::socket Socket;
 
-		// creates a new socket to received the connection
-		std::shared_ptr<tcp::socket> newClient = std::make_shared<tcp::socket>(io_context);
+		// creates a new socket to received the connection (on its own strand)
+		std::shared_ptr<Socket> newClient = std::make_shared<Socket>(boost::asio::make_strand(io_context));
 
 		// waits for a new connection
-		acceptor.async_accept(*newClient, std::bind(&TCPStreamingServer::async_handle_accept, this, newClient, _1));
+		clientAcceptor.async_accept(*newClient, std::bind(&TCPStreamingServer::async_handle_accept<Acceptor>, this, std::ref(clientAcceptor), newClient, _1));
 	}
 
-	// as soon as a new client connects, adds client to the list and waits for a new connection
-	void async_handle_accept(std::shared_ptr<tcp::socket> newClient, const boost::system::error_code& error)
+	// remote address and port of a client (for logs and statistics)
+	void RemoteEndpoint(tcp::socket& client, std::string& address, int& port)
 	{
-		// adds a new client to the list
+		boost::system::error_code error;
+		tcp::endpoint remote = client.remote_endpoint(error);
 		if (!error)
 		{
-			const std::lock_guard<std::mutex> lock(clientSetMutex);
-			clients.insert(newClient);
-			clientsQs[newClient] = std::queue<std::shared_ptr<std::vector<uchar> > >(); // creates a new Q for this client
-			clientsStatistics[newClient] = NetworkStatistics(true);						// starts trackings stats for this client
-			clientsStatistics[newClient].remoteAddress = newClient->remote_endpoint().address().to_string();
-			clientsStatistics[newClient].remotePort = newClient->remote_endpoint().port();
-
-
-			Logger::Log("Streamer") << "New client connected: " << clientsStatistics[newClient].remoteAddress << ':' << clientsStatistics[newClient].remotePort << std::endl;
+			address = remote.address().to_string();
+			port = remote.port();
 		}
+	}
 
-		// accepts a new connection
-		aync_accept_connection();
+#ifdef BOOST_ASIO_HAS_LOCAL_SOCKETS
+	void RemoteEndpoint(boost::asio::local::stream_protocol::socket& client, std::string& address, int& port)
+	{
+		// local clients are usually unnamed, so they go by the path they connected to
+		address = configuration->GetStreamingLocalSocketPath();
+		port = 0;
 	}
+#endif
 
-	// called when done writing to cleint
-	void write_done(std::shared_ptr<tcp::socket> client, std::shared_ptr < std::vector<uchar> > buffer,
-		            const boost::system::error_code& error, std::size_t bytes_transferred)
+	// as soon as a new client connects, adds client to the list and waits for a new connection
+	template <class Acceptor>
+	void async_handle_accept(Acceptor& clientAcceptor, std::shared_ptr<typename Acceptor::protocol_type::socket> newClient, const boost::system::error_code& error)
 	{
-		// there's nothing much we can do here besides remove the client if we get an error sending to it
-		if (error)
+		using namespace std::placeholders; // for  _1, _2, ...
+		typedef typename Acceptor::protocol_type::socket Socket;
+
+		// acceptor closed (server stopped)
+		if (error == boost::asio::error::operation_aborted)
+			return;
+
+		// adds a new client to the list
+		if (!error)
 		{
+			std::string remoteAddress;
+			int remotePort = 0;
+			RemoteEndpoint(*newClient, remoteAddress, remotePort);
+
+			std::shared_ptr<StreamingSession> session = BasicStreamingSession<Socket>::Create(newClient, remoteAddress, remotePort, defaultPreferences,
+				std::bind(&TCPStreamingServer::session_disconnected, this, _1));
+
+			// no need to wait for the camera: the last frame goes out first (posted before the session gets any new frame)
+			std::shared_ptr<StreamingMessage> latest = GetLatestFrame();
+			if (latest)
+				session->Post(latest);
+
 			{
-				const std::lock_guard<std::mutex> lock(clientSetMutex);
-				if (clients.find(client) != clients.end())
-				{
-					clientsStatistics[client].disconnected();
-					clientsStatistics[client].messagesDropped++;
-
-					Logger::Log("Streamer") << "Client " << clientsStatistics[client].remoteAddress << ':' << clientsStatistics[client].remotePort << " disconnected" << std::endl;
-					Logger::Log("Streamer") << "[Stats] Sent client " << clientsStatistics[client].remoteAddress << ':' << clientsStatistics[client].remotePort << " --> "
-						<< clientsStatistics[client].bytesSent << " bytes (" << clientsStatistics[client].messagesSent << " packets sent and " << clientsStatistics[client].messagesDropped << " dropped) -"
-						<< " Duration: " << std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now() - clientsStatistics[client].connectedTime).count() / 1000.0f << " sec" << std::endl;
-					
-					clientsQs.erase(client);
-					clients.erase(client);
-					clientsStatistics.erase(client);
-				}
+				const std::lock_guard<std::mutex> lock(sessionsMutex);
+				std::shared_ptr<SessionList> newSessions = std::make_shared<SessionList>(*sessions);
+				newSessions->push_back(session);
+				sessionCount = newSessions->size();
+				std::atomic_store(&sessions, std::shared_ptr<const SessionList>(newSessions));
 			}
-			return;
-		}
 
-		// pops the last read
-		clientsQs[client].pop();
-		clientsStatistics[client].messagesSent++;
-		clientsStatistics[client].bytesSent += bytes_transferred;
+			Logger::Log("Streamer") << "New client connected: " << session->RemoteAddress() << ':' << session->RemotePort() << std::endl;
+
+			// clients can subscribe to what they want any time
+			session->Start();
+		}
 
-		// moves on
-		write_to_client_async(client);
+		// accepts a new connection
+		async_accept_connection(clientAcceptor);
 	}
 
-	void write_to_client_async(std::shared_ptr<tcp::socket> client)
+	// called by a session (on its strand) when it loses its connection
+	void session_disconnected(std::shared_ptr<StreamingSession> session)
 	{
-		using namespace std::placeholders; // for  _1, _2, ...
-
-		// nothing to write -> done with asynchronous writings
-		if (!clientsQs[client].size())
-			return;
+		const std::lock_guard<std::mutex> lock(sessionsMutex);
+		std::shared_ptr<SessionList> newSessions = std::make_shared<SessionList>(*sessions);
 
-		// something to write? let's pop it!
-		std::shared_ptr<std::vector<uchar > > message = clientsQs[client].back();
+		// order doesn't matter, so the last session takes its place
+		for (size_t i = 0; i < newSessions->size(); ++i)
+		{
+			if ((*newSessions)[i] == session)
+			{
+				(*newSessions)[i] = newSessions->back();
+				newSessions->pop_back();
+				break;
+			}
+		}
 
-		// starts writing for this client
-		boost::asio::async_write(*client, boost::asio::buffer(*message, message->size()), std::bind(&TCPStreamingServer::write_done, this, client, message, _1, _2));
+		sessionCount = newSessions->size();
+		std::atomic_store(&sessions, std::shared_ptr<const SessionList>(newSessions));
 	}
 
 };
@@ -0,0 +1,236 @@
+#include "UDPMulticastRelayCamera.h"
+
+
+
+// we have compilation flags that determine whether this feature
+// is supported or not
+#include "CompilerConfiguration.h"
+#ifdef CS_ENABLE_CAMERA_MULTICAST_RELAY
+
+#include <iostream>
+
+
+const char* UDPMulticastRelayCamera::UDPMulticastRelayCameraConstStr = "MulticastRelayCam";
+
+bool UDPMulticastRelayCamera::LoadConfigurationSettings()
+{
+
+	// makes sure to invoke base class implementation of settings
+	if (Camera::LoadConfigurationSettings())
+	{
+		groupAddr = configuration->GetCameraCustomString("group", "239.255.0.1", false);
+		groupPort = configuration->GetCameraCustomInt("port", 5004, false);
+		interfaceAddr = configuration->GetCameraCustomString("interface", "", false);
+
+		// frames arrive as RTP/JPEG packets
+		packetReader = std::static_pointer_cast<RTPJPEGProtocolReader>(RTPJPEGProtocolReader::Create());
+		colorFrameEncoding = FrameType::Encoding::MJPEG;
+
+		cameraSerialNumber = packetReader->ProtocolName() + ":\\" + groupAddr + std::string(":") + std::to_string(groupPort);
+
+		return true;
+	}
+	return false;
+}
+
+
+void UDPMulticastRelayCamera::onStreamStarted()
+{
+	// start keeping track of incoming frames / failed frames
+	statistics.StartCounting();
+	framesDroppedBefore = packetReader->getFramesDropped();
+
+	colorCameraEnabled = true;
+	depthCameraEnabled = false;
+
+	colorCameraParameters.resolutionWidth = packetReader->getColorFrameWidth();
+	colorCameraParameters.resolutionHeight = packetReader->getColorFrameHeight();
+
+	// updates app with capture and stream status
+	appStatus->UpdateCaptureStatus(colorCameraEnabled, depthCameraEnabled, cameraSerialNumber,
+		OpenCVCameraMatrix(colorCameraParameters),
+
+		// color camera
+		colorCameraParameters.resolutionWidth, colorCameraParameters.resolutionHeight,
+
+		// depth camera
+		0, 0,
+
+		// streaming
+		colorCameraParameters.resolutionWidth, colorCameraParameters.resolutionHeight);
+
+	Logger::Log(UDPMulticastRelayCameraConstStr) << "Started capturing (" << colorCameraParameters.resolutionWidth << 'x' << colorCameraParameters.resolutionHeight << ')' << std::endl;
+
+	// tell others that the camera connected
+	didWeCallConnectedCallback = true;
+	if (onCameraConnect)
+		onCameraConnect();
+}
+
+void UDPMulticastRelayCamera::onStreamStopped()
+{
+	if (!IsAnyCameraEnabled())
+		return;
+
+	// stop statistics
+	statistics.framesFailed += packetReader->getFramesDropped() - framesDroppedBefore;
+	statistics.StopCounting();
+
+	Logger::Log(UDPMulticastRelayCameraConstStr) << "Stopped capturing (" << statistics.framesCaptured << " frames received and " << statistics.framesFailed << " incomplete)" << std::endl;
+
+	// let other threads know that we are not capturing anymore
+	appStatus->UpdateCaptureStatus(false, false);
+
+	depthCameraEnabled = false;
+	colorCameraEnabled = false;
+
+	// calls the camera disconnect callback if we called onCameraConnect() - consistency
+	if (didWeCallConnectedCallback && onCameraDisconnect)
+		onCameraDisconnect();
+
+	didWeCallConnectedCallback = false;
+}
+
+
+void UDPMulticastRelayCamera::startAsyncReceive()
+{
+	using namespace std::placeholders; // for  _1, _2, ...
+	socket.async_receive(boost::asio::buffer(datagramBuffer), std::bind(&UDPMulticastRelayCamera::onDatagramReceived, this, _1, _2));
+}
+
+void UDPMulticastRelayCamera::startFrameTimeout()
+{
+	using namespace std::placeholders; // for  _1, _2, ...
+	frameReceivedSinceTimeout = false;
+	frameTimer.expires_after(getFrameTimeout);
+	frameTimer.async_wait(std::bind(&UDPMulticastRelayCamera::onFrameTimeout, this, _1));
+}
+
+
+void UDPMulticastRelayCamera::onDatagramReceived(const boost::system::error_code& e, std::size_t bytesReceived)
+{
+	if (e == boost::asio::error::operation_aborted || !thread_running)
+		return;
+
+	if (e)
+	{
+		// e.g.: a datagram larger than our buffer. Next one might be fine
+		Logger::Log(UDPMulticastRelayCameraConstStr) << "Error receiving datagram: " << e.message() << std::endl;
+	}
+	else if (packetReader->ParseHeader(datagramBuffer.data(), bytesReceived) && packetReader->ParseFrame(datagramBuffer.data(), bytesReceived))
+	{
+		// is this the first frame in a while?
+		if (!IsAnyCameraEnabled())
+			onStreamStarted();
+
+		++statistics.framesCaptured;
+		frameReceivedSinceTimeout = true;
+
+		// invoke frame ready callback
+		if (onFramesReady)
+			onFramesReady(packetReader->getLastFrameTimestamp(), packetReader->getLastColorFrame(), nullptr, nullptr);
+	}
+
+	// next datagram
+	startAsyncReceive();
+}
+
+void UDPMulticastRelayCamera::onFrameTimeout(const boost::system::error_code& e)
+{
+	if (e == boost::asio::error::operation_aborted)
+		return;
+
+	// the camera was stopped: closing the socket lets io_context.run() return
+	if (!thread_running)
+	{
+		boost::system::error_code closeError;
+		socket.close(closeError);
+		return;
+	}
+
+	// no frames for a while
+	if (!frameReceivedSinceTimeout && IsAnyCameraEnabled())
+	{
+		Logger::Log(UDPMulticastRelayCameraConstStr) << "No frames received in " << getFrameTimeoutMSInt << " ms" << std::endl;
+		onStreamStopped();
+	}
+
+	startFrameTimeout();
+}
+
+
+void UDPMulticastRelayCamera::CameraLoop()
+{
+	Logger::Log(UDPMulticastRelayCameraConstStr) << "Started UDP Multicast Relay Camera thread: " << std::this_thread::get_id() << std::endl;
+
+	while (thread_running)
+	{
+		//  makes sure to execute a disconnect callback whenever a connected callback has been called
+		didWeCallConnectedCallback = false;
+
+		// read configuration (todo: make async)
+		while (!LoadConfigurationSettings() && thread_running)
+		{
+			Logger::Log(UDPMulticastRelayCameraConstStr) << "Trying again in 5 seconds..." << std::endl;
+			std::this_thread::sleep_for(std::chrono::seconds(5));
+		}
+
+		//  if we stop the application while waiting...
+		if (!thread_running) break;
+
+		Logger::Log(UDPMulticastRelayCameraConstStr) << "Using protocol " << packetReader->ProtocolName() << std::endl;
+
+		// async event loop: receive datagrams until stopped
+		try
+		{
+			using boost::asio::ip::udp;
+			const boost::asio::ip::address group = boost::asio::ip::make_address(groupAddr);
+
+			// several receivers on the same machine can join the same group
+			socket.open(group.is_v6() ? udp::v6() : udp::v4());
+			socket.set_option(udp::socket::reuse_address(true));
+			socket.bind(udp::endpoint(group.is_v6() ? udp::v6() : udp::v4(), (unsigned short)groupPort));
+
+			// frames arrive in bursts of datagrams
+			boost::system::error_code optionError;
+			socket.set_option(boost::asio::socket_base::receive_buffer_size(8 * 1024 * 1024), optionError);
+
+			if (!interfaceAddr.empty() && group.is_v4())
+				socket.set_option(boost::asio::ip::multicast::join_group(group.to_v4(), boost::asio::ip::make_address_v4(interfaceAddr)));
+			else
+				socket.set_option(boost::asio::ip::multicast::join_group(group));
+
+			Logger::Log(UDPMulticastRelayCameraConstStr) << "Joined " << groupAddr << ':' << groupPort << std::endl;
+
+			startAsyncReceive();
+			startFrameTimeout();
+
+			// runs the async event loop until an exception happens or until we are done
+			io_context.restart();
+			io_context.run();
+		}
+		catch (const std::exception& e)
+		{
+			Logger::Log(UDPMulticastRelayCameraConstStr) << "Unexpected error " << e.what() << std::endl;
+			std::this_thread::sleep_for(std::chrono::seconds(5));
+		}
+
+		//
+		// got out of the read loop. everything should've been shut, but just in case
+		//
+
+		boost::system::error_code closeError;
+		socket.close(closeError);
+		frameTimer.cancel();
+
+		onStreamStopped();
+
+		if (thread_running)
+		{
+			Logger::Log(UDPMulticastRelayCameraConstStr) << "Restarting device..." << std::endl;
+		}
+	}
+
+}
+
+#endif
@@ -0,0 +1,147 @@
+#pragma once
+
+// we have compilation flags that determine whether this feature
+// is supported or not
+#include "CompilerConfiguration.h"
+#ifdef CS_ENABLE_CAMERA_MULTICAST_RELAY
+
+// stl
+#include <string>
+#include <vector>
+
+// our framework
+#include "Logger.h"
+#include "Configuration.h"
+#include "ApplicationStatus.h"
+#include "Frame.h"
+#include "Camera.h"
+
+// boost requirements for this camera
+#include <boost/asio.hpp>
+
+// network protocols
+#include "RTPJPEGProtocolReader.h"
+
+/**
+  UDP Multicast Relay camera joins a multicast group and relays the JPEG frames
+  sent to it over RTP (RFC 2435) - e.g.: by another CameraStreamer with the
+  "multicast" section enabled.
+
+  Any number of machines can join the same group: the sender's egress does not
+  change. Frames missing packets are dropped (there are no retransmissions).
+  Frames are relayed as JPEGs (custom encoding), so they are streamed as they are.
+
+  Generic configuration settings implemented:
+  * type : "multicast-relay"
+
+  UDPMulticastRelayCamera-specific configuration elements:
+  * group: multicast group this camera should join (default: 239.255.0.1)
+  * port: port frames are sent to (default: 5004)
+  * interface: address of the network interface used to join the group (default: system default)
+
+  The camera is considered disconnected when no frame arrives for longer than the frame timeout.
+ */
+class UDPMulticastRelayCamera : public Camera
+{
+	// group and port as found in the configuration file
+	std::string groupAddr;
+	int groupPort;
+
+	// interface used to join the group (empty means system default)
+	std::string interfaceAddr;
+
+protected:
+
+	// method that finds a suitable camera given what is set in the app status
+	bool LoadConfigurationSettings();
+
+	// camera loop responsible for receiving frames, transforming them, and invoking callbacks
+	virtual void CameraLoop();
+
+	// used in all camera logs
+	static const char* UDPMulticastRelayCameraConstStr;
+
+	//
+	// this class uses an asynchronous socket
+	// so it needs to handle all socket events in separate methods
+	//
+
+	void onDatagramReceived(const boost::system::error_code& e, std::size_t bytesReceived);
+	void onFrameTimeout(const boost::system::error_code& e);
+
+	void startAsyncReceive();
+	void startFrameTimeout();
+
+	// reports that frames are coming (first frame) or that they stopped coming
+	void onStreamStarted();
+	void onStreamStopped();
+
+	//
+	// the following variables help us understand the state of the network camera
+	//
+
+	bool didWeCallConnectedCallback;	// if true, we have to call the disconnected callback
+	bool frameReceivedSinceTimeout;		// false if the frame timeout expired without any frames
+	unsigned long long framesDroppedBefore;	// incomplete frames before frames started coming
+	boost::asio::io_context io_context;	// all asio methods rely on io_context.
+
+	// socket that joined the multicast group
+	boost::asio::ip::udp::socket socket;
+
+	// object used for frame timeouts (and to notice that the camera was stopped)
+	boost::asio::steady_timer frameTimer;
+
+	// memory buffer for a single datagram
+	std::vector<unsigned char> datagramBuffer;
+
+	// pointer to code responsible for putting frames back together
+	std::shared_ptr<RTPJPEGProtocolReader> packetReader;
+
+public:
+
+	/**
+	  This method creates a shared pointer to this camera implementation
+	*/
+	static std::shared_ptr<Camera> Create(std::shared_ptr<ApplicationStatus> appStatus, std::shared_ptr<Configuration> configuration)
+	{
+		return std::make_shared<UDPMulticastRelayCamera>(appStatus, configuration);
+	}
+
+	UDPMulticastRelayCamera(std::shared_ptr<ApplicationStatus> appStatus, std::shared_ptr<Configuration> configuration) : Camera(appStatus, configuration),
+		groupPort(0), didWeCallConnectedCallback(false), frameReceivedSinceTimeout(false), framesDroppedBefore(0), socket(io_context), frameTimer(io_context), datagramBuffer(65536)
+	{
+
+	}
+
+	~UDPMulticastRelayCamera()
+	{
+		Stop();
+	}
+
+	virtual void Stop()
+	{
+		// stop thread first
+		Camera::Stop();
+
+		// frees resources
+		if (IsAnyCameraEnabled())
+		{
+			depthCameraEnabled = false;
+			colorCameraEnabled = false;
+		}
+	}
+
+
+	virtual bool AdjustGainBy(int gain_level)
+	{
+		return false;
+
+	}
+
+	virtual bool AdjustExposureBy(int exposure_level)
+	{
+		return false;
+	}
+};
+
+#endif
@@ -1,6 +1,9 @@
 #pragma once
 
+#include "CompilerConfiguration.h"
 #include "Frame.h"
+#include "FrameConversion.h"
+#include "DepthCodec.h"
 
 #include <iostream>
 #include <iomanip>
@@ -51,6 +54,13 @@ class VideoRecorder
 	cv::VideoWriter colorVideoWriter;
 	std::ofstream depthVideoWriter;
 
+	// frames the camera compressed (MJPEG) are written as they are instead of going through colorVideoWriter
+	std::ofstream colorJPEGWriter;
+	int internalColorWidth, internalColorHeight, internalColorFPS;
+
+	// compresses depth frames before they are written to file (raw by default)
+	std::shared_ptr<DepthCodec> depthCodec;
+
 
 	// externalIsRecordingColor/externalIsRecordingDepth represent the status of VideoRecorder
 	// when all events have been processed (and not what it is currently doing)
@@ -100,15 +110,19 @@ class VideoRecorder
 	void InternalStopRecording()
 	{
 		// are we recording?
-		if (colorVideoWriter.isOpened())
+		if (colorVideoWriter.isOpened() || colorJPEGWriter.is_open())
 		{
-			colorVideoWriter.release();
+			if (colorVideoWriter.isOpened())
+				colorVideoWriter.release();
+			else
+				colorJPEGWriter.close();
 			Logger::Log("Recorder") << "Closed file " << internalFilenameColor << " after recording " << internalColorFramesRecorded << " frames (" << internalColorFramesDropped << " dropped)" << std::endl;
 		}
 
 		if (depthVideoWriter.is_open())
 		{
 			depthVideoWriter.close();
+			depthCodec.reset();
 			Logger::Log("Recorder") << "Closed file " << internalFilenameDepth << " after recording " << internalDepthFramesRecorded << " frames (" << internalDepthFramesDropped << " dropped)" << std::endl;
 		}
 
@@ -122,7 +136,7 @@ class VideoRecorder
 
 	// similar to InternalStopRecording. This method is guaranteed to be called by the VideoRecorder thread
 	void InternalStartRecording(const std::string& colorPath, const std::string& depthPath, bool recordColor, bool recordDepth,
-								int colorWidth, int colorHeight, int depthWidth, int depthHeight, int colorFPS)
+								int colorWidth, int colorHeight, int depthWidth, int depthHeight, int colorFPS, DepthCodec::Type depthCodecType)
 	{
 		// there is a small change that an external request to start a new recording
 		// while a recording is already happening will be ignored because another thread
@@ -139,20 +153,10 @@ class VideoRecorder
 		internalIsRecordingColor = recordColor;
 		internalIsRecordingDepth = recordDepth;
 
-		try
-		{
-			// prepare the files
-			if (internalIsRecordingColor)
-			{
-	//			vw.open(filenameDepth, cv::VideoWriter::fourcc('F', 'M', 'P', '4'), 30, cv::Size(KinectV2Source::cColorWidth, KinectV2Source::cColorHeight));
-				colorVideoWriter.open(internalFilenameColor, cv::VideoWriter::fourcc('F', 'M', 'P', '4'), colorFPS, cv::Size(colorWidth, colorHeight));
-			}
-		}
-		catch (const std::exception& e)
-		{
-			internalIsRecordingColor = false; // sorry
-			Logger::Log("Recorder") << "Error creating color video stream: " << e.what() << std::endl;
-		}
+		// the color file is opened with the first color frame (see InternalOpenColorFile)
+		internalColorWidth = colorWidth;
+		internalColorHeight = colorHeight;
+		internalColorFPS = colorFPS;
 
 		try
 		{
@@ -161,10 +165,13 @@ class VideoRecorder
 				// open depth file
 				depthVideoWriter.open(internalFilenameDepth, std::ios::out | std::ios::binary);
 
+				// compressed depth frames are written as [ticks][length][compressed frame] instead of [ticks][frame]
+				depthCodec = std::make_shared<DepthCodec>(depthCodecType);
+
 				// save ugly depth header
 				std::stringstream header;
 				header << "{\"filetype\":\"depth\", \"datatype\": \"numpy.int16\", \"resolution\": [";
-				header << depthWidth << ", " << depthHeight << "]}\n";
+				header << depthWidth << ", " << depthHeight << "], \"codec\": \"" << DepthCodec::TypeToString(depthCodecType) << "\"}\n";
 				std::string headerStr = header.str();
 				depthVideoWriter.write(headerStr.c_str(), headerStr.length());
 			}
@@ -177,6 +184,45 @@ class VideoRecorder
 
 	}
 
+	// opens the color file once the first frame tells us what the camera sends. MJPEG frames are stored as they are
+	// (no decoding nor encoding) in a file like the depth one: a json header followed by [ticks][length][jpeg image]
+	void InternalOpenColorFile(const Frame& colorFrame)
+	{
+		try
+		{
+			if (colorFrame.getEncoding() == FrameType::Encoding::MJPEG)
+			{
+				internalFilenameColor = std::filesystem::path(internalFilenameColor).replace_extension(".mjpeg").string();
+				colorJPEGWriter.open(internalFilenameColor, std::ios::out | std::ios::binary);
+
+				std::stringstream header;
+				header << "{\"filetype\":\"color\", \"codec\": \"jpeg\", \"resolution\": [";
+				header << internalColorWidth << ", " << internalColorHeight << "], \"fps\": " << internalColorFPS << "}\n";
+				std::string headerStr = header.str();
+				colorJPEGWriter.write(headerStr.c_str(), headerStr.length());
+
+				appStatus->UpdateRecordingColorPath(internalFilenameColor);
+			}
+			else {
+	//			vw.open(filenameDepth, cv::VideoWriter::fourcc('F', 'M', 'P', '4'), 30, cv::Size(KinectV2Source::cColorWidth, KinectV2Source::cColorHeight));
+				colorVideoWriter.open(internalFilenameColor, cv::VideoWriter::fourcc('F', 'M', 'P', '4'), internalColorFPS, cv::Size(internalColorWidth, internalColorHeight));
+			}
+		}
+		catch (const std::exception& e)
+		{
+			internalIsRecordingColor = false; // sorry
+			Logger::Log("Recorder") << "Error creating color video stream: " << e.what() << std::endl;
+		}
+	}
+
+	// depth codec as described in the configuration file (raw if invalid)
+	DepthCodec::Type RecordingDepthCodecType()
+	{
+		DepthCodec::Type type = DepthCodec::Type::Raw;
+		DepthCodec::TypeFromString(appStatus->GetRecordingDepthCodec(), type);
+		return type;
+	}
+
 	// work that keeps the thread busy
 	std::shared_ptr<boost::asio::io_context::work> m_work;
 
@@ -188,14 +234,43 @@ class VideoRecorder
 
 		if (colorFrame)
 		{
-			if (internalIsRecordingColor && colorVideoWriter.isOpened())
+			if (internalIsRecordingColor && !colorVideoWriter.isOpened() && !colorJPEGWriter.is_open())
+				InternalOpenColorFile(*colorFrame);
+
+			if (internalIsRecordingColor && colorJPEGWriter.is_open())
+			{
+				try
+				{
+					if (colorFrame->getEncoding() == FrameType::Encoding::MJPEG)
+					{
+						uint32_t jpegLength = (uint32_t) colorFrame->size();
+						colorJPEGWriter.write((const char*)& ticksSoFar, sizeof(long long));
+						colorJPEGWriter.write((const char*)& jpegLength, sizeof(uint32_t));
+						colorJPEGWriter.write((const char*) colorFrame->getData(), jpegLength);
+						++internalColorFramesRecorded;
+					}
+					else {
+						++internalColorFramesDropped;
+					}
+				}
+				catch (const std::exception& e)
+				{
+					++internalColorFramesDropped;
+				}
+			}
+			else if (internalIsRecordingColor && colorVideoWriter.isOpened())
 			{
 				try
 				{
-					unsigned int type = (colorFrame->getPixelLen() == 3) ? CV_8UC3 : CV_8UC4;
-					cv::Mat frame(colorFrame->getHeight(), colorFrame->getWidth() , type, colorFrame->getData());
-					colorVideoWriter.write(frame);
-					++internalColorFramesRecorded;
+					cv::Mat frame;
+					if (FrameConversion::ToBGRMat(*colorFrame, frame))
+					{
+						colorVideoWriter.write(frame);
+						++internalColorFramesRecorded;
+					}
+					else {
+						++internalColorFramesDropped;
+					}
 				}
 				catch (const std::exception& e)
 				{
@@ -213,9 +288,30 @@ class VideoRecorder
 			{
 				try
 				{
-					depthVideoWriter.write((const char*)& ticksSoFar, sizeof(long long));
-					depthVideoWriter.write((const char*) depthFrame->getData(), depthFrame->size());
-					++internalDepthFramesRecorded;
+					// frames have to be written without padding
+					if (!depthFrame->isPacked())
+						depthFrame = Frame::Duplicate(depthFrame);
+
+					if (depthCodec && depthCodec->GetType() != DepthCodec::Type::Raw)
+					{
+						std::shared_ptr<EncodedBuffer> compressedDepth = depthCodec->Compress(*depthFrame);
+						if (compressedDepth)
+						{
+							uint32_t compressedLength = (uint32_t) compressedDepth->size();
+							depthVideoWriter.write((const char*)& ticksSoFar, sizeof(long long));
+							depthVideoWriter.write((const char*)& compressedLength, sizeof(uint32_t));
+							depthVideoWriter.write((const char*) compressedDepth->data(), compressedLength);
+							++internalDepthFramesRecorded;
+						}
+						else {
+							++internalDepthFramesDropped;
+						}
+					}
+					else {
+						depthVideoWriter.write((const char*)& ticksSoFar, sizeof(long long));
+						depthVideoWriter.write((const char*) depthFrame->getData(), depthFrame->size());
+						++internalDepthFramesRecorded;
+					}
 				}
 				catch (const std::exception & e)
 				{
@@ -236,6 +332,7 @@ public:
 
 	VideoRecorder(std::shared_ptr<ApplicationStatus> appStatus, const std::string& filePrefix = "StandardCamera") :
 	appStatus(appStatus), acceptNewTasks(false), internalIsRecordingColor(false), internalIsRecordingDepth(false),
+	internalColorWidth(0), internalColorHeight(0), internalColorFPS(0),
 	externalIsRecordingColor(false), externalIsRecordingDepth(false), externalColorTakeNumber(1), externalDepthTakeNumber(1),
 	externalColorWidth(0), externalColorHeight(0), externalDepthWidth(0), externalDepthHeight(0), filePrefix(filePrefix),
 	framesLeft(0), internalColorFramesRecorded(0), internalDepthFramesRecorded(0), internalColorFramesDropped(0), internalDepthFramesDropped(0)
@@ -439,7 +536,7 @@ public:
 
 		// we start recording internally
 		// whenever possible, that is (adds event to the end of the queue)
-		boost::asio::post(io_context, std::bind(&VideoRecorder::InternalStartRecording, this, colorVideoPath, depthVideoPath, color, depth, externalColorWidth, externalColorHeight, externalDepthWidth, externalDepthHeight, appStatus->GetCameraColorFPS()));
+		boost::asio::post(io_context, std::bind(&VideoRecorder::InternalStartRecording, this, colorVideoPath, depthVideoPath, color, depth, externalColorWidth, externalColorHeight, externalDepthWidth, externalDepthHeight, appStatus->GetCameraColorFPS(), RecordingDepthCodecType()));
 		
 		// we start accepting frame requests
 		appStatus->UpdateRecordingStatus(true, color, depth, colorVideoPath, depthVideoPath, filenameColor, filenameDepth);
@@ -528,6 +625,13 @@ public:
 			}
 		}
 
+		// the queue has no bound, so frames that borrow SDK memory (Frame::Wrap) are copied into pooled frames:
+		// a recorder falling behind would otherwise keep the SDK from capturing new frames
+		if (color && color->isWrapped())
+			color = Frame::Duplicate(color);
+		if (depth && depth->isWrapped())
+			depth = Frame::Duplicate(depth);
+
 		// good to go!
 		boost::asio::post(io_context, std::bind(&VideoRecorder::InternalRecordFrame, this, timenow, color, depth));
 		return true;
@@ -45,6 +45,10 @@ stream = socket.socket(socket.AF_INET, socket.SOCK_STREAM)
 stream.connect((ADDR, PORT))
 print("Successfully connected to stream on port", (PORT))
 
+# optional: only ask for what we need (e.g.: a color thumbnail at 10 fps). Clients that don't subscribe get everything
+# subscription = b'{"type": "subscribe", "color": true, "depth": false, "width": 320, "maxFPS": 10}'
+# stream.sendall(len(subscription).to_bytes(4, "little") + subscription)
+
 
 def receivedEntireMessage(sock, length):
   chunks = []
@@ -64,6 +68,10 @@ while True:
   height = int.from_bytes(receivedEntireMessage(stream, 4), "little")
   colorLen = int.from_bytes(receivedEntireMessage(stream, 4), "little") # 0 if no color frame
   depthLen = int.from_bytes(receivedEntireMessage(stream, 4), "little") # 0 if no depth frame
+
+  # top 4 bits of the depth length tell which codec was used (0 is raw, 1 rvl, 2 zstd, 3 lz4)
+  depthCodec = depthLen >> 28
+  depthLen = depthLen & 0x0FFFFFFF
   
   print("Got frame with (w=%d,h=%d,color=%d,depth=%d)" % (width, height, colorLen, depthLen))
 
@@ -82,7 +90,7 @@ while True:
     cv2.imshow('Color', frame)
 
   # show depth if enabled
-  if (depthLen > 0):
+  if (depthLen > 0 and depthCodec == 0):
     deptharray = numpy.fromstring(depthData, numpy.uint16).reshape(height,width)
     cv2.imshow('Depth', cv2.normalize(deptharray, dst=None, alpha=0, beta=65535, norm_type=cv2.NORM_MINMAX))
 